@@ -6,17 +6,22 @@
 
 #include "stdafx.h"
 #include "pms_util.h"
+#include "pms_random.h"
 #include "pms_propagation.h"
+#include "pms_preprocess.h"
 #include "PatchMatchStereo.h"
+#include <memory>
 
 
-PatchMatchStereo::PatchMatchStereo(): width_(0), height_(0), img_left_(nullptr), img_right_(nullptr),
+PatchMatchStereo::PatchMatchStereo(): width_(0), height_(0), img_left_(), img_right_(),
                                       gray_left_(nullptr), gray_right_(nullptr),
                                       grad_left_(nullptr), grad_right_(nullptr),
                                       cost_left_(nullptr), cost_right_(nullptr), 
                                       disp_left_(nullptr), disp_right_(nullptr),
                                       plane_left_(nullptr), plane_right_(nullptr),
-                                      is_initialized_(false) { }
+                                      arena_(nullptr), arena_capacity_(0), is_huge_arena_(false),
+                                      is_initialized_(false), is_pyramid_init_(false),
+                                      is_stream_init_(false), num_frames_(0) { }
 
 PatchMatchStereo::~PatchMatchStereo() { Release(); }
 
@@ -25,83 +30,300 @@ bool PatchMatchStereo::Initialize(const sint32 & width, const sint32 & height, c
 	width_ = width;
 	height_ = height;
 	option_ = option;
+	num_frames_ = 0;
 	if (width <= 0 || height <= 0) return false;
 
-	// 分配内存空间
+	// 分配内存空间: 所有缓存位于同一块对齐的内存, 已有容量足够时直接复用
 	const sint32 img_size = width * height;
-	const sint32 disp_range = option.max_disparity - option.min_disparity;
+	const uint64 bytes = AssignBuffers(nullptr, img_size);
+	if (bytes > arena_capacity_ || option.is_huge_pages != is_huge_arena_) {
+		pms_util::AlignedFree(arena_);
+		arena_ = static_cast<uint8*>(pms_util::AlignedAlloc(bytes, 64, option.is_huge_pages));
+		arena_capacity_ = arena_ ? bytes : 0;
+		is_huge_arena_ = option.is_huge_pages;
+	}
+	if (arena_ == nullptr) {
+		is_initialized_ = false;
+		return false;
+	}
+	AssignBuffers(arena_, img_size);
+
+	is_initialized_ = true;
+
+	return is_initialized_;
+}
+
+uint64 PatchMatchStereo::AssignBuffers(uint8* base, const sint32& img_size)
+{
+	const uint64 align = 64;
+	uint64 offset = 0;
+	const auto take = [base, &offset, align](const uint64& bytes) {
+		uint8* ptr = base ? base + offset : nullptr;
+		offset += (bytes + align - 1) / align * align;
+		return ptr;
+	};
+	const uint64 n = img_size > 0 ? static_cast<uint64>(img_size) : 0;
 	// 灰度数据
-	gray_left_ = new uint8[img_size];
-	gray_right_ = new uint8[img_size];
+	gray_left_ = take(n);
+	gray_right_ = take(n);
 	// 梯度数据
-	grad_left_ = new PGradient[img_size]();
-	grad_right_ = new PGradient[img_size]();
+	grad_left_ = reinterpret_cast<PGradient*>(take(n * sizeof(PGradient)));
+	grad_right_ = reinterpret_cast<PGradient*>(take(n * sizeof(PGradient)));
 	// 代价数据
-	cost_left_ = new float32[img_size];
-	cost_right_ = new float32[img_size];
+	cost_left_ = reinterpret_cast<PCostStore*>(take(n * sizeof(PCostStore)));
+	cost_right_ = reinterpret_cast<PCostStore*>(take(n * sizeof(PCostStore)));
 	// 视差图
-	disp_left_ = new float32[img_size];
-	disp_right_ = new float32[img_size];
+	disp_left_ = reinterpret_cast<float32*>(take(n * sizeof(float32)));
+	disp_right_ = reinterpret_cast<float32*>(take(n * sizeof(float32)));
 	// 平面集
-	plane_left_ = new DisparityPlane[img_size];
-	plane_right_ = new DisparityPlane[img_size];
-
-	is_initialized_ = grad_left_ && grad_right_ && disp_left_ && disp_right_  && plane_left_ && plane_right_;
-
-	return is_initialized_;
+	plane_left_ = reinterpret_cast<PPlaneStore*>(take(n * sizeof(PPlaneStore)));
+	plane_right_ = reinterpret_cast<PPlaneStore*>(take(n * sizeof(PPlaneStore)));
+	return offset;
 }
 
 void PatchMatchStereo::Release()
 {
-	SAFE_DELETE(grad_left_);
-	SAFE_DELETE(grad_right_);
-	SAFE_DELETE(cost_left_);
-	SAFE_DELETE(cost_right_);
-	SAFE_DELETE(disp_left_);
-	SAFE_DELETE(disp_right_);
-	SAFE_DELETE(plane_left_);
-	SAFE_DELETE(plane_right_);
+	pms_util::AlignedFree(arena_);
+	arena_ = nullptr;
+	arena_capacity_ = 0;
+	AssignBuffers(nullptr, 0);
+}
+
+bool PatchMatchStereo::IsMatchable(const PImageView& img) const
+{
+	return img.IsValid() && img.width == width_ && img.height == height_;
 }
 
 bool PatchMatchStereo::Match(const uint8* img_left, const uint8* img_right, float32* disp_left)
+{
+	return Match(PImageView(img_left, width_, height_), PImageView(img_right, width_, height_), disp_left);
+}
+
+bool PatchMatchStereo::Match(const PImageView& img_left, const PImageView& img_right, float32* disp_left)
 {
 	if (!is_initialized_) return false;	
-	if (img_left == nullptr || img_right == nullptr) return false;
+	if (!IsMatchable(img_left) || !IsMatchable(img_right)) return false;
+
+	img_left_ = img_left;
+	img_right_ = img_right;
+
+	is_stream_init_ = false;
+	is_pyramid_init_ = PyramidInitialization(); 	 // 由较粗金字塔层初始化
+	if (!is_pyramid_init_) RandomInitialization(); 	 // 随机初始化
+	MatchFromPlanes(disp_left);
+
+	return true;
+}
+
+bool PatchMatchStereo::Match(const uint8* img_left, const uint8* img_right, float32* disp_left,
+							 const vector<PRect>& rois)
+{
+	return Match(PImageView(img_left, width_, height_), PImageView(img_right, width_, height_), disp_left, rois);
+}
+
+bool PatchMatchStereo::Match(const PImageView& img_left, const PImageView& img_right, float32* disp_left,
+							 const vector<PRect>& rois)
+{
+	if (!is_initialized_) return false;
+	if (!IsMatchable(img_left) || !IsMatchable(img_right)) return false;
+
+	img_left_ = img_left;
+	img_right_ = img_right;
+
+	// 截断到图像内的ROI
+	vector<PRect> clipped;
+	for (const auto& roi : rois) {
+		const sint32 x0 = std::max(roi.x, 0), x1 = std::min(roi.x + roi.width, width_);
+		const sint32 y0 = std::max(roi.y, 0), y1 = std::min(roi.y + roi.height, height_);
+		if (x1 > x0 && y1 > y0) {
+			clipped.emplace_back(x0, y0, x1 - x0, y1 - y0);
+		}
+	}
+
+	// 外扩: 上下左右各外扩窗口半径; 左视图像素x的同名点位于右视图[x-max_disparity, x-min_disparity], 左右再外扩视差范围
+	const sint32 pat = option_.patch_size / 2;
+	const sint32 ext_left = pat + std::max(option_.max_disparity, 0);
+	const sint32 ext_right = pat + std::max(-option_.min_disparity, 0);
+	vector<PRect> regions;
+	for (const auto& roi : clipped) {
+		const sint32 x0 = std::max(roi.x - ext_left, 0), x1 = std::min(roi.x + roi.width + ext_right, width_);
+		const sint32 y0 = std::max(roi.y - pat, 0), y1 = std::min(roi.y + roi.height + pat, height_);
+		regions.emplace_back(x0, y0, x1 - x0, y1 - y0);
+	}
+
+	// 合并相交的区域, 重叠部分只处理一次
+	for (bool merged = true; merged;) {
+		merged = false;
+		for (size_t i = 0; i < regions.size() && !merged; i++) {
+			for (size_t j = i + 1; j < regions.size(); j++) {
+				auto& a = regions[i];
+				const auto& b = regions[j];
+				if (a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height && b.y < a.y + a.height) {
+					const sint32 x0 = std::min(a.x, b.x), x1 = std::max(a.x + a.width, b.x + b.width);
+					const sint32 y0 = std::min(a.y, b.y), y1 = std::max(a.y + a.height, b.y + b.height);
+					a = PRect(x0, y0, x1 - x0, y1 - y0);
+					regions.erase(regions.begin() + j);
+					merged = true;
+					break;
+				}
+			}
+		}
+	}
+
+	const sint32 img_size = width_ * height_;
+	std::fill(disp_left_, disp_left_ + img_size, Invalid_Float);
+	std::fill(disp_right_, disp_right_ + img_size, Invalid_Float);
+	tile_timings_.clear();
+	iteration_stats_.clear();
+
+	// 各区域裁剪后独立匹配
+	float32 num_pixels = 0.0f;
+	for (size_t i = 0; i < regions.size(); i++) {
+		const auto& rc = regions[i];
+
+		PMSOption option_roi = option_;
+		option_roi.seed = (option_.seed != 0) ? pms_util::MixSeed(option_.seed, pms_util::SeedPurpose::ROI, static_cast<uint32>(i), 0, 0) : 0;
+		PatchMatchStereo roi_pms;
+		if (!roi_pms.Initialize(rc.width, rc.height, option_roi) ||
+			!roi_pms.Match(img_left.Crop(rc), img_right.Crop(rc), nullptr)) {
+			return false;
+		}
+
+		// 分块耗时的坐标换算到整幅图像; 迭代统计累加各区域的像素数, 提前收敛的区域在之后的迭代中计为0
+		for (auto tile : roi_pms.GetTileTimings()) {
+			tile.x += rc.x;
+			tile.y += rc.y;
+			tile_timings_.push_back(tile);
+		}
+		const float32 roi_pixels = static_cast<float32>(rc.width * rc.height);
+		for (const auto& stat : roi_pms.GetIterationStats()) {
+			const size_t idx = static_cast<size_t>(stat.iter * NumViews() + stat.view);
+			if (iteration_stats_.size() <= idx) {
+				iteration_stats_.resize(idx + 1);
+			}
+			iteration_stats_[idx].active_ratio += stat.active_ratio * roi_pixels;
+			iteration_stats_[idx].changed_ratio += stat.changed_ratio * roi_pixels;
+		}
+		num_pixels += roi_pixels;
+
+		// 写回视差和平面, 区域内坐标(x,y)对应图像坐标(x+x0,y+y0), 平面截距相应变为c-a*x0-b*y0
+		for (int k = 0; k < NumViews(); k++) {
+			const auto* disp_roi = roi_pms.GetDisparityMap(k);
+			const auto* plane_roi = roi_pms.GetPlaneMap(k);
+			auto* disp_ptr = (k == 0) ? disp_left_ : disp_right_;
+			auto* plane_ptr = (k == 0) ? plane_left_ : plane_right_;
+			for (sint32 y = 0; y < rc.height; y++) {
+				for (sint32 x = 0; x < rc.width; x++) {
+					const sint32 p = (y + rc.y) * width_ + x + rc.x;
+					const auto param = PMSPlaneStore::Load(plane_roi[y * rc.width + x], x, y).param;
+					disp_ptr[p] = disp_roi[y * rc.width + x];
+					plane_ptr[p] = PMSPlaneStore::Store(
+						DisparityPlane(param.x, param.y, param.z - param.x * rc.x - param.y * rc.y), x + rc.x, y + rc.y);
+				}
+			}
+		}
+	}
+
+	// 迭代统计的比例相对于所有区域的像素总数
+	for (size_t idx = 0; idx < iteration_stats_.size(); idx++) {
+		auto& stat = iteration_stats_[idx];
+		stat.iter = static_cast<sint32>(idx) / NumViews();
+		stat.view = static_cast<sint32>(idx) % NumViews();
+		stat.active_ratio /= num_pixels;
+		stat.changed_ratio /= num_pixels;
+	}
+
+	// 左视图只保留ROI内的视差, 外扩部分的窗口被区域边界截断
+	vector<uint8> in_roi(img_size, 0);
+	for (const auto& roi : clipped) {
+		for (sint32 y = roi.y; y < roi.y + roi.height; y++) {
+			memset(&in_roi[y * width_ + roi.x], 1, roi.width);
+		}
+	}
+	for (sint32 p = 0; p < img_size; p++) {
+		if (!in_roi[p]) disp_left_[p] = Invalid_Float;
+	}
+
+	if (disp_left)
+		memcpy(disp_left, disp_left_, img_size * sizeof(float32)); // 输出视差图
+
+	return true;
+}
+
+void PatchMatchStereo::BeginSequence()
+{
+	num_frames_ = 0;
+}
+
+bool PatchMatchStereo::MatchNext(const uint8* img_left, const uint8* img_right, float32* disp_left)
+{
+	return MatchNext(PImageView(img_left, width_, height_), PImageView(img_right, width_, height_), disp_left);
+}
+
+bool PatchMatchStereo::MatchNext(const PImageView& img_left, const PImageView& img_right, float32* disp_left)
+{
+	// 序列的第一帧没有可沿用的平面, 完整匹配
+	if (num_frames_ == 0) {
+		if (!Match(img_left, img_right, disp_left)) return false;
+		num_frames_ = 1;
+		return true;
+	}
+
+	if (!is_initialized_) return false;
+	if (!IsMatchable(img_left) || !IsMatchable(img_right)) return false;
 
 	img_left_ = img_left;
 	img_right_ = img_right;
 
-	RandomInitialization(); 						 // 随机初始化
-	ComputeGray(); 									 // 计算灰度图
-	ComputeGradient(); 								 // 计算梯度图
+	// 沿用上一帧的平面, 部分像素重新随机初始化
+	is_pyramid_init_ = false;
+	is_stream_init_ = true;
+	RandomInitialization(option_.stream_random_ratio);
+	MatchFromPlanes(disp_left);
+	is_stream_init_ = false;
+	num_frames_++;
+
+	return true;
+}
+
+void PatchMatchStereo::MatchFromPlanes(float32* disp_left)
+{
+	Preprocess(); 									 // 计算灰度、梯度并打包
 	Propagation(); 									 // 迭代传播
 	PlaneToDisparity(); 							 // 平面转换成视差
 
-	if (option_.is_check_lr) LRCheck(); 			 // 左右一致性检查
-	if (option_.is_fill_holes) FillHolesInDispMap(); // 视差填充
+	// 只计算左视图时没有右视图视差, 不做一致性检查及依赖其结果的视差填充
+	if (!option_.is_left_view_only) {
+		if (option_.is_check_lr) LRCheck(); 			 // 左右一致性检查
+		if (option_.is_fill_holes) FillHolesInDispMap(); // 视差填充
+	}
 
 	if (disp_left && disp_left_)
 		memcpy(disp_left, disp_left_, height_ * width_ * sizeof(float32)); // 输出视差图
-
-	return true;
 }
 
 bool PatchMatchStereo::Reset(const uint32& width, const uint32& height, const PMSOption& option)
 {
-	
-	Release(); 				 // 释放内存
 	is_initialized_ = false; // 重置初始化标记
 
+	// 已有内存足够时复用, 否则重新分配
 	return Initialize(width, height, option);
 }
 
+uint64 PatchMatchStereo::GetMemoryFootprint() const
+{
+	return arena_capacity_ + packed_left_.Bytes() + packed_right_.Bytes() +
+		   census_left_.Bytes() + census_right_.Bytes() +
+		   (mismatches_left_.capacity() + mismatches_right_.capacity()) * sizeof(pair<int, int>);
+}
+
 float* PatchMatchStereo::GetDisparityMap(const sint32& view) const
 {
 	switch (view) {
 	case 0:
 		return disp_left_;
 	case 1:
-		return disp_right_;
+		return option_.is_left_view_only ? nullptr : disp_right_;
 	default:
 		return nullptr;
 	}
@@ -119,7 +341,29 @@ PGradient* PatchMatchStereo::GetGradientMap(const sint32& view) const
 	}
 }
 
-void PatchMatchStereo::RandomInitialization() const
+PPlaneStore* PatchMatchStereo::GetPlaneMap(const sint32& view) const
+{
+	switch (view) {
+	case 0:
+		return plane_left_;
+	case 1:
+		return option_.is_left_view_only ? nullptr : plane_right_;
+	default:
+		return nullptr;
+	}
+}
+
+const vector<PTileTiming>& PatchMatchStereo::GetTileTimings() const
+{
+	return tile_timings_;
+}
+
+const vector<PIterationStat>& PatchMatchStereo::GetIterationStats() const
+{
+	return iteration_stats_;
+}
+
+void PatchMatchStereo::RandomInitialization(const float32& ratio) const
 {
 	const sint32 width = width_;
 	const sint32 height = height_;
@@ -132,31 +376,37 @@ void PatchMatchStereo::RandomInitialization() const
 	const sint32 min_disparity = option.min_disparity;
 	const sint32 max_disparity = option.max_disparity;
 
-	// 视差/法线的随机数生成器
-	std::random_device rd;
-	std::mt19937 gen(rd());
-	std::uniform_real_distribution<float32> rand_d(
-		static_cast<float32>(min_disparity), static_cast<float32>(max_disparity));
-	std::uniform_real_distribution<float32> rand_n(-1.0f, 1.0f);
+	// 视差/法线的随机数种子, 设置了种子时可复现
+	const uint32 seed = option.seed != 0 ? option.seed : std::random_device()();
+	const auto disp_lo = static_cast<float32>(min_disparity);
+	const auto disp_hi = static_cast<float32>(max_disparity);
+	// 部分初始化(视频序列的后续帧)时各帧使用不同的随机数流
+	const bool partial = (ratio < 1.0f);
+	const uint32 frame = partial ? num_frames_ : 0;
 
-	for (int k = 0; k < 2; k++) {
+	for (int k = 0; k < NumViews(); k++) {
 		auto* disp_ptr = k == 0 ? disp_left_ : disp_right_;
 		auto* plane_ptr = k == 0 ? plane_left_ : plane_right_;
 		sint32 sign = (k == 0) ? 1 : -1;
 		for (sint32 y = 0; y < height; y++) {
+			// 每行一个独立的随机数流, 结果与遍历顺序无关
+			PMSRandom gen(pms_util::MixSeed(seed, pms_util::SeedPurpose::INIT, k, frame, y));
 			for (sint32 x = 0; x < width; x++) {
+				if (partial && gen.Uniform(0.0f, 1.0f) >= ratio) {
+					continue;
+				}
 				const sint32 p = y * width + x;
 
-				float32 disp = sign * rand_d(gen); // 随机视差值
+				float32 disp = sign * gen.Uniform(disp_lo, disp_hi); // 随机视差值
 				if (option.is_integer_disp) disp = static_cast<float32>(round(disp));
 				disp_ptr[p] = disp;
 
 				PVector3f norm; // 随机法向量
 				if (!option.is_fource_fpw) {
-					norm.x = rand_n(gen);
-					norm.y = rand_n(gen);
-					float32 z = rand_n(gen);
-					while (z == 0.0f) z = rand_n(gen);
+					norm.x = gen.Uniform(-1.0f, 1.0f);
+					norm.y = gen.Uniform(-1.0f, 1.0f);
+					float32 z = gen.Uniform(-1.0f, 1.0f);
+					while (z == 0.0f) z = gen.Uniform(-1.0f, 1.0f);
 					norm.z = z;
 					norm.normalize();
 				}
@@ -164,74 +414,133 @@ void PatchMatchStereo::RandomInitialization() const
 					norm.x = 0.0f; norm.y = 0.0f; norm.z = 1.0f;
 				}
 				
-				plane_ptr[p] = DisparityPlane(x, y, norm, disp); // 计算视差平面
+				plane_ptr[p] = PMSPlaneStore::Store(DisparityPlane(x, y, norm, disp), x, y); // 计算视差平面
 			}
 		}
 	}
 }
 
-void PatchMatchStereo::ComputeGray() const
+bool PatchMatchStereo::PyramidInitialization()
 {
-	const sint32 width = width_;
-	const sint32 height = height_;
-	if (width <= 0 || height <= 0 || \
-		img_left_ == nullptr || img_right_ == nullptr || \
-		gray_left_ == nullptr || gray_right_ == nullptr) {
-		return;
+	if (option_.num_levels <= 1 || plane_left_ == nullptr || plane_right_ == nullptr) {
+		return false;
+	}
+
+	// 较粗一层: 图像尺寸、视差范围及局部窗口减半, 只需要平面, 不做一致性检查和视差填充
+	const sint32 width_c = (width_ + 1) / 2;
+	const sint32 height_c = (height_ + 1) / 2;
+	PMSOption option_c = option_;
+	option_c.num_levels = option_.num_levels - 1;
+	option_c.min_disparity = static_cast<sint32>(floor(option_.min_disparity / 2.0));
+	option_c.max_disparity = static_cast<sint32>(ceil(option_.max_disparity / 2.0));
+	option_c.patch_size = (option_.patch_size / 2) | 1;
+	option_c.is_check_lr = false;
+	option_c.is_fill_holes = false;
+	option_c.seed = (option_.seed != 0) ? pms_util::MixSeed(option_.seed, pms_util::SeedPurpose::PYRAMID, 0, 0, 0) : 0;
+	if (width_c < option_c.patch_size || height_c < option_c.patch_size ||
+		option_c.max_disparity - option_c.min_disparity < 2) {
+		return false;
+	}
+
+	// 高斯降采样, 保持输入的像素格式
+	vector<uint8> img_left_c(width_c * height_c * img_left_.Channels());
+	vector<uint8> img_right_c(width_c * height_c * img_right_.Channels());
+	pms_util::PyramidDown(img_left_, img_left_c.data());
+	pms_util::PyramidDown(img_right_, img_right_c.data());
+
+	// 较粗一层匹配, 该层再按num_levels递归
+	PatchMatchStereo coarse;
+	if (!coarse.Initialize(width_c, height_c, option_c) ||
+		!coarse.Match(PImageView(img_left_c.data(), width_c, height_c, 0, img_left_.format),
+					  PImageView(img_right_c.data(), width_c, height_c, 0, img_right_.format), nullptr)) {
+		return false;
 	}
 
-	// 彩色转灰度
-	for (sint32 n = 0; n < 2; n++) {
-		auto* color = (n == 0) ? img_left_ : img_right_;
-		auto* gray = (n == 0) ? gray_left_ : gray_right_;
-		for (sint32 i = 0; i < height; i++) {
-			for (sint32 j = 0; j < width; j++) {
-				const auto b = color[i * width * 3 + 3 * j];
-				const auto g = color[i * width * 3 + 3 * j + 1];
-				const auto r = color[i * width * 3 + 3 * j + 2];
-				gray[i * width + j] = uint8(r * 0.299 + g * 0.587 + b * 0.114);
+	// 平面上采样: 粗层像素(xc,yc)对应本层像素(2xc,2yc), 本层视差是粗层的2倍,
+	// 即 d = 2*(a*x/2 + b*y/2 + c) = a*x + b*y + 2c, 斜率不变, 截距加倍
+	for (int k = 0; k < NumViews(); k++) {
+		const auto* plane_c = coarse.GetPlaneMap(k);
+		auto* plane_ptr = (k == 0) ? plane_left_ : plane_right_;
+		for (sint32 y = 0; y < height_; y++) {
+			for (sint32 x = 0; x < width_; x++) {
+				const sint32 xc = x / 2, yc = y / 2;
+				const auto param = PMSPlaneStore::Load(plane_c[yc * width_c + xc], xc, yc).param;
+				plane_ptr[y * width_ + x] = PMSPlaneStore::Store(DisparityPlane(param.x, param.y, 2.0f * param.z), x, y);
 			}
 		}
 	}
+	return true;
 }
 
-void PatchMatchStereo::ComputeGradient() const
+void PatchMatchStereo::Preprocess()
 {
-	const sint32 width = width_;
-	const sint32 height = height_;
-	if (width <= 0 || height <= 0 || \
-		grad_left_ == nullptr || grad_right_ == nullptr || \
-		gray_left_ == nullptr || gray_right_ == nullptr) {
+	if (width_ <= 0 || height_ <= 0 || \
+		!img_left_.IsValid() || !img_right_.IsValid() || \
+		gray_left_ == nullptr || gray_right_ == nullptr || \
+		grad_left_ == nullptr || grad_right_ == nullptr) {
 		return;
 	}
 
-	// Sobel梯度算子
-	for (sint32 n = 0; n < 2; n++) {
-		auto* gray = (n == 0) ? gray_left_ : gray_right_;
-		auto* grad = (n == 0) ? grad_left_ : grad_right_;
-		for (int y = 1; y < height - 1; y++) {
-			for (int x = 1; x < width - 1; x++) {
-				const auto grad_x = (-gray[(y - 1) * width + x - 1] + gray[(y - 1) * width + x + 1]) + \
-									(-2 * gray[y * width + x - 1] + 2 * gray[y * width + x + 1]) + \
-									(-gray[(y + 1) * width + x - 1] + gray[(y + 1) * width + x + 1]);
-				const auto grad_y = (-gray[(y - 1) * width + x - 1] - gray[(y - 1) * width + x + 1]) + \
-									(-2 * gray[(y - 1) * width + x] + 2 * gray[(y + 1) * width + x]) + \
-									(gray[(y + 1) * width + x - 1] + gray[(y + 1) * width + x + 1]);
-
-				// 这里除以8是为了让梯度的最大值不超过255, 这样计算代价时梯度差和颜色差位于同一个尺度
-				grad[y * width + x].x = grad_x / 8;
-				grad[y * width + x].y = grad_y / 8;
-			}
-		}
+	// 打包图像的外扩宽度覆盖聚合窗口半径及视差范围, 左右视图共用
+	const sint32 halo_x = PMSPackedImage::RequiredHaloX(option_.patch_size, option_.min_disparity, option_.max_disparity);
+	const sint32 halo_y = PMSPackedImage::RequiredHaloY(option_.patch_size);
+
+	// 图像按行块分给线程池, 单线程时不创建线程
+	PMSThreadPool thread_pool(option_.num_threads);
+	PMSThreadPool* pool = (thread_pool.NumThreads() > 1) ? &thread_pool : nullptr;
+	pms_preprocess::Preprocess(img_left_, gray_left_, grad_left_, &packed_left_, halo_x, halo_y,
+							   option_.simd_level, pool);
+	pms_preprocess::Preprocess(img_right_, gray_right_, grad_right_, &packed_right_, halo_x, halo_y,
+							   option_.simd_level, pool);
+
+	// census代价的census图像由灰度构建, 外扩与打包图像相同
+	if (option_.cost_type == CostType::CENSUS) {
+		census_left_.Build(gray_left_, width_, height_, option_.census_width, option_.census_height,
+						   halo_x, halo_y, pool);
+		census_right_.Build(gray_right_, width_, height_, option_.census_width, option_.census_height,
+							halo_x, halo_y, pool);
+	}
+}
+
+void PatchMatchStereo::Propagation()
+{
+	// 按代价类型选择传播类的实例, 已知的代价类型直接调用代价计算, 其余类型经虚函数调用
+	switch (option_.cost_type) {
+	case CostType::PMS:
+		PropagationWithCost<CostComputerPMS>();
+		break;
+	case CostType::PMS_FIXED:
+		PropagationWithCost<CostComputerPMSFixed>();
+		break;
+	case CostType::CENSUS:
+		PropagationWithCost<CostComputerCensus>();
+		break;
+	default:
+		PropagationWithCost<CostComputer>();
+		break;
+	}
+}
+
+template <class CostT>
+void PatchMatchStereo::PropagationWithCost()
+{
+	if (option_.is_fource_fpw) {
+		if (option_.is_integer_disp) PropagationImpl<CostT, true, true>();
+		else PropagationImpl<CostT, true, false>();
+	}
+	else {
+		if (option_.is_integer_disp) PropagationImpl<CostT, false, true>();
+		else PropagationImpl<CostT, false, false>();
 	}
 }
 
-void PatchMatchStereo::Propagation() const
+template <class CostT, bool kFrontoPW, bool kIntDisp>
+void PatchMatchStereo::PropagationImpl()
 {
 	const sint32 width = width_;
 	const sint32 height = height_;
 	if (width <= 0 || height <= 0 || \
-		img_left_ == nullptr || img_right_ == nullptr || \
+		!img_left_.IsValid() || !img_right_.IsValid() || \
 		grad_left_ == nullptr || grad_right_ == nullptr || \
 		disp_left_ == nullptr || disp_right_ == nullptr || \
 		plane_left_ == nullptr || plane_right_ == nullptr) {
@@ -239,23 +548,117 @@ void PatchMatchStereo::Propagation() const
 	}
 
 	// 左右视图匹配参数
-	const auto opion_left = option_;
+	auto opion_left = option_;
+	// 视频序列的各帧使用不同的随机数流
+	if (is_stream_init_ && opion_left.seed != 0) {
+		opion_left.seed = pms_util::MixSeed(opion_left.seed, pms_util::SeedPurpose::STREAM, num_frames_, 0, 0);
+	}
 	auto option_right = option_;
 	option_right.min_disparity = -opion_left.max_disparity;
 	option_right.max_disparity = -opion_left.min_disparity;
+	// 右视图使用另一条随机数流
+	option_right.seed = (opion_left.seed != 0) ? pms_util::MixSeed(opion_left.seed, pms_util::SeedPurpose::VIEW, 0, 0, 0) : 0;
+
+	// 并行模式的线程池, 左右视图共用; 顺序模式单线程
+	const bool parallel = (option_.propagation_mode != PropagationMode::SEQUENTIAL);
+	PMSThreadPool thread_pool(parallel ? option_.num_threads : 1);
+	PMSThreadPool* pool = parallel ? &thread_pool : nullptr;
+
+	// 左右视图传播实例, 只计算左视图时没有右视图实例(构造时即计算全图代价)
+	using Propagator = PMSPropagation<CostT, kFrontoPW, kIntDisp>;
+	const bool left_only = option_.is_left_view_only;
+	const sint32 num_views = NumViews();
+	Propagator propa_left(width, height, img_left_, img_right_,
+						  grad_left_, grad_right_, plane_left_, plane_right_,
+						  opion_left,cost_left_,cost_right_, disp_left_,
+						  &packed_left_, &packed_right_, &census_left_, &census_right_, pool);
+	std::unique_ptr<Propagator> propa_right;
+	if (!left_only) {
+		propa_right.reset(new Propagator(width, height, img_right_, img_left_,
+										 grad_right_, grad_left_, plane_right_, plane_left_,
+										 option_right, cost_right_, cost_left_, disp_right_,
+										 &packed_right_, &packed_left_, &census_right_, &census_left_, pool));
+		// 视图传播复用另一视图的权值缓存
+		propa_left.ShareWeightCache(*propa_right);
+		propa_right->ShareWeightCache(propa_left);
+	}
 
-	// 左右视图传播实例
-	PMSPropagation propa_left(width, height, img_left_, img_right_,
-							  grad_left_, grad_right_, plane_left_, plane_right_,
-							  opion_left,cost_left_,cost_right_, disp_left_);
-	PMSPropagation propa_right(width, height, img_right_, img_left_,
-							   grad_right_, grad_left_, plane_right_, plane_left_,
-							   option_right, cost_right_, cost_left_, disp_right_);
+	// 左右视图并发传播或分块传播时, 跨视图的候选经信箱传递给目标视图
+	const bool concurrent = option_.is_concurrent_views && !parallel && !left_only;
+	const bool tiled = (option_.propagation_mode == PropagationMode::TILED);
+	const bool use_mailbox = (concurrent || tiled) && !left_only;
+	PMSViewMailbox mailbox_left(use_mailbox ? height : 0);
+	PMSViewMailbox mailbox_right(use_mailbox ? height : 0);
+	if (use_mailbox) {
+		propa_left.SetViewMailboxes(&mailbox_left, &mailbox_right);
+		propa_right->SetViewMailboxes(&mailbox_right, &mailbox_left);
+	}
+
+	// 活跃集: 各像素平面最近变化的迭代序号, 随机初始化记为-1
+	const bool active_set = option_.is_active_set;
+	vector<sint32> stamp_left(active_set ? width * height : 0, -1);
+	vector<sint32> stamp_right(active_set && !left_only ? width * height : 0, -1);
+	if (active_set) {
+		propa_left.SetActiveSet(stamp_left.data(), left_only ? nullptr : stamp_right.data());
+		if (propa_right) propa_right->SetActiveSet(stamp_right.data(), stamp_left.data());
+	}
+	iteration_stats_.clear();
+
+	// 由较粗金字塔层或视频上一帧初始化的平面已接近最优, 减少迭代次数并只在小范围内优化
+	const sint32 num_iters = is_stream_init_ ? option_.num_stream_iters :
+							 is_pyramid_init_ ? option_.num_fine_iters : option_.num_iters;
+	if (is_pyramid_init_ || is_stream_init_) {
+		propa_left.SetRefineRadius(option_.fine_refine_radius);
+		if (propa_right) propa_right->SetRefineRadius(option_.fine_refine_radius);
+	}
 
 	// 迭代传播
-	for (int k = 0; k < option_.num_iters; k++) {
-		propa_left.DoPropagation();
-		propa_right.DoPropagation();
+	for (int k = 0; k < num_iters; k++) {
+		if (concurrent) {
+			std::thread thread_right([&propa_right] { propa_right->DoPropagation(); });
+			propa_left.DoPropagation();
+			thread_right.join();
+		}
+		else {
+			propa_left.DoPropagation();
+			if (propa_right) propa_right->DoPropagation();
+		}
+
+		if (!active_set) {
+			continue;
+		}
+		// 统计本次迭代的活跃像素及平面变化比例, 变化足够少时视为收敛
+		const float32 num_pixels = static_cast<float32>(width * height);
+		sint32 num_changed = 0;
+		for (sint32 view = 0; view < num_views; view++) {
+			const auto& stamp = (view == 0) ? stamp_left : stamp_right;
+			const sint32 changed = static_cast<sint32>(std::count(stamp.begin(), stamp.end(), k));
+			PIterationStat stat;
+			stat.iter = k;
+			stat.view = view;
+			stat.active_ratio = ((view == 0) ? propa_left.NumActive() : propa_right->NumActive()) / num_pixels;
+			stat.changed_ratio = changed / num_pixels;
+			iteration_stats_.push_back(stat);
+			num_changed += changed;
+		}
+		if (num_changed <= option_.converge_ratio * num_views * num_pixels) {
+			break;
+		}
+	}
+
+	// 处理最后一次迭代中投递的候选
+	if (use_mailbox) {
+		propa_left.DrainViewMailbox();
+		propa_right->DrainViewMailbox();
+	}
+
+	// 分块耗时统计
+	tile_timings_.clear();
+	for (sint32 view = 0; view < num_views; view++) {
+		for (auto tile : (view == 0) ? propa_left.GetTileTimings() : propa_right->GetTileTimings()) {
+			tile.view = view;
+			tile_timings_.push_back(tile);
+		}
 	}
 }
 
@@ -322,7 +725,7 @@ void PatchMatchStereo::FillHolesInDispMap()
 		auto& mismatches = (k == 0) ? mismatches_left_ : mismatches_right_;
 		if(mismatches.empty()) continue;
 
-		const auto* img_ptr = (k == 0) ? img_left_ : img_right_;
+		const auto& img = (k == 0) ? img_left_ : img_right_;
 		const auto* plane_ptr = (k == 0) ? plane_left_ : plane_right_;
 		auto* disp_ptr = (k == 0) ? disp_left_ : disp_right_;
 		vector<float32> fill_disps(mismatches.size()); // 存储每个待填充像素的视差
@@ -336,7 +739,7 @@ void PatchMatchStereo::FillHolesInDispMap()
 			sint32 xs = x + 1;
 			while (xs < width) {
 				if (disp_ptr[y * width + xs] != Invalid_Float) {
-					planes.push_back(plane_ptr[y * width + xs]);
+					planes.push_back(PMSPlaneStore::Load(plane_ptr[y * width + xs], xs, y));
 					break;
 				}
 				xs++;
@@ -344,7 +747,7 @@ void PatchMatchStereo::FillHolesInDispMap()
 			xs = x - 1;
 			while (xs >= 0) {
 				if (disp_ptr[y * width + xs] != Invalid_Float) {
-					planes.push_back(plane_ptr[y * width + xs]);
+					planes.push_back(PMSPlaneStore::Load(plane_ptr[y * width + xs], xs, y));
 					break;
 				}
 				xs--;
@@ -369,8 +772,7 @@ void PatchMatchStereo::FillHolesInDispMap()
 		}
 
 		// 加权中值滤波
-		pms_util::WeightedMedianFilter(img_ptr,
-			width, height, option.patch_size, option.gamma, mismatches, disp_ptr);
+		pms_util::WeightedMedianFilter(img, option.patch_size, option.gamma, mismatches, disp_ptr);
 	}
 }
 
@@ -384,13 +786,13 @@ void PatchMatchStereo::PlaneToDisparity() const
 		return;
 	}
 
-	for (int k = 0; k < 2; k++) {
+	for (int k = 0; k < NumViews(); k++) {
 		auto* plane_ptr = (k == 0) ? plane_left_ : plane_right_;
 		auto* disp_ptr = (k == 0) ? disp_left_ : disp_right_;
 		for (sint32 y = 0; y < height; y++) {
 			for (sint32 x = 0; x < width; x++) {
 				const sint32 p = y * width + x;
-				const auto& plane = plane_ptr[p];
+				const auto plane = PMSPlaneStore::Load(plane_ptr[p], x, y);
 				disp_ptr[p] = plane.to_disparity(x, y);
 			}
 		}
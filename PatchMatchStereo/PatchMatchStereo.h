@@ -6,6 +6,9 @@
 
 #pragma once
 #include "pms_types.h"
+#include "pms_packed_image.h"
+#include "pms_census_image.h"
+#include "pms_plane_store.h"
 
 
 // PatchMatch类
@@ -27,12 +30,71 @@ public:
 
 	/**
 	 * @brief 匹配
+	 * @param img_left	输入, 左图像数据指针, 3通道(b,g,r)紧密排列
+	 * @param img_right	输入, 右图像数据指针, 3通道(b,g,r)紧密排列
+	 * @param disp_left	输出, 左图像视差图指针, 预先分配和图像等尺寸的内存空间
+	 * @return bool
+	 */
+	bool Match(const uint8* img_left, const uint8* img_right, float32* disp_left);
+
+	/**
+	 * @brief 匹配, 图像由视图给出, 匹配过程中直接读取视图引用的数据, 不拷贝
+	 * 灰度图(PixelFormat::GRAY)视为三个通道相同的彩色, 不做颜色转换
+	 * @param img_left	输入, 左图像视图, 尺寸须与初始化的尺寸一致
+	 * @param img_right	输入, 右图像视图, 尺寸须与初始化的尺寸一致
+	 * @param disp_left	输出, 左图像视差图指针, 预先分配和图像等尺寸的内存空间
+	 * @return bool
+	 */
+	bool Match(const PImageView& img_left, const PImageView& img_right, float32* disp_left);
+
+	/**
+	 * @brief 只匹配感兴趣区域(ROI)
+	 * 各ROI上下左右外扩窗口半径, 左右再外扩视差范围(使右视图中的同名点及其窗口也在处理区域内), 相交的区域合并后
+	 * 各自裁剪匹配, 耗时与区域面积而不是图像尺寸成正比. 视差图、平面集写回整幅图像, 未处理的像素视差无效;
+	 * 平面集只有ROI内的有效, 其余像素保留外扩区域的结果或之前匹配的平面(紧凑编码无法表示无效平面).
+	 * 分块耗时为各区域的分块(坐标换算到整幅图像), 迭代统计为各区域合并后的比例
+	 * @param img_left	输入, 左图像数据指针, 3通道
+	 * @param img_right	输入, 右图像数据指针, 3通道
+	 * @param disp_left	输出, 左图像视差图指针, 预先分配和图像等尺寸的内存空间, ROI以外的视差无效
+	 * @param rois		输入, 感兴趣区域, 超出图像的部分被截断
+	 * @return bool
+	 */
+	bool Match(const uint8* img_left, const uint8* img_right, float32* disp_left, const vector<PRect>& rois);
+
+	/**
+	 * @brief 只匹配感兴趣区域(ROI), 图像由视图给出, 各区域直接引用视图的子区域, 不拷贝
+	 * @param img_left	输入, 左图像视图
+	 * @param img_right	输入, 右图像视图
+	 * @param disp_left	输出, 左图像视差图指针, 预先分配和图像等尺寸的内存空间, ROI以外的视差无效
+	 * @param rois		输入, 感兴趣区域, 超出图像的部分被截断
+	 * @return bool
+	 */
+	bool Match(const PImageView& img_left, const PImageView& img_right, float32* disp_left, const vector<PRect>& rois);
+
+	/**
+	 * @brief 开始一个视频序列, 之后的第一次MatchNext与Match相同, 其余各帧由上一帧的平面初始化
+	 */
+	void BeginSequence();
+
+	/**
+	 * @brief 匹配视频序列的下一帧
+	 * 平面由上一帧的结果初始化, 其中stream_random_ratio比例的像素重新随机初始化, 迭代num_stream_iters次,
+	 * 平面优化的初始视差扰动半径为fine_refine_radius
 	 * @param img_left	输入, 左图像数据指针, 3通道
 	 * @param img_right	输入, 右图像数据指针, 3通道
 	 * @param disp_left	输出, 左图像视差图指针, 预先分配和图像等尺寸的内存空间
 	 * @return bool
 	 */
-	bool Match(const uint8* img_left, const uint8* img_right, float32* disp_left);
+	bool MatchNext(const uint8* img_left, const uint8* img_right, float32* disp_left);
+
+	/**
+	 * @brief 匹配视频序列的下一帧, 图像由视图给出
+	 * @param img_left	输入, 左图像视图
+	 * @param img_right	输入, 右图像视图
+	 * @param disp_left	输出, 左图像视差图指针, 预先分配和图像等尺寸的内存空间
+	 * @return bool
+	 */
+	bool MatchNext(const PImageView& img_left, const PImageView& img_right, float32* disp_left);
 
 	/**
 	 * @brief 重设
@@ -43,10 +105,16 @@ public:
 	 */
 	bool Reset(const uint32& width, const uint32& height, const PMSOption& option);
 
+	/**
+	 * @brief 获取匹配实例持有的内存字节数(缓存区、打包影像及误匹配像素集), 不含匹配过程中的临时数据
+	 * @return uint64	字节数
+	 */
+	uint64 GetMemoryFootprint() const;
+
 	/**
 	 * @brief 获取视差图指针
 	 * @param view 		0-左视图 1-右视图
-	 * @return float*	视差图指针
+	 * @return float*	视差图指针, 只计算左视图时右视图为nullptr
 	 */
 	float* GetDisparityMap(const sint32& view) const;
 
@@ -57,14 +125,78 @@ public:
 	 * @return PGradient*	梯度图指针
 	 */
 	PGradient* GetGradientMap(const sint32& view) const;
+
+	/**
+	 * @brief 获取视差平面集指针, 像素(x,y)的平面由PMSPlaneStore::Load(map[y*width+x], x, y)解码
+	 * @param view 				0-左视图 1-右视图
+	 * @return PPlaneStore*		平面集指针, 未定义PMS_COMPACT_PLANE时即DisparityPlane*; 只计算左视图时右视图为nullptr
+	 */
+	PPlaneStore* GetPlaneMap(const sint32& view) const;
+
+	/**
+	 * @brief 获取最近一次匹配中分块传播(PropagationMode::TILED)各块的耗时
+	 * @return const vector<PTileTiming>&	左右视图的分块及累计耗时, 未使用分块传播时为空; ROI匹配时为各区域的分块
+	 */
+	const vector<PTileTiming>& GetTileTimings() const;
+
+	/**
+	 * @brief 获取最近一次匹配中活跃集模式(is_active_set)每次迭代的活跃像素及平面变化比例
+	 * ROI匹配时按像素数合并各区域的统计, 比例相对于所有区域的像素总数
+	 * @return const vector<PIterationStat>&	按迭代顺序, 每次迭代左右视图各一条; 提前收敛时少于num_iters次, 未启用活跃集时为空
+	 */
+	const vector<PIterationStat>& GetIterationStats() const;
 private:
-	void RandomInitialization() const; 	// 随机初始化
+	/**
+	 * @brief 图像视图是否可用于匹配: 数据有效且尺寸与初始化的尺寸一致
+	 * @param img	图像视图
+	 * @return bool
+	 */
+	bool IsMatchable(const PImageView& img) const;
+
+	// 计算的视图数, 只计算左视图时为1
+	sint32 NumViews() const { return option_.is_left_view_only ? 1 : 2; }
+
+	/**
+	 * @brief 随机初始化
+	 * @param ratio		重新初始化的像素比例, 按种子随机抽取, 不小于1时初始化全部像素
+	 */
+	void RandomInitialization(const float32& ratio = 1.0f) const;
+
+	/**
+	 * @brief 平面初始化后的匹配流程: 预处理, 迭代传播, 平面转视差及后处理
+	 * @param disp_left	输出, 左图像视差图指针, 可为空
+	 */
+	void MatchFromPlanes(float32* disp_left);
+
+	/**
+	 * @brief 金字塔初始化: 降采样左右图像, 在较粗一层上匹配(递归至最粗层), 再将平面上采样到本层
+	 * @return bool		是否完成初始化, 未启用金字塔或图像过小时返回false
+	 */
+	bool PyramidInitialization();
 	
-	void ComputeGray() const; 			// 计算灰度数据
+	/**
+	 * @brief 预处理: 左右视图各一次遍历计算灰度、梯度并打包颜色与梯度, 按行块多线程执行(见pms_preprocess.h);
+	 * census代价时再由灰度构建左右视图的census图像, 供各代价计算实例共用
+	 */
+	void Preprocess();
 
-	void ComputeGradient() const; 		// 计算梯度数据
+	void Propagation(); 				// 迭代传播
 
-	void Propagation() const; 			// 迭代传播
+	/**
+	 * @brief 按策略参数选择传播类的实例, 见Propagation
+	 * @tparam CostT	代价计算类
+	 */
+	template <class CostT>
+	void PropagationWithCost();
+
+	/**
+	 * @brief 以指定的传播类实例执行迭代传播
+	 * @tparam CostT		代价计算类
+	 * @tparam kFrontoPW	是否强制为前端平行窗口
+	 * @tparam kIntDisp		是否为整数视差
+	 */
+	template <class CostT, bool kFrontoPW, bool kIntDisp>
+	void PropagationImpl();
 
 	void LRCheck(); 					// 一致性检查
 
@@ -74,14 +206,23 @@ private:
 
 	void Release(); 					// 内存释放
 
+	/**
+	 * @brief 在arena中依次划分灰度、梯度、代价、视差及平面缓存, 起始地址按64字节对齐
+	 * @param base		arena起始地址, 为空时只计算大小(各缓存指针置空)
+	 * @param img_size	像素数
+	 * @return uint64	arena所需的字节数
+	 */
+	uint64 AssignBuffers(uint8* base, const sint32& img_size);
+
 private:
 	PMSOption option_; // PMS参数
 
 	sint32 width_;
 	sint32 height_;
 
-	const uint8* img_left_;
-	const uint8* img_right_;
+	// 左右图像, 引用调用方的数据, 只在匹配过程中有效
+	PImageView img_left_;
+	PImageView img_right_;
 
 	uint8* gray_left_;
 	uint8* gray_right_;
@@ -89,18 +230,40 @@ private:
 	PGradient* grad_left_;
 	PGradient* grad_right_;
 
-	float32* cost_left_; // 左图像聚合代价数据
-	float32* cost_right_; // 右图像聚合代价数据
+	// 打包的颜色+梯度数据(含外扩边界), 供聚合代价计算使用
+	PMSPackedImage packed_left_;
+	PMSPackedImage packed_right_;
+
+	// census图像(含外扩边界), 仅census代价时由灰度构建, 各代价计算实例共用
+	PMSCensusImage census_left_;
+	PMSCensusImage census_right_;
+
+	PCostStore* cost_left_; // 左图像聚合代价数据
+	PCostStore* cost_right_; // 右图像聚合代价数据
 
 	float32* disp_left_;
 	float32* disp_right_;
 
-	DisparityPlane* plane_left_; // 左图像平面集
-	DisparityPlane* plane_right_; // 右图像平面集
+	PPlaneStore* plane_left_; // 左图像平面集
+	PPlaneStore* plane_right_; // 右图像平面集
+
+	// 以上各缓存所在的内存块, 容量足够时Reset复用
+	uint8* arena_;
+	uint64 arena_capacity_;
+	bool is_huge_arena_; // arena是否按大页分配
 
 	bool is_initialized_; // 是否初始化标志
+	bool is_pyramid_init_; // 平面是否由较粗金字塔层初始化
+	bool is_stream_init_; // 平面是否由视频序列的上一帧初始化
+	sint32 num_frames_; // 视频序列已匹配的帧数, 大于0时MatchNext由上一帧的平面初始化
 
 	// 误匹配区像素集
 	vector<pair<int, int>> mismatches_left_;
 	vector<pair<int, int>> mismatches_right_;
+
+	// 分块传播各块的耗时
+	vector<PTileTiming> tile_timings_;
+
+	// 活跃集模式每次迭代的统计
+	vector<PIterationStat> iteration_stats_;
 };
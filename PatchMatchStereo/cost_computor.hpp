@@ -7,6 +7,10 @@
 #ifndef PATCH_MATCH_STEREO_COST_HPP_
 #define PATCH_MATCH_STEREO_COST_HPP_
 #include "pms_types.h"
+#include "pms_weight_cache.h"
+#include "pms_sample_pattern.h"
+#include "pms_packed_image.h"
+#include "pms_census_image.h"
 #include <algorithm>
 
 
@@ -34,22 +38,27 @@ inline double fast_exp(double x) {
  */
 class CostComputer {
 public:
+	// 批量聚合一次遍历的候选平面数上限, 超出时分批遍历
+	static constexpr sint32 MAX_BATCH = 8;
+
 	// 代价计算类的默认构造方法
-	CostComputer() : img_left_(nullptr), img_right_(nullptr),
+	CostComputer() : img_left_(), img_right_(),
 					 width_(0), height_(0), patch_size_(0),
-					 min_disp_(0), max_disp_(0) {}
+					 min_disp_(0), max_disp_(0), weight_cache_(nullptr),
+					 is_weighted_row_order_(false), sample_pattern_(nullptr),
+					 packed_left_(nullptr), packed_right_(nullptr) {}
 
 	/**
 	 * @brief 代价计算类的带参数构造方法
-	 * @param img_left		左图像数据 
-	 * @param img_right		右图像数据
+	 * @param img_left		左图像 
+	 * @param img_right		右图像
 	 * @param width			图像宽
 	 * @param height		图像高
 	 * @param patch_size	局部块大小
 	 * @param min_disp		最小视差值
 	 * @param max_disp		最大视差值
 	 */
-	CostComputer(const uint8* img_left, const uint8* img_right,
+	CostComputer(const PImageView& img_left, const PImageView& img_right,
 				 const sint32& width, const sint32& height, const sint32& patch_size,
 				 const sint32& min_disp, const sint32& max_disp)
 	{
@@ -57,11 +66,21 @@ public:
 		img_right_ = img_right;
 		width_ = width;
 		height_ = height;
-		patch_size_ = patch_size;
+		// 聚合区间为[-patch_size/2, patch_size/2], 实际块大小总为奇数
+		patch_size_ = patch_size / 2 * 2 + 1;
 		min_disp_ = min_disp;
 		max_disp_ = max_disp;
+		weight_cache_ = nullptr;
+		is_weighted_row_order_ = false;
+		sample_pattern_ = nullptr;
+		packed_left_ = nullptr;
+		packed_right_ = nullptr;
 	}
 
+	// 打包图像由指针引用, 禁止拷贝
+	CostComputer(const CostComputer&) = delete;
+	CostComputer& operator=(const CostComputer&) = delete;
+
 	// 虚析构函数, 可重写
 	virtual ~CostComputer() = default;
 
@@ -75,15 +94,158 @@ public:
 	 */
 	virtual float32 Compute(const sint32& i, const sint32& j, const float32& d) = 0;
 
+	/**
+	 * @brief 计算左图像p点在视差平面d为ax+by+c时的聚合代价值, 可重写
+	 * @param x			p点x坐标
+	 * @param y 		p点y坐标
+	 * @param param		平面参数(a, b, c)
+	 * @return float32	聚合代价值
+	 */
+	virtual float32 ComputeA(const sint32& x, const sint32& y, const DisparityPlane& param) const = 0;
+
+	/**
+	 * @brief 带上界的聚合代价, 可重写
+	 * 逐行累加, 部分和不小于上界时提前返回部分和. 每一项代价均非负, 因此返回值小于上界当且仅当完整代价小于上界,
+	 * 与上界(当前最优代价)的比较结果不变. 基类的默认实现忽略上界, 不提前终止, 总是返回完整代价
+	 * @param x				p点x坐标
+	 * @param y 			p点y坐标
+	 * @param param			平面参数(a, b, c)
+	 * @param upper_bound	代价上界
+	 * @return float32		聚合代价值, 或不小于上界的部分和
+	 */
+	virtual float32 ComputeA(const sint32& x, const sint32& y, const DisparityPlane& param,
+							 const float32& /*upper_bound*/) const
+	{
+		return ComputeA(x, y, param);
+	}
+
+	/**
+	 * @brief 批量计算p点在多个候选平面下的聚合代价, 可重写
+	 * 候选共用p点的局部块、邻域像素和支持权值, 一次遍历局部块同时累加各候选的代价, 每个候选的结果与单独调用ComputeA相同.
+	 * 所有候选共用同一上界, 部分和不小于上界的候选不再累加, 全部候选都越过上界时提前返回. 默认实现逐个调用ComputeA
+	 * @param x				p点x坐标
+	 * @param y 			p点y坐标
+	 * @param params		候选平面数组
+	 * @param num			候选平面个数
+	 * @param costs			输出, 各候选的聚合代价值, 或不小于上界的部分和
+	 * @param upper_bound	代价上界
+	 */
+	virtual void ComputeABatch(const sint32& x, const sint32& y, const DisparityPlane* params, const sint32& num,
+							   float32* costs, const float32& upper_bound = Invalid_Float) const
+	{
+		for (sint32 h = 0; h < num; h++) {
+			costs[h] = ComputeA(x, y, params[h], upper_bound);
+		}
+	}
+
+	/**
+	 * @brief 设置支持权值缓存, 缓存须由本代价计算类的左图像(即聚合中心所在视图)构建
+	 * @param weight_cache	权值缓存, 为nullptr时每次聚合实时计算权值
+	 */
+	void SetWeightCache(PMSWeightCache* weight_cache)
+	{
+		weight_cache_ = (weight_cache && weight_cache->IsValid()) ? weight_cache : nullptr;
+	}
+
+	/**
+	 * @brief 设置聚合时是否优先访问权值大的行, 使带上界的聚合尽早越过上界
+	 * 权值缓存记录了行序时按每个像素的行权值和排序, 否则由中心行向外交替访问
+	 * @param enable	是否启用
+	 */
+	void SetWeightedRowOrder(const bool& enable)
+	{
+		is_weighted_row_order_ = enable;
+		row_order_.clear();
+		if (enable) {
+			const sint32 pat = patch_size_ / 2;
+			row_order_.push_back(static_cast<uint16>(pat));
+			for (sint32 k = 1; k <= pat; k++) {
+				row_order_.push_back(static_cast<uint16>(pat - k));
+				row_order_.push_back(static_cast<uint16>(pat + k));
+			}
+		}
+	}
+
+	/**
+	 * @brief 设置聚合窗口的采样模式, 模式的块大小须与本类一致
+	 * @param pattern	采样模式, 为nullptr或全采样时逐像素聚合
+	 */
+	void SetSamplePattern(const PMSSamplePattern* pattern)
+	{
+		sample_pattern_ = (pattern && !pattern->IsFull()) ? pattern : nullptr;
+	}
+
+	/**
+	 * @brief 设置左右视图的打包图像(颜色+梯度, 含外扩边界)
+	 * 提供的打包图像外扩宽度不足或未提供时, 由图像和梯度数据自行构建
+	 * @param grad_left		左梯度数据
+	 * @param grad_right	右梯度数据
+	 * @param packed_left	左视图打包图像, 可为空
+	 * @param packed_right	右视图打包图像, 可为空
+	 */
+	void InitPackedImages(const PGradient* grad_left, const PGradient* grad_right,
+						  const PMSPackedImage* packed_left, const PMSPackedImage* packed_right)
+	{
+		const sint32 halo_x = PMSPackedImage::RequiredHaloX(patch_size_, min_disp_, max_disp_);
+		const sint32 halo_y = PMSPackedImage::RequiredHaloY(patch_size_);
+		if (packed_left && packed_left->Covers(halo_x, halo_y)) {
+			packed_left_ = packed_left;
+		}
+		else {
+			own_packed_left_.Build(img_left_, grad_left, halo_x, halo_y);
+			packed_left_ = &own_packed_left_;
+		}
+		if (packed_right && packed_right->Covers(halo_x, halo_y)) {
+			packed_right_ = packed_right;
+		}
+		else {
+			own_packed_right_.Build(img_right_, grad_right, halo_x, halo_y);
+			packed_right_ = &own_packed_right_;
+		}
+	}
+
+	/**
+	 * @brief 获取像素(x,y)聚合时的行访问顺序
+	 * @param x					像素x坐标
+	 * @param y					像素y坐标
+	 * @return const uint16*	patch_size个块内行号, 为nullptr时自上而下访问
+	 */
+	inline const uint16* GetRowOrder(const sint32& x, const sint32& y) const
+	{
+		if (!is_weighted_row_order_) {
+			return nullptr;
+		}
+		const uint16* order = weight_cache_ ? weight_cache_->GetRowOrder(x, y) : nullptr;
+		return order ? order : row_order_.data();
+	}
+
 public:
-	const uint8* img_left_;
-	const uint8* img_right_;
+	PImageView img_left_;
+	PImageView img_right_;
 	sint32 width_;
 	sint32 height_;
 
 	sint32 patch_size_;
 	sint32 min_disp_;
 	sint32 max_disp_;
+
+	// 支持权值缓存, 可为空
+	PMSWeightCache* weight_cache_;
+
+	// 是否优先访问权值大的行
+	bool is_weighted_row_order_;
+	// 由中心行向外交替的默认行序
+	vector<uint16> row_order_;
+
+	// 聚合窗口的采样模式, 为空时逐像素聚合
+	const PMSSamplePattern* sample_pattern_;
+
+	// 左右视图的打包图像
+	const PMSPackedImage* packed_left_;
+	const PMSPackedImage* packed_right_;
+	// 未提供打包图像时自行构建的数据
+	PMSPackedImage own_packed_left_;
+	PMSPackedImage own_packed_right_;
 };
 
 
@@ -96,12 +258,13 @@ public:
 	// PatchMatchStero代价计算类的默认构造方法
 	CostComputerPMS() : grad_left_(nullptr), grad_right_(nullptr),
 						gamma_(0), alpha_(0),
-						tau_col_(0), tau_grad_(0) {}
+						tau_col_(0), tau_grad_(0),
+						simd_level_(SimdLevel::NONE) {}
 
 	/**
 	 * \brief PatchMatchStero代价计算类的带参数构造方法
-	 * \param img_left		左图像数据
-	 * \param img_right		右图像数据
+	 * \param img_left		左图像
+	 * \param img_right		右图像
 	 * \param grad_left		左梯度数据
 	 * \param grad_right	右梯度数据
 	 * \param width			图像宽
@@ -113,13 +276,19 @@ public:
 	 * \param alpha			参数alpha值
 	 * \param t_col			参数tau_col值
 	 * \param t_grad		参数tau_grad值
+	 * \param simd		聚合代价计算使用的SIMD级别(需为CPU支持的级别, 不可为AUTO)
+	 * \param packed_left	左视图打包图像, 为空时自行构建
+	 * \param packed_right	右视图打包图像, 为空时自行构建
 	 */
-	CostComputerPMS(const uint8* img_left, const uint8* img_right,
+	CostComputerPMS(const PImageView& img_left, const PImageView& img_right,
 					const PGradient* grad_left, const PGradient* grad_right,
 					const sint32& width, const sint32& height, const sint32& patch_size,
 					const sint32& min_disp, const sint32& max_disp,
 					const float32& gamma, const float32& alpha,
-					const float32& t_col, const float32 t_grad) :
+					const float32& t_col, const float32 t_grad,
+					const SimdLevel& simd = SimdLevel::NONE,
+					const PMSPackedImage* packed_left = nullptr,
+					const PMSPackedImage* packed_right = nullptr) :
 					CostComputer(img_left, img_right, width, height, patch_size, min_disp, max_disp)
 	{
 		grad_left_ = grad_left;
@@ -128,6 +297,8 @@ public:
 		alpha_ = alpha;
 		tau_col_ = t_col;
 		tau_grad_ = t_grad;
+		simd_level_ = (simd == SimdLevel::AUTO) ? SimdLevel::NONE : simd;
+		InitPackedImages(grad_left, grad_right, packed_left, packed_right);
 	}
 
 	/**
@@ -165,32 +336,39 @@ public:
 	}
 
 	/**
-	 * @brief 计算左图像p点视差为d时的代价值, 已知p点颜色值和梯度值
-	 * @param col_p		p点颜色值
-	 * @param grad_p	p点梯度值
-	 * @param x			p点x坐标
-	 * @param y			p点y坐标
-	 * @param d			视差值
+	 * @brief 由打包图像计算同名点对的代价值, 已知左图像素q
+	 * 右图外扩边界覆盖视差范围, 同名点列号xr加外扩宽度后非负, 截断取整即向下取整;
+	 * 外扩边界的有效标记为0, 同名点不在右图中时使用截断参数, 无需判断坐标范围
+	 * @param pix_q		左图像素q
+	 * @param row_r		右图同名点所在行(打包图像行指针)
+	 * @param xr		同名点列号, 实数(线性内插)
 	 * @return float32 	代价值
 	 */
-	inline float32 Compute(const PColor& col_p, const PGradient& grad_p,
-						   const sint32& x, const sint32& y, const float32& d) const
+	inline float32 Compute(const PPixel& pix_q, const PPixel* row_r, const float32& xr) const
 	{
-		// d = x - xr
-		const float32 xr = x - d;
+		const sint32 halo = packed_right_->HaloX();
+		const sint32 x1 = static_cast<sint32>(xr + halo) - halo;
+		const PPixel& p1 = row_r[x1];
 		// 如果同名点不在右图中, 则使用截断参数
-		if (xr < 0.0f || xr >= static_cast<float32>(width_)) {
+		if (!p1.valid) {
 			return (1 - alpha_) * tau_col_ + alpha_ * tau_grad_;
 		}
+		// 外扩边界复制了最后一列, x2处于边界时与x1同值
+		const PPixel& p2 = row_r[x1 + 1];
+		const float32 ofs = xr - x1;
+
 		// 颜色空间
-		const auto col_q = GetColor(img_right_, xr, y);
+		const float32 b = (1 - ofs) * p1.b + ofs * p2.b;
+		const float32 g = (1 - ofs) * p1.g + ofs * p2.g;
+		const float32 r = (1 - ofs) * p1.r + ofs * p2.r;
 		const auto dc = std::min((float32)(
-			abs(col_p.b - col_q.x) + abs(col_p.g - col_q.y) + abs(col_p.r - col_q.z)), tau_col_);
+			abs(pix_q.b - b) + abs(pix_q.g - g) + abs(pix_q.r - r)), tau_col_);
 
 		// 梯度空间
-		const auto grad_q = GetGradient(grad_right_, xr, y);
+		const float32 gx = (1 - ofs) * p1.grad.x + ofs * p2.grad.x;
+		const float32 gy = (1 - ofs) * p1.grad.y + ofs * p2.grad.y;
 		const auto dg = std::min((float32)(
-			abs(grad_p.x - grad_q.x) + abs(grad_p.y - grad_q.y)), tau_grad_);
+			abs(pix_q.grad.x - gx) + abs(pix_q.grad.y - gy)), tau_grad_);
 
 		// 同名点对的不相似代价值
 		return (1 - alpha_) * dc + alpha_ * dg;
@@ -198,25 +376,102 @@ public:
 
 	/**
 	 * @brief 计算左图像p点在视差平面d为ax+by+c时的聚合代价值
+	 * 根据构造时指定的SIMD级别选择向量化实现或标量实现
 	 * @param x			p点x坐标
 	 * @param y 		p点y坐标
 	 * @param param		平面参数(a, b, c)
 	 * @return float32	聚合代价值
 	 */
-	inline float32 ComputeA(const sint32& x, const sint32& y, const DisparityPlane& param) const
+	inline float32 ComputeA(const sint32& x, const sint32& y, const DisparityPlane& param) const override
+	{
+		return ComputeA(x, y, param, Invalid_Float);
+	}
+
+	/**
+	 * @brief 带上界的聚合代价, 部分和不小于上界时提前返回
+	 * @param x				p点x坐标
+	 * @param y 			p点y坐标
+	 * @param param			平面参数(a, b, c)
+	 * @param upper_bound	代价上界
+	 * @return float32		聚合代价值, 或不小于上界的部分和
+	 */
+	inline float32 ComputeA(const sint32& x, const sint32& y, const DisparityPlane& param,
+							const float32& upper_bound) const override
+	{
+		switch (simd_level_) {
+		case SimdLevel::AVX512:
+			return ComputeAAVX512(x, y, param, upper_bound);
+		case SimdLevel::AVX2:
+			return ComputeAAVX2(x, y, param, upper_bound);
+		default:
+			return ComputeAScalar(x, y, param, upper_bound);
+		}
+	}
+
+	/**
+	 * @brief 批量计算p点在多个候选平面下的聚合代价, 按SIMD级别选择实现, 每批最多MAX_BATCH个候选
+	 * @param x				p点x坐标
+	 * @param y 			p点y坐标
+	 * @param params		候选平面数组
+	 * @param num			候选平面个数
+	 * @param costs			输出, 各候选的聚合代价值, 或不小于上界的部分和
+	 * @param upper_bound	代价上界
+	 */
+	inline void ComputeABatch(const sint32& x, const sint32& y, const DisparityPlane* params, const sint32& num,
+							  float32* costs, const float32& upper_bound = Invalid_Float) const override
+	{
+		for (sint32 h = 0; h < num; h += MAX_BATCH) {
+			const sint32 m = (num - h < MAX_BATCH) ? num - h : MAX_BATCH;
+			switch (simd_level_) {
+			case SimdLevel::AVX512:
+				ComputeABatchAVX512(x, y, params + h, m, costs + h, upper_bound);
+				break;
+			case SimdLevel::AVX2:
+				ComputeABatchAVX2(x, y, params + h, m, costs + h, upper_bound);
+				break;
+			default:
+				ComputeABatchScalar(x, y, params + h, m, costs + h, upper_bound);
+				break;
+			}
+		}
+	}
+
+	/**
+	 * @brief 聚合代价的标量实现, 逐像素计算, 作为向量化实现的参考
+	 * @param x				p点x坐标
+	 * @param y 			p点y坐标
+	 * @param param			平面参数(a, b, c)
+	 * @param upper_bound	代价上界, 每行结束时部分和不小于上界则提前返回
+	 * @return float32		聚合代价值
+	 */
+	inline float32 ComputeAScalar(const sint32& x, const sint32& y, const DisparityPlane& param,
+								  const float32& upper_bound = Invalid_Float) const
 	{
 		// 以p点为中心, 聚合区间为[-pat, pat]
 		const auto pat = patch_size_ / 2;
 		// 获取p点颜色值
-		const auto& col_p = GetColor(img_left_, x, y);
+		const PPixel& pix_p = packed_left_->Row(y)[x];
+		// 获取p点的缓存权值块及行序
+		const uint8* weights = weight_cache_ ? weight_cache_->GetWeights(x, y) : nullptr;
+		const uint16* order = GetRowOrder(x, y);
 		float32 cost = 0.0f;
-		// patch逐点计算
-		for (sint32 r = -pat; r <= pat; r++) {
+		// patch逐行逐点计算
+		for (sint32 k = 0; k < patch_size_ && cost < upper_bound; k++) {
+			const sint32 i = order ? order[k] : k;
+			const sint32 r = i - pat;
 			const sint32 yr = y + r;
-			for (sint32 c = -pat; c <= pat; c++) {
+			// 外扩边界覆盖窗口半径, 邻域行总是可读
+			const PPixel* row_l = packed_left_->Row(yr);
+			const PPixel* row_r = packed_right_->Row(yr);
+			// 本行参与聚合的列, 未设置采样模式时为[-pat, pat]
+			const sint32* cols = sample_pattern_ ? sample_pattern_->RowCols(i) : nullptr;
+			const sint32 n = sample_pattern_ ? sample_pattern_->RowCount(i) : patch_size_;
+			for (sint32 j = 0; j < n; j++) {
+				const sint32 c = cols ? cols[j] : j - pat;
 				const sint32 xc = x + c;
-				// 坐标值溢出, 即同名点不在右图中
-				if (yr < 0 || yr > height_ - 1 || xc < 0 || xc > width_ - 1) {
+				const PPixel& pix_q = row_l[xc];
+				// 邻域像素不在图像中
+				if (!pix_q.valid) {
 					continue;
 				}
 				// 根据视差平面方程计算同名点的视差值
@@ -227,60 +482,161 @@ public:
 					continue;
 				}
 
-				const auto& col_q = GetColor(img_left_, xc, yr);
-				// 颜色空间
-				const auto dc = abs(col_p.r - col_q.r) + abs(col_p.g - col_q.g) + abs(col_p.b - col_q.b);
-
+				// 计算同名点对在同一平面的可能性, 有缓存时直接读取
+				float64 w;
+				if (weights) {
+					w = weights[(r + pat) * patch_size_ + c + pat] * PMSWeightCache::WEIGHT_SCALE;
+				}
+				else {
+					// 颜色空间
+					const auto dc = abs(pix_p.r - pix_q.r) + abs(pix_p.g - pix_q.g) + abs(pix_p.b - pix_q.b);
 #ifdef USE_FAST_EXP
-				// 计算同名点对在同一平面的可能性
-				const auto w = fast_exp(double(-dc / gamma_));
+					w = fast_exp(double(-dc / gamma_));
 #else
-				const auto w = exp(-dc / gamma_);
+					w = exp(-dc / gamma_);
 #endif
+				}
 
 				// 计算聚合代价值
-				// 从预先计算好打梯度矩阵中查找对应位置的梯度值
-				const auto grad_q = GetGradient(grad_left_, xc, yr);
-				cost += w * Compute(col_q, grad_q, xc, yr, d);
+				cost += w * Compute(pix_q, row_r, xc - d);
 			}
 		}
 		return cost;
 	}
 
+	/**
+	 * @brief 批量聚合代价的标量实现, 邻域像素和权值每个只计算一次, 各候选的结果与ComputeAScalar相同
+	 * @param x				p点x坐标
+	 * @param y 			p点y坐标
+	 * @param params		候选平面数组
+	 * @param num			候选平面个数, 不大于MAX_BATCH
+	 * @param costs			输出, 各候选的聚合代价值, 或不小于上界的部分和
+	 * @param upper_bound	代价上界, 每行开始时部分和不小于上界的候选不再累加
+	 */
+	inline void ComputeABatchScalar(const sint32& x, const sint32& y, const DisparityPlane* params, const sint32& num,
+									float32* costs, const float32& upper_bound = Invalid_Float) const
+	{
+		const auto pat = patch_size_ / 2;
+		const PPixel& pix_p = packed_left_->Row(y)[x];
+		const uint8* weights = weight_cache_ ? weight_cache_->GetWeights(x, y) : nullptr;
+		const uint16* order = GetRowOrder(x, y);
+		// 本行仍在累加的候选
+		bool is_live[MAX_BATCH];
+		for (sint32 h = 0; h < num; h++) {
+			costs[h] = 0.0f;
+		}
+		for (sint32 k = 0; k < patch_size_; k++) {
+			sint32 num_live = 0;
+			for (sint32 h = 0; h < num; h++) {
+				is_live[h] = costs[h] < upper_bound;
+				num_live += is_live[h];
+			}
+			if (num_live == 0) {
+				break;
+			}
+			const sint32 i = order ? order[k] : k;
+			const sint32 r = i - pat;
+			const sint32 yr = y + r;
+			const PPixel* row_l = packed_left_->Row(yr);
+			const PPixel* row_r = packed_right_->Row(yr);
+			const sint32* cols = sample_pattern_ ? sample_pattern_->RowCols(i) : nullptr;
+			const sint32 n = sample_pattern_ ? sample_pattern_->RowCount(i) : patch_size_;
+			for (sint32 j = 0; j < n; j++) {
+				const sint32 c = cols ? cols[j] : j - pat;
+				const sint32 xc = x + c;
+				const PPixel& pix_q = row_l[xc];
+				if (!pix_q.valid) {
+					continue;
+				}
+
+				// 各候选共用的权值
+				float64 w;
+				if (weights) {
+					w = weights[(r + pat) * patch_size_ + c + pat] * PMSWeightCache::WEIGHT_SCALE;
+				}
+				else {
+					const auto dc = abs(pix_p.r - pix_q.r) + abs(pix_p.g - pix_q.g) + abs(pix_p.b - pix_q.b);
+#ifdef USE_FAST_EXP
+					w = fast_exp(double(-dc / gamma_));
+#else
+					w = exp(-dc / gamma_);
+#endif
+				}
+
+				for (sint32 h = 0; h < num; h++) {
+					if (!is_live[h]) {
+						continue;
+					}
+					const float32 d = params[h].to_disparity(xc, yr);
+					if (d < min_disp_ || d > max_disp_) {
+						costs[h] += COST_PUNISH;
+						continue;
+					}
+					costs[h] += w * Compute(pix_q, row_r, xc - d);
+				}
+			}
+		}
+	}
+
+	/**
+	 * @brief 聚合代价的AVX2实现, 每次处理一行中的8列, 实现见cost_computor_simd.cpp
+	 * 与标量实现的差异仅来自单精度的权值计算和求和顺序
+	 * @param x				p点x坐标
+	 * @param y 			p点y坐标
+	 * @param param			平面参数(a, b, c)
+	 * @param upper_bound	代价上界, 每行结束时部分和不小于上界则提前返回
+	 * @return float32		聚合代价值
+	 */
+	float32 ComputeAAVX2(const sint32& x, const sint32& y, const DisparityPlane& param,
+						 const float32& upper_bound = Invalid_Float) const;
+
+	/**
+	 * @brief 聚合代价的AVX-512实现, 每次处理一行中的16列, 实现见cost_computor_simd.cpp
+	 * @param x				p点x坐标
+	 * @param y 			p点y坐标
+	 * @param param			平面参数(a, b, c)
+	 * @param upper_bound	代价上界, 每行结束时部分和不小于上界则提前返回
+	 * @return float32		聚合代价值
+	 */
+	float32 ComputeAAVX512(const sint32& x, const sint32& y, const DisparityPlane& param,
+						   const float32& upper_bound = Invalid_Float) const;
+
+	// 批量聚合代价的AVX2实现, 邻域像素和权值每8列计算一次, 供各候选共用, 实现见cost_computor_simd.cpp
+	void ComputeABatchAVX2(const sint32& x, const sint32& y, const DisparityPlane* params, const sint32& num,
+						   float32* costs, const float32& upper_bound = Invalid_Float) const;
+
+	// 批量聚合代价的AVX-512实现, 邻域像素和权值每16列计算一次, 实现见cost_computor_simd.cpp
+	void ComputeABatchAVX512(const sint32& x, const sint32& y, const DisparityPlane* params, const sint32& num,
+							 float32* costs, const float32& upper_bound = Invalid_Float) const;
+
 	/**
 	* @brief 获取像素点的颜色值
-	* @param img_data	颜色数组, 3通道
+	* @param img		图像
 	* @param x			像素x坐标
 	* @param y			像素y坐标
 	* @return PColor 	像素(x,y)的颜色值
 	*/
-	inline PColor GetColor(const uint8* img_data, const sint32& x, const sint32& y) const
+	inline PColor GetColor(const PImageView& img, const sint32& x, const sint32& y) const
 	{
-		auto* pixel = img_data + y * width_ * 3 + 3 * x;
-		return { pixel[0], pixel[1], pixel[2] };
+		return img.Color(x, y);
 	}
 
 	/**
 	* @brief 获取像素点的颜色值
-	* @param img_data	颜色数组
+	* @param img		图像
 	* @param x			像素x坐标, 实数(线性内插得到颜色值)
 	* @param y			像素y坐标
-	* @return PVector3f	像素(x,y)的颜色值
+	* @return PVector3f	像素(x,y)的颜色值, 依次为b,g,r
 	*/
-	inline PVector3f GetColor(const uint8* img_data, const float32& x,const sint32& y) const
+	inline PVector3f GetColor(const PImageView& img, const float32& x,const sint32& y) const
 	{
-		float32 col[3];
 		const auto x1 = static_cast<sint32>(x);
 		const sint32 x2 = x1 + 1;
 		const float32 ofs = x - x1;
 
-		for (sint32 n = 0; n < 3; n++) {
-			const auto& g1 = img_data[y * width_ * 3 + 3 * x1 + n];
-			const auto& g2 = (x2 < width_) ? img_data[y * width_ * 3 + 3 * x2 + n] : g1;
-			col[n] = (1 - ofs) * g1 + ofs * g2;
-		}
-
-		return { col[0], col[1], col[2] };
+		const PColor c1 = img.Color(x1, y);
+		const PColor c2 = (x2 < width_) ? img.Color(x2, y) : c1;
+		return { (1 - ofs) * c1.b + ofs * c2.b, (1 - ofs) * c1.g + ofs * c2.g, (1 - ofs) * c1.r + ofs * c2.r };
 	}
 
 	/**
@@ -322,8 +678,540 @@ private:
 	float32 alpha_;
 	float32 tau_col_;
 	float32 tau_grad_;
+
+	// 聚合代价计算使用的SIMD级别
+	SimdLevel simd_level_;
 };
 
 // ↓↓↓可在此通过派生类来实现其他代价计算方法类↓↓↓
 
+/**
+ * @brief 实现类
+ * PatchMatchStero原文代价的定点实现
+ * 颜色差dc为0~765的整数, 权值由766项查找表得到(与权值缓存的8位量化一致);
+ * 颜色/梯度代价为16位无符号定点数(COST_SHIFT位小数), 逐行以32位整数累加
+ */
+class CostComputerPMSFixed : public CostComputer {
+public:
+	// 代价的定点小数位数
+	static constexpr sint32 COST_SHIFT = 8;
+	// 视差/坐标的定点小数位数
+	static constexpr sint32 COORD_SHIFT = 16;
+	// 权值查找表的项数, 即颜色差的取值个数
+	static constexpr sint32 LUT_SIZE = 766;
+
+	// 定点代价计算类的默认构造方法
+	CostComputerPMSFixed() : alpha_q_(0), tau_col_q_(0), tau_grad_q_(0), trunc_q_(0) {
+		std::fill(weight_lut_, weight_lut_ + LUT_SIZE, uint8(0));
+	}
+
+	/**
+	 * \brief 定点代价计算类的带参数构造方法, 参数同CostComputerPMS
+	 * \param img_left		左图像
+	 * \param img_right		右图像
+	 * \param grad_left		左梯度数据
+	 * \param grad_right	右梯度数据
+	 * \param width			图像宽
+	 * \param height		图像高
+	 * \param patch_size	局部块大小
+	 * \param min_disp		最小视差值
+	 * \param max_disp		最大视差值
+	 * \param gamma			参数gamma值
+	 * \param alpha			参数alpha值
+	 * \param t_col			参数tau_col值
+	 * \param t_grad		参数tau_grad值
+	 * \param packed_left	左视图打包图像, 为空时自行构建
+	 * \param packed_right	右视图打包图像, 为空时自行构建
+	 */
+	CostComputerPMSFixed(const PImageView& img_left, const PImageView& img_right,
+						 const PGradient* grad_left, const PGradient* grad_right,
+						 const sint32& width, const sint32& height, const sint32& patch_size,
+						 const sint32& min_disp, const sint32& max_disp,
+						 const float32& gamma, const float32& alpha,
+						 const float32& t_col, const float32 t_grad,
+						 const PMSPackedImage* packed_left = nullptr,
+						 const PMSPackedImage* packed_right = nullptr) :
+						 CostComputer(img_left, img_right, width, height, patch_size, min_disp, max_disp)
+	{
+		InitPackedImages(grad_left, grad_right, packed_left, packed_right);
+
+		// 参数量化
+		const float32 one = static_cast<float32>(1 << COST_SHIFT);
+		alpha_q_ = static_cast<sint32>(lround(alpha * one));
+		tau_col_q_ = static_cast<sint32>(std::min(65535L, lround(t_col * one)));
+		tau_grad_q_ = static_cast<sint32>(std::min(65535L, lround(t_grad * one)));
+		trunc_q_ = static_cast<uint16>((((1 << COST_SHIFT) - alpha_q_) * tau_col_q_ + alpha_q_ * tau_grad_q_) >> COST_SHIFT);
+
+		// 权值查找表, 与CostComputerPMS的权值计算方式一致
+		for (sint32 dc = 0; dc < LUT_SIZE; dc++) {
+#ifdef USE_FAST_EXP
+			const auto w = fast_exp(double(-dc / gamma));
+#else
+			const auto w = exp(-dc / gamma);
+#endif
+			weight_lut_[dc] = static_cast<uint8>(std::min(255.0, w * 255.0 + 0.5));
+		}
+	}
+
+	/**
+	 * @brief 计算左图像p点视差为d时的代价值
+	 * @param x			p点x坐标
+	 * @param y			p点y坐标
+	 * @param d			视差值
+	 * @return float32 	代价值
+	 */
+	inline float32 Compute(const sint32& x, const sint32& y, const float32& d) override
+	{
+		// 视差可为任意值, 先判断同名点是否在右图中
+		const float32 xr = x - d;
+		if (xr < 0.0f || xr >= static_cast<float32>(width_)) {
+			return trunc_q_ / static_cast<float32>(1 << COST_SHIFT);
+		}
+		const sint64 xr_q = llround(xr * (1 << COORD_SHIFT));
+		const auto cost = ComputeFixed(packed_left_->Row(y)[x], packed_right_->Row(y), xr_q);
+		return cost / static_cast<float32>(1 << COST_SHIFT);
+	}
+
+	/**
+	 * @brief 计算左图像p点在视差平面d为ax+by+c时的聚合代价值
+	 * 平面视差沿行方向以定点数递增, 每行的加权代价以32位整数累加
+	 * @param x			p点x坐标
+	 * @param y 		p点y坐标
+	 * @param param		平面参数(a, b, c)
+	 * @return float32	聚合代价值
+	 */
+	inline float32 ComputeA(const sint32& x, const sint32& y, const DisparityPlane& param) const override
+	{
+		return ComputeA(x, y, param, Invalid_Float);
+	}
+
+	/**
+	 * @brief 带上界的聚合代价, 每行结束时部分和不小于上界则提前返回
+	 * @param x				p点x坐标
+	 * @param y 			p点y坐标
+	 * @param param			平面参数(a, b, c)
+	 * @param upper_bound	代价上界
+	 * @return float32		聚合代价值, 或不小于上界的部分和
+	 */
+	inline float32 ComputeA(const sint32& x, const sint32& y, const DisparityPlane& param,
+							const float32& upper_bound) const override
+	{
+		// 以p点为中心, 聚合区间为[-pat, pat], 列方向裁剪到图像内
+		const auto pat = patch_size_ / 2;
+		const sint32 c_lo = std::max(-pat, -x);
+		const sint32 c_hi = std::min(pat, width_ - 1 - x);
+
+		const PPixel& pix_p = packed_left_->Row(y)[x];
+		const uint8* weights = weight_cache_ ? weight_cache_->GetWeights(x, y) : nullptr;
+		const uint16* order = GetRowOrder(x, y);
+		const float32 scale = 1.0f / (255 << COST_SHIFT);
+
+		const float32 one = static_cast<float32>(1 << COORD_SHIFT);
+		const sint64 a_q = llround(param.param.x * one);
+		// 有符号数乘以定点单位而不做左移, 负数左移为未定义行为
+		const sint64 one_q = static_cast<sint64>(1) << COORD_SHIFT;
+		const sint64 min_q = static_cast<sint64>(min_disp_) * one_q;
+		const sint64 max_q = static_cast<sint64>(max_disp_) * one_q;
+
+		sint64 cost = 0;
+		sint32 num_punish = 0;
+		for (sint32 k = 0; k < patch_size_; k++) {
+			const sint32 i = order ? order[k] : k;
+			const sint32 r = i - pat;
+			const sint32 yr = y + r;
+			if (yr < 0 || yr > height_ - 1) {
+				continue;
+			}
+			const PPixel* row_l = packed_left_->Row(yr);
+			const PPixel* row_r = packed_right_->Row(yr);
+			const uint8* wrow = weights ? weights + i * patch_size_ + pat : nullptr;
+
+			// 本行参与聚合的列, 未设置采样模式时为[c_lo, c_hi]
+			const sint32* cols = sample_pattern_ ? sample_pattern_->RowCols(i) : nullptr;
+			const sint32 n = sample_pattern_ ? sample_pattern_->RowCount(i) : c_hi - c_lo + 1;
+
+			// 行首视差, 沿行方向每列增加a
+			const sint64 d_q0 = llround(param.to_disparity(x + c_lo, yr) * one);
+			sint32 row_cost = 0;
+			for (sint32 j = 0; j < n; j++) {
+				const sint32 c = cols ? cols[j] : c_lo + j;
+				if (c < c_lo || c > c_hi) {
+					continue;
+				}
+				const sint64 d_q = d_q0 + (c - c_lo) * a_q;
+				// 截断溢出惩罚
+				if (d_q < min_q || d_q > max_q) {
+					num_punish++;
+					continue;
+				}
+				const sint32 xc = x + c;
+				const PPixel& pix_q = row_l[xc];
+				const sint32 w = wrow ? wrow[c] :
+					weight_lut_[abs(pix_p.b - pix_q.b) + abs(pix_p.g - pix_q.g) + abs(pix_p.r - pix_q.r)];
+				const sint64 xr_q = static_cast<sint64>(xc) * one_q - d_q;
+				row_cost += w * ComputeFixed(pix_q, row_r, xr_q);
+			}
+			cost += row_cost;
+
+			// 部分和已不小于上界, 提前终止
+			if (cost * scale + num_punish * COST_PUNISH >= upper_bound) {
+				break;
+			}
+		}
+
+		return cost * scale + num_punish * COST_PUNISH;
+	}
+
+	/**
+	 * @brief 批量计算p点在多个候选平面下的聚合代价, 邻域像素和权值每个只读取一次, 各候选的结果与ComputeA相同
+	 * @param x				p点x坐标
+	 * @param y 			p点y坐标
+	 * @param params		候选平面数组
+	 * @param num			候选平面个数
+	 * @param costs			输出, 各候选的聚合代价值, 或不小于上界的部分和
+	 * @param upper_bound	代价上界
+	 */
+	inline void ComputeABatch(const sint32& x, const sint32& y, const DisparityPlane* params, const sint32& num,
+							  float32* costs, const float32& upper_bound = Invalid_Float) const override
+	{
+		for (sint32 h = 0; h < num; h += MAX_BATCH) {
+			const sint32 m = (num - h < MAX_BATCH) ? num - h : MAX_BATCH;
+			ComputeABatchImpl(x, y, params + h, m, costs + h, upper_bound);
+		}
+	}
+
+private:
+	// 批量聚合代价的实现, num不大于MAX_BATCH, 参数同ComputeABatch
+	inline void ComputeABatchImpl(const sint32& x, const sint32& y, const DisparityPlane* params, const sint32& num,
+								  float32* costs, const float32& upper_bound) const
+	{
+		const auto pat = patch_size_ / 2;
+		const sint32 c_lo = std::max(-pat, -x);
+		const sint32 c_hi = std::min(pat, width_ - 1 - x);
+
+		const PPixel& pix_p = packed_left_->Row(y)[x];
+		const uint8* weights = weight_cache_ ? weight_cache_->GetWeights(x, y) : nullptr;
+		const uint16* order = GetRowOrder(x, y);
+		const float32 scale = 1.0f / (255 << COST_SHIFT);
+
+		const float32 one = static_cast<float32>(1 << COORD_SHIFT);
+		// 有符号数乘以定点单位而不做左移, 负数左移为未定义行为
+		const sint64 one_q = static_cast<sint64>(1) << COORD_SHIFT;
+		const sint64 min_q = static_cast<sint64>(min_disp_) * one_q;
+		const sint64 max_q = static_cast<sint64>(max_disp_) * one_q;
+
+		// 各候选的定点平面参数及累加值
+		sint64 a_q[MAX_BATCH], d_q0[MAX_BATCH], cost[MAX_BATCH];
+		sint32 row_cost[MAX_BATCH], num_punish[MAX_BATCH];
+		bool is_live[MAX_BATCH];
+		for (sint32 h = 0; h < num; h++) {
+			a_q[h] = llround(params[h].param.x * one);
+			cost[h] = 0;
+			num_punish[h] = 0;
+			is_live[h] = true;
+		}
+		sint32 num_live = num;
+
+		for (sint32 k = 0; k < patch_size_ && num_live > 0; k++) {
+			const sint32 i = order ? order[k] : k;
+			const sint32 r = i - pat;
+			const sint32 yr = y + r;
+			if (yr < 0 || yr > height_ - 1) {
+				continue;
+			}
+			const PPixel* row_l = packed_left_->Row(yr);
+			const PPixel* row_r = packed_right_->Row(yr);
+			const uint8* wrow = weights ? weights + i * patch_size_ + pat : nullptr;
+			const sint32* cols = sample_pattern_ ? sample_pattern_->RowCols(i) : nullptr;
+			const sint32 n = sample_pattern_ ? sample_pattern_->RowCount(i) : c_hi - c_lo + 1;
+
+			for (sint32 h = 0; h < num; h++) {
+				d_q0[h] = llround(params[h].to_disparity(x + c_lo, yr) * one);
+				row_cost[h] = 0;
+			}
+			for (sint32 j = 0; j < n; j++) {
+				const sint32 c = cols ? cols[j] : c_lo + j;
+				if (c < c_lo || c > c_hi) {
+					continue;
+				}
+				const sint32 xc = x + c;
+				const PPixel& pix_q = row_l[xc];
+				// 各候选共用的权值
+				const sint32 w = wrow ? wrow[c] :
+					weight_lut_[abs(pix_p.b - pix_q.b) + abs(pix_p.g - pix_q.g) + abs(pix_p.r - pix_q.r)];
+				for (sint32 h = 0; h < num; h++) {
+					if (!is_live[h]) {
+						continue;
+					}
+					const sint64 d_q = d_q0[h] + (c - c_lo) * a_q[h];
+					if (d_q < min_q || d_q > max_q) {
+						num_punish[h]++;
+						continue;
+					}
+					const sint64 xr_q = static_cast<sint64>(xc) * one_q - d_q;
+					row_cost[h] += w * ComputeFixed(pix_q, row_r, xr_q);
+				}
+			}
+
+			// 部分和已不小于上界的候选提前终止
+			for (sint32 h = 0; h < num; h++) {
+				if (is_live[h]) {
+					cost[h] += row_cost[h];
+					costs[h] = cost[h] * scale + num_punish[h] * COST_PUNISH;
+					if (costs[h] >= upper_bound) {
+						is_live[h] = false;
+						num_live--;
+					}
+				}
+			}
+		}
+		for (sint32 h = 0; h < num; h++) {
+			if (is_live[h]) {
+				costs[h] = cost[h] * scale + num_punish[h] * COST_PUNISH;
+			}
+		}
+	}
+
+	/**
+	 * @brief 计算同名点对的定点代价
+	 * 同名点列号向下取整后由外扩边界的有效标记判断是否在右图中
+	 * @param pix_q		左图像素q
+	 * @param row_r		右图同名点所在行(打包图像行指针)
+	 * @param xr_q		同名点列号(COORD_SHIFT位小数)
+	 * @return uint16	代价值(COST_SHIFT位小数)
+	 */
+	inline uint16 ComputeFixed(const PPixel& pix_q, const PPixel* row_r, const sint64& xr_q) const
+	{
+		const sint32 x1 = static_cast<sint32>(xr_q >> COORD_SHIFT);
+		const PPixel& p1 = row_r[x1];
+		// 如果同名点不在右图中, 则使用截断参数
+		if (!p1.valid) {
+			return trunc_q_;
+		}
+		// 外扩边界复制了最后一列, x2处于边界时与x1同值
+		const PPixel& p2 = row_r[x1 + 1];
+		// 内插系数, 8位小数
+		const sint32 f = static_cast<sint32>(xr_q >> (COORD_SHIFT - 8)) & 0xff;
+		const sint32 f_c = 256 - f;
+
+		// 颜色空间, 各通道差值取整后求和, 与浮点实现一致
+		sint32 dc = (abs((pix_q.b << 8) - (f_c * p1.b + f * p2.b)) >> 8) +
+					(abs((pix_q.g << 8) - (f_c * p1.g + f * p2.g)) >> 8) +
+					(abs((pix_q.r << 8) - (f_c * p1.r + f * p2.r)) >> 8);
+		dc = std::min(dc << COST_SHIFT, tau_col_q_);
+
+		// 梯度空间
+		sint32 dg = (abs(pix_q.grad.x * 256 - (f_c * p1.grad.x + f * p2.grad.x)) >> 8) +
+					(abs(pix_q.grad.y * 256 - (f_c * p1.grad.y + f * p2.grad.y)) >> 8);
+		dg = std::min(dg << COST_SHIFT, tau_grad_q_);
+
+		return static_cast<uint16>((((1 << COST_SHIFT) - alpha_q_) * dc + alpha_q_ * dg) >> COST_SHIFT);
+	}
+
+private:
+	// 量化参数, COST_SHIFT位小数
+	sint32 alpha_q_;
+	sint32 tau_col_q_;
+	sint32 tau_grad_q_;
+	// 同名点不在右图中时的截断代价
+	uint16 trunc_q_;
+
+	// 权值查找表, 以颜色差为索引, 8位量化(255为1)
+	uint8 weight_lut_[LUT_SIZE];
+};
+
+
+/**
+ * @brief 实现类
+ * Census变换代价: 同名点对的代价为census比特串的汉明距离, 对光照变化鲁棒
+ * 支持权值与CostComputerPMS相同(由颜色差计算), 聚合方式相同(倾斜窗口);
+ * 汉明距离按线性内插(两侧列的汉明距离加权)或最近列计算, 按census位数归一化到与PMS截断代价相同的范围
+ * 聚合实现见cost_computor_census.cpp, CPU支持AVX2时(必然支持POPCNT)使用硬件popcount
+ */
+class CostComputerCensus : public CostComputer {
+public:
+	// 权值查找表的项数, 即颜色差的取值个数
+	static constexpr sint32 LUT_SIZE = 766;
+
+	// Census代价计算类的默认构造方法
+	CostComputerCensus() : census_left_(nullptr), census_right_(nullptr), is_interpolate_(true), is_hw_popcnt_(false), scale_(0) {
+		std::fill(weight_lut_, weight_lut_ + LUT_SIZE, 0.0f);
+	}
+
+	/**
+	 * \brief Census代价计算类的带参数构造方法
+	 * \param img_left		左图像
+	 * \param img_right		右图像
+	 * \param width			图像宽
+	 * \param height		图像高
+	 * \param patch_size	局部块大小
+	 * \param min_disp		最小视差值
+	 * \param max_disp		最大视差值
+	 * \param gamma			参数gamma值
+	 * \param alpha			参数alpha值, 仅用于确定代价范围
+	 * \param t_col			参数tau_col值, 仅用于确定代价范围
+	 * \param t_grad		参数tau_grad值, 仅用于确定代价范围
+	 * \param census_w		census窗口宽
+	 * \param census_h		census窗口高
+	 * \param interpolate	是否对汉明距离线性内插, 否则取最近列
+	 * \param simd			CPU支持的SIMD级别, 不为NONE时使用硬件popcount
+	 * \param packed_left	左视图打包图像, 为空时自行构建
+	 * \param packed_right	右视图打包图像, 为空时自行构建
+	 * \param census_left	左视图census图像, 为空或窗口、外扩不符时自行构建
+	 * \param census_right	右视图census图像, 为空或窗口、外扩不符时自行构建
+	 */
+	CostComputerCensus(const PImageView& img_left, const PImageView& img_right,
+					   const sint32& width, const sint32& height, const sint32& patch_size,
+					   const sint32& min_disp, const sint32& max_disp,
+					   const float32& gamma, const float32& alpha,
+					   const float32& t_col, const float32 t_grad,
+					   const sint32& census_w, const sint32& census_h, const bool& interpolate,
+					   const SimdLevel& simd = SimdLevel::NONE,
+					   const PMSPackedImage* packed_left = nullptr,
+					   const PMSPackedImage* packed_right = nullptr,
+					   const PMSCensusImage* census_left = nullptr,
+					   const PMSCensusImage* census_right = nullptr) :
+					   CostComputer(img_left, img_right, width, height, patch_size, min_disp, max_disp)
+	{
+		// 打包图像提供颜色(支持权值)及有效标记, 不需要梯度
+		InitPackedImages(nullptr, nullptr, packed_left, packed_right);
+		const sint32 halo_x = PMSPackedImage::RequiredHaloX(patch_size_, min_disp_, max_disp_);
+		const sint32 halo_y = PMSPackedImage::RequiredHaloY(patch_size_);
+		if (census_left && census_left->Covers(census_w, census_h, halo_x, halo_y)) {
+			census_left_ = census_left;
+		}
+		else {
+			own_census_left_.Build(img_left, census_w, census_h, halo_x, halo_y);
+			census_left_ = &own_census_left_;
+		}
+		if (census_right && census_right->Covers(census_w, census_h, halo_x, halo_y)) {
+			census_right_ = census_right;
+		}
+		else {
+			own_census_right_.Build(img_right, census_w, census_h, halo_x, halo_y);
+			census_right_ = &own_census_right_;
+		}
+
+		is_interpolate_ = interpolate;
+		is_hw_popcnt_ = (simd != SimdLevel::NONE && simd != SimdLevel::AUTO);
+
+		// 全部位不同时代价等于PMS的截断代价
+		scale_ = ((1 - alpha) * t_col + alpha * t_grad) / std::max(census_left_->NumBits(), 1);
+
+		// 权值查找表, 与CostComputerPMS的权值计算方式一致
+		for (sint32 dc = 0; dc < LUT_SIZE; dc++) {
+#ifdef USE_FAST_EXP
+			weight_lut_[dc] = static_cast<float32>(fast_exp(double(-dc / gamma)));
+#else
+			weight_lut_[dc] = static_cast<float32>(exp(-dc / gamma));
+#endif
+		}
+	}
+
+	/**
+	 * @brief 计算左图像p点视差为d时的代价值
+	 * @param x			p点x坐标
+	 * @param y			p点y坐标
+	 * @param d			视差值
+	 * @return float32 	代价值
+	 */
+	float32 Compute(const sint32& x, const sint32& y, const float32& d) override;
+
+	/**
+	 * @brief 计算左图像p点在视差平面d为ax+by+c时的聚合代价值
+	 * @param x			p点x坐标
+	 * @param y 		p点y坐标
+	 * @param param		平面参数(a, b, c)
+	 * @return float32	聚合代价值
+	 */
+	inline float32 ComputeA(const sint32& x, const sint32& y, const DisparityPlane& param) const override
+	{
+		return ComputeA(x, y, param, Invalid_Float);
+	}
+
+	/**
+	 * @brief 带上界的聚合代价, 每行结束时部分和不小于上界则提前返回
+	 * @param x				p点x坐标
+	 * @param y 			p点y坐标
+	 * @param param			平面参数(a, b, c)
+	 * @param upper_bound	代价上界
+	 * @return float32		聚合代价值, 或不小于上界的部分和
+	 */
+	inline float32 ComputeA(const sint32& x, const sint32& y, const DisparityPlane& param,
+							const float32& upper_bound) const override
+	{
+		return is_hw_popcnt_ ? ComputeAPopcnt(x, y, param, upper_bound) : ComputeAScalar(x, y, param, upper_bound);
+	}
+
+	// 聚合代价的可移植实现, 软件popcount
+	float32 ComputeAScalar(const sint32& x, const sint32& y, const DisparityPlane& param,
+						   const float32& upper_bound = Invalid_Float) const;
+
+	// 聚合代价的硬件popcount实现, 需CPU支持POPCNT
+	float32 ComputeAPopcnt(const sint32& x, const sint32& y, const DisparityPlane& param,
+						   const float32& upper_bound = Invalid_Float) const;
+
+	/**
+	 * @brief 批量计算p点在多个候选平面下的聚合代价, 邻域census串和权值每个只读取一次, 各候选的结果与ComputeA相同
+	 * @param x				p点x坐标
+	 * @param y 			p点y坐标
+	 * @param params		候选平面数组
+	 * @param num			候选平面个数
+	 * @param costs			输出, 各候选的聚合代价值, 或不小于上界的部分和
+	 * @param upper_bound	代价上界
+	 */
+	inline void ComputeABatch(const sint32& x, const sint32& y, const DisparityPlane* params, const sint32& num,
+							  float32* costs, const float32& upper_bound = Invalid_Float) const override
+	{
+		for (sint32 h = 0; h < num; h += MAX_BATCH) {
+			const sint32 m = (num - h < MAX_BATCH) ? num - h : MAX_BATCH;
+			if (is_hw_popcnt_) {
+				ComputeABatchPopcnt(x, y, params + h, m, costs + h, upper_bound);
+			}
+			else {
+				ComputeABatchScalar(x, y, params + h, m, costs + h, upper_bound);
+			}
+		}
+	}
+
+	// 批量聚合代价的可移植实现, num不大于MAX_BATCH
+	void ComputeABatchScalar(const sint32& x, const sint32& y, const DisparityPlane* params, const sint32& num,
+							 float32* costs, const float32& upper_bound = Invalid_Float) const;
+
+	// 批量聚合代价的硬件popcount实现, num不大于MAX_BATCH
+	void ComputeABatchPopcnt(const sint32& x, const sint32& y, const DisparityPlane* params, const sint32& num,
+							 float32* costs, const float32& upper_bound = Invalid_Float) const;
+
+private:
+	/**
+	 * @brief 聚合代价的实现, 由ComputeAScalar/ComputeAPopcnt展开
+	 * @tparam kHwPopcnt	是否使用硬件popcount
+	 */
+	template <bool kHwPopcnt>
+	float32 ComputeAImpl(const sint32& x, const sint32& y, const DisparityPlane& param,
+						 const float32& upper_bound) const;
+
+	// 批量聚合代价的实现, 由ComputeABatchScalar/ComputeABatchPopcnt展开
+	template <bool kHwPopcnt>
+	void ComputeABatchImpl(const sint32& x, const sint32& y, const DisparityPlane* params, const sint32& num,
+						   float32* costs, const float32& upper_bound) const;
+
+private:
+	// 左右视图的census图像, 指向外部传入的或自行构建的图像
+	const PMSCensusImage* census_left_;
+	const PMSCensusImage* census_right_;
+	PMSCensusImage own_census_left_;
+	PMSCensusImage own_census_right_;
+
+	// 是否对汉明距离线性内插
+	bool is_interpolate_;
+	// 是否使用硬件popcount
+	bool is_hw_popcnt_;
+	// 汉明距离到代价的比例
+	float32 scale_;
+
+	// 权值查找表, 以颜色差为索引
+	float32 weight_lut_[LUT_SIZE];
+};
+
 #endif
\ No newline at end of file
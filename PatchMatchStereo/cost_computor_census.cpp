@@ -0,0 +1,250 @@
+/* -*-c++-*- PatchMatchStereo - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+*			  https://github.com/ethan-li-coding
+* Describe	: implement of census cost computer
+*/
+
+#include "stdafx.h"
+#include "cost_computor.hpp"
+#include "pms_util.h"
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+namespace
+{
+	/**
+	 * @brief 统计64位整数中置位的个数
+	 * @tparam kHwPopcnt	是否使用硬件popcount, 否则为SWAR位运算
+	 * @param v				64位整数
+	 * @return sint32		置位个数
+	 */
+	template <bool kHwPopcnt>
+	PMS_FORCE_INLINE sint32 PopCount64(uint64 v)
+	{
+		if (kHwPopcnt) {
+#if defined(__GNUC__) || defined(__clang__)
+			return __builtin_popcountll(v);
+#elif defined(_MSC_VER) && defined(_M_X64)
+			return static_cast<sint32>(__popcnt64(v));
+#elif defined(_MSC_VER) && defined(_M_IX86)
+			return static_cast<sint32>(__popcnt(static_cast<uint32>(v)) + __popcnt(static_cast<uint32>(v >> 32)));
+#endif
+		}
+		v = v - ((v >> 1) & 0x5555555555555555ULL);
+		v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+		v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+		return static_cast<sint32>((v * 0x0101010101010101ULL) >> 56);
+	}
+
+	/**
+	 * @brief 计算同名点对的汉明距离
+	 * 右图外扩边界覆盖视差范围, 同名点列号加外扩宽度后非负, 截断取整即向下取整;
+	 * 同名点不在右图中时返回census位数, 即全部位不同
+	 * @tparam kHwPopcnt	是否使用硬件popcount
+	 * @param census_q		左图像素q的census比特串
+	 * @param census_r		右图同名点所在行的census行指针
+	 * @param pixel_r		右图同名点所在行的打包图像行指针(有效标记)
+	 * @param xr			同名点列号, 实数
+	 * @param halo			右图左右外扩宽度
+	 * @param num_bits		census位数
+	 * @param interpolate	是否线性内插, 否则取最近列
+	 * @return float32		汉明距离
+	 */
+	template <bool kHwPopcnt>
+	PMS_FORCE_INLINE float32 Hamming(const uint64& census_q, const uint64* census_r, const PPixel* pixel_r,
+									 const float32& xr, const sint32& halo, const sint32& num_bits,
+									 const bool& interpolate)
+	{
+		if (!interpolate) {
+			const sint32 xn = static_cast<sint32>(xr + halo + 0.5f) - halo;
+			return pixel_r[xn].valid ? static_cast<float32>(PopCount64<kHwPopcnt>(census_q ^ census_r[xn])) :
+									   static_cast<float32>(num_bits);
+		}
+		const sint32 x1 = static_cast<sint32>(xr + halo) - halo;
+		if (!pixel_r[x1].valid) {
+			return static_cast<float32>(num_bits);
+		}
+		// 外扩边界复制了最后一列, x2处于边界时与x1同值
+		const float32 ofs = xr - x1;
+		const sint32 h1 = PopCount64<kHwPopcnt>(census_q ^ census_r[x1]);
+		const sint32 h2 = PopCount64<kHwPopcnt>(census_q ^ census_r[x1 + 1]);
+		return (1 - ofs) * h1 + ofs * h2;
+	}
+}
+
+float32 CostComputerCensus::Compute(const sint32& x, const sint32& y, const float32& d)
+{
+	// 视差可为任意值, 先判断同名点是否在右图中
+	const float32 xr = x - d;
+	if (xr < 0.0f || xr >= static_cast<float32>(width_)) {
+		return census_left_->NumBits() * scale_;
+	}
+	return scale_ * Hamming<false>(census_left_->Row(y)[x], census_right_->Row(y), packed_right_->Row(y), xr,
+								   packed_right_->HaloX(), census_left_->NumBits(), is_interpolate_);
+}
+
+// 聚合实现须内联到各入口函数中, 硬件popcount才能按入口函数的指令集展开
+template <bool kHwPopcnt>
+PMS_FORCE_INLINE float32 CostComputerCensus::ComputeAImpl(const sint32& x, const sint32& y, const DisparityPlane& param,
+														  const float32& upper_bound) const
+{
+	// 以p点为中心, 聚合区间为[-pat, pat]
+	const auto pat = patch_size_ / 2;
+	const sint32 halo = packed_right_->HaloX();
+	const sint32 num_bits = census_left_->NumBits();
+	const bool interpolate = is_interpolate_;
+
+	// 获取p点颜色值, 缓存权值块及行序
+	const PPixel& pix_p = packed_left_->Row(y)[x];
+	const uint8* weights = weight_cache_ ? weight_cache_->GetWeights(x, y) : nullptr;
+	const uint16* order = GetRowOrder(x, y);
+
+	// 加权汉明距离之和, 最后乘以scale_
+	float32 cost = 0.0f;
+	sint32 num_punish = 0;
+	for (sint32 k = 0; k < patch_size_; k++) {
+		const sint32 i = order ? order[k] : k;
+		const sint32 r = i - pat;
+		const sint32 yr = y + r;
+		// 外扩边界覆盖窗口半径, 邻域行总是可读
+		const PPixel* row_l = packed_left_->Row(yr);
+		const PPixel* row_r = packed_right_->Row(yr);
+		const uint64* census_l = census_left_->Row(yr);
+		const uint64* census_r = census_right_->Row(yr);
+		const uint8* wrow = weights ? weights + i * patch_size_ + pat : nullptr;
+
+		// 本行参与聚合的列, 未设置采样模式时为[-pat, pat]
+		const sint32* cols = sample_pattern_ ? sample_pattern_->RowCols(i) : nullptr;
+		const sint32 n = sample_pattern_ ? sample_pattern_->RowCount(i) : patch_size_;
+		for (sint32 j = 0; j < n; j++) {
+			const sint32 c = cols ? cols[j] : j - pat;
+			const sint32 xc = x + c;
+			const PPixel& pix_q = row_l[xc];
+			// 邻域像素不在图像中
+			if (!pix_q.valid) {
+				continue;
+			}
+			// 根据视差平面方程计算同名点的视差值, 截断溢出惩罚
+			const float32 d = param.to_disparity(xc, yr);
+			if (d < min_disp_ || d > max_disp_) {
+				num_punish++;
+				continue;
+			}
+			const float32 w = wrow ? wrow[c] * PMSWeightCache::WEIGHT_SCALE :
+				weight_lut_[abs(pix_p.b - pix_q.b) + abs(pix_p.g - pix_q.g) + abs(pix_p.r - pix_q.r)];
+			cost += w * Hamming<kHwPopcnt>(census_l[xc], census_r, row_r, xc - d, halo, num_bits, interpolate);
+		}
+
+		// 部分和已不小于上界, 提前终止
+		if (cost * scale_ + num_punish * COST_PUNISH >= upper_bound) {
+			break;
+		}
+	}
+	return cost * scale_ + num_punish * COST_PUNISH;
+}
+
+float32 CostComputerCensus::ComputeAScalar(const sint32& x, const sint32& y, const DisparityPlane& param,
+										   const float32& upper_bound) const
+{
+	return ComputeAImpl<false>(x, y, param, upper_bound);
+}
+
+PMS_TARGET_POPCNT float32 CostComputerCensus::ComputeAPopcnt(const sint32& x, const sint32& y, const DisparityPlane& param,
+															 const float32& upper_bound) const
+{
+	return ComputeAImpl<true>(x, y, param, upper_bound);
+}
+
+template <bool kHwPopcnt>
+PMS_FORCE_INLINE void CostComputerCensus::ComputeABatchImpl(const sint32& x, const sint32& y, const DisparityPlane* params,
+															const sint32& num, float32* costs,
+															const float32& upper_bound) const
+{
+	const auto pat = patch_size_ / 2;
+	const sint32 halo = packed_right_->HaloX();
+	const sint32 num_bits = census_left_->NumBits();
+	const bool interpolate = is_interpolate_;
+
+	const PPixel& pix_p = packed_left_->Row(y)[x];
+	const uint8* weights = weight_cache_ ? weight_cache_->GetWeights(x, y) : nullptr;
+	const uint16* order = GetRowOrder(x, y);
+
+	// 各候选的加权汉明距离之和及惩罚个数
+	float32 cost[MAX_BATCH];
+	sint32 num_punish[MAX_BATCH];
+	bool is_live[MAX_BATCH];
+	for (sint32 h = 0; h < num; h++) {
+		cost[h] = 0.0f;
+		num_punish[h] = 0;
+		is_live[h] = true;
+	}
+	sint32 num_live = num;
+
+	for (sint32 k = 0; k < patch_size_ && num_live > 0; k++) {
+		const sint32 i = order ? order[k] : k;
+		const sint32 r = i - pat;
+		const sint32 yr = y + r;
+		const PPixel* row_l = packed_left_->Row(yr);
+		const PPixel* row_r = packed_right_->Row(yr);
+		const uint64* census_l = census_left_->Row(yr);
+		const uint64* census_r = census_right_->Row(yr);
+		const uint8* wrow = weights ? weights + i * patch_size_ + pat : nullptr;
+
+		const sint32* cols = sample_pattern_ ? sample_pattern_->RowCols(i) : nullptr;
+		const sint32 n = sample_pattern_ ? sample_pattern_->RowCount(i) : patch_size_;
+		for (sint32 j = 0; j < n; j++) {
+			const sint32 c = cols ? cols[j] : j - pat;
+			const sint32 xc = x + c;
+			const PPixel& pix_q = row_l[xc];
+			if (!pix_q.valid) {
+				continue;
+			}
+			// 各候选共用的权值及census串
+			const float32 w = wrow ? wrow[c] * PMSWeightCache::WEIGHT_SCALE :
+				weight_lut_[abs(pix_p.b - pix_q.b) + abs(pix_p.g - pix_q.g) + abs(pix_p.r - pix_q.r)];
+			const uint64 census_q = census_l[xc];
+			for (sint32 h = 0; h < num; h++) {
+				if (!is_live[h]) {
+					continue;
+				}
+				const float32 d = params[h].to_disparity(xc, yr);
+				if (d < min_disp_ || d > max_disp_) {
+					num_punish[h]++;
+					continue;
+				}
+				cost[h] += w * Hamming<kHwPopcnt>(census_q, census_r, row_r, xc - d, halo, num_bits, interpolate);
+			}
+		}
+
+		// 部分和已不小于上界的候选提前终止
+		for (sint32 h = 0; h < num; h++) {
+			if (is_live[h]) {
+				costs[h] = cost[h] * scale_ + num_punish[h] * COST_PUNISH;
+				if (costs[h] >= upper_bound) {
+					is_live[h] = false;
+					num_live--;
+				}
+			}
+		}
+	}
+	for (sint32 h = 0; h < num; h++) {
+		if (is_live[h]) {
+			costs[h] = cost[h] * scale_ + num_punish[h] * COST_PUNISH;
+		}
+	}
+}
+
+void CostComputerCensus::ComputeABatchScalar(const sint32& x, const sint32& y, const DisparityPlane* params,
+											 const sint32& num, float32* costs, const float32& upper_bound) const
+{
+	ComputeABatchImpl<false>(x, y, params, num, costs, upper_bound);
+}
+
+PMS_TARGET_POPCNT void CostComputerCensus::ComputeABatchPopcnt(const sint32& x, const sint32& y, const DisparityPlane* params,
+															   const sint32& num, float32* costs,
+															   const float32& upper_bound) const
+{
+	ComputeABatchImpl<true>(x, y, params, num, costs, upper_bound);
+}
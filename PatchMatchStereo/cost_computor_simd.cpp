@@ -0,0 +1,901 @@
+/* -*-c++-*- PatchMatchStereo - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+*			  https://github.com/ethan-li-coding
+* Describe	: implement of simd kernels of cost computer
+*/
+
+#include "stdafx.h"
+#include "cost_computor.hpp"
+#include "pms_util.h"
+
+#ifdef PMS_SIMD_X86
+#include <immintrin.h>
+#endif
+
+#ifdef PMS_SIMD_X86
+namespace
+{
+	// 统计掩码中置位的个数
+	inline sint32 PopCount(uint32 v)
+	{
+		sint32 n = 0;
+		while (v) {
+			v &= v - 1;
+			n++;
+		}
+		return n;
+	}
+
+	/**
+	 * @brief 8路单精度快速e^x, 与fast_exp的逼近方式相同
+	 * @param x		指数
+	 * @return __m256	e^x
+	 */
+	PMS_TARGET_AVX2 inline __m256 FastExpAVX2(__m256 x)
+	{
+		x = _mm256_fmadd_ps(x, _mm256_set1_ps(1.0f / 1024), _mm256_set1_ps(1.0f));
+		x = _mm256_mul_ps(x, x); x = _mm256_mul_ps(x, x); x = _mm256_mul_ps(x, x); x = _mm256_mul_ps(x, x);
+		x = _mm256_mul_ps(x, x); x = _mm256_mul_ps(x, x); x = _mm256_mul_ps(x, x); x = _mm256_mul_ps(x, x);
+		x = _mm256_mul_ps(x, x); x = _mm256_mul_ps(x, x);
+		return x;
+	}
+
+	/**
+	 * @brief 按列号收集8个打包像素的颜色和梯度, 两者位于同一8字节记录中
+	 * @param row		打包图像行指针
+	 * @param xs		列号
+	 * @param mask		有效通道
+	 * @param col		输出, 颜色(低3字节)及有效标记(最高字节)
+	 * @param grad		输出, 梯度
+	 */
+	PMS_TARGET_AVX2 inline void GatherPixelAVX2(const PPixel* row, __m256i xs, __m256i mask, __m256i& col, __m256i& grad)
+	{
+		const int* base = reinterpret_cast<const int*>(row);
+		col = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), base, xs, mask, 8);
+		grad = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), base + 1, xs, mask, 8);
+	}
+
+	/**
+	 * @brief 读取连续8个打包像素, 拆分为颜色和梯度
+	 * @param pixels	首个像素的指针
+	 * @param col		输出, 颜色及有效标记
+	 * @param grad		输出, 梯度
+	 */
+	PMS_TARGET_AVX2 inline void LoadPixelAVX2(const PPixel* pixels, __m256i& col, __m256i& grad)
+	{
+		const __m256i idx = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+		const __m256i lo = _mm256_permutevar8x32_epi32(
+			_mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels)), idx);
+		const __m256i hi = _mm256_permutevar8x32_epi32(
+			_mm256_loadu_si256(reinterpret_cast<const __m256i*>(pixels + 4)), idx);
+		col = _mm256_permute2x128_si256(lo, hi, 0x20);
+		grad = _mm256_permute2x128_si256(lo, hi, 0x31);
+	}
+
+	// 打包颜色中的有效标记, 有效为全1
+	PMS_TARGET_AVX2 inline __m256i ValidAVX2(__m256i col)
+	{
+		return _mm256_cmpgt_epi32(_mm256_srli_epi32(col, 24), _mm256_setzero_si256());
+	}
+
+	// 取出打包颜色的第0/1/2字节
+	PMS_TARGET_AVX2 inline __m256 Channel0AVX2(__m256i v)
+	{
+		return _mm256_cvtepi32_ps(_mm256_and_si256(v, _mm256_set1_epi32(0xff)));
+	}
+	PMS_TARGET_AVX2 inline __m256 Channel1AVX2(__m256i v)
+	{
+		return _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(v, 8), _mm256_set1_epi32(0xff)));
+	}
+	PMS_TARGET_AVX2 inline __m256 Channel2AVX2(__m256i v)
+	{
+		return _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(v, 16), _mm256_set1_epi32(0xff)));
+	}
+
+	// 取出打包梯度(PGradient)的x/y分量
+	PMS_TARGET_AVX2 inline __m256 GradXAVX2(__m256i v)
+	{
+		return _mm256_cvtepi32_ps(_mm256_srai_epi32(_mm256_slli_epi32(v, 16), 16));
+	}
+	PMS_TARGET_AVX2 inline __m256 GradYAVX2(__m256i v)
+	{
+		return _mm256_cvtepi32_ps(_mm256_srai_epi32(v, 16));
+	}
+
+	PMS_TARGET_AVX2 inline __m256 AbsAVX2(__m256 v)
+	{
+		return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), v);
+	}
+
+	// 8路单精度水平求和
+	PMS_TARGET_AVX2 inline float32 HSumAVX2(__m256 v)
+	{
+		__m128 v_sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+		v_sum = _mm_add_ps(v_sum, _mm_movehl_ps(v_sum, v_sum));
+		v_sum = _mm_add_ss(v_sum, _mm_shuffle_ps(v_sum, v_sum, 1));
+		return _mm_cvtss_f32(v_sum);
+	}
+
+	// 差值向零取整后取绝对值, 与标量实现中整型abs的结果一致
+	PMS_TARGET_AVX2 inline __m256 AbsTruncAVX2(__m256 v)
+	{
+		return AbsAVX2(_mm256_round_ps(v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC));
+	}
+
+	/**
+	 * @brief 16路单精度快速e^x, 与fast_exp的逼近方式相同
+	 * @param x		指数
+	 * @return __m512	e^x
+	 */
+	PMS_TARGET_AVX512 inline __m512 FastExpAVX512(__m512 x)
+	{
+		x = _mm512_fmadd_ps(x, _mm512_set1_ps(1.0f / 1024), _mm512_set1_ps(1.0f));
+		x = _mm512_mul_ps(x, x); x = _mm512_mul_ps(x, x); x = _mm512_mul_ps(x, x); x = _mm512_mul_ps(x, x);
+		x = _mm512_mul_ps(x, x); x = _mm512_mul_ps(x, x); x = _mm512_mul_ps(x, x); x = _mm512_mul_ps(x, x);
+		x = _mm512_mul_ps(x, x); x = _mm512_mul_ps(x, x);
+		return x;
+	}
+
+	// 同GatherPixelAVX2
+	PMS_TARGET_AVX512 inline void GatherPixelAVX512(const PPixel* row, __m512i xs, __mmask16 mask,
+													__m512i& col, __m512i& grad)
+	{
+		const int* base = reinterpret_cast<const int*>(row);
+		col = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), mask, xs, base, 8);
+		grad = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), mask, xs, base + 1, 8);
+	}
+
+	// 同LoadPixelAVX2, 读取连续16个打包像素
+	PMS_TARGET_AVX512 inline void LoadPixelAVX512(const PPixel* pixels, __m512i& col, __m512i& grad)
+	{
+		const __m512i lo = _mm512_loadu_si512(pixels);
+		const __m512i hi = _mm512_loadu_si512(pixels + 8);
+		col = _mm512_permutex2var_epi32(lo,
+			_mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 16, 18, 20, 22, 24, 26, 28, 30), hi);
+		grad = _mm512_permutex2var_epi32(lo,
+			_mm512_setr_epi32(1, 3, 5, 7, 9, 11, 13, 15, 17, 19, 21, 23, 25, 27, 29, 31), hi);
+	}
+
+	// 打包颜色中的有效标记
+	PMS_TARGET_AVX512 inline __mmask16 ValidAVX512(__m512i col)
+	{
+		return _mm512_test_epi32_mask(col, _mm512_set1_epi32(static_cast<sint32>(0xff000000)));
+	}
+
+	PMS_TARGET_AVX512 inline __m512 Channel0AVX512(__m512i v)
+	{
+		return _mm512_cvtepi32_ps(_mm512_and_si512(v, _mm512_set1_epi32(0xff)));
+	}
+	PMS_TARGET_AVX512 inline __m512 Channel1AVX512(__m512i v)
+	{
+		return _mm512_cvtepi32_ps(_mm512_and_si512(_mm512_srli_epi32(v, 8), _mm512_set1_epi32(0xff)));
+	}
+	PMS_TARGET_AVX512 inline __m512 Channel2AVX512(__m512i v)
+	{
+		return _mm512_cvtepi32_ps(_mm512_and_si512(_mm512_srli_epi32(v, 16), _mm512_set1_epi32(0xff)));
+	}
+	PMS_TARGET_AVX512 inline __m512 GradXAVX512(__m512i v)
+	{
+		return _mm512_cvtepi32_ps(_mm512_srai_epi32(_mm512_slli_epi32(v, 16), 16));
+	}
+	PMS_TARGET_AVX512 inline __m512 GradYAVX512(__m512i v)
+	{
+		return _mm512_cvtepi32_ps(_mm512_srai_epi32(v, 16));
+	}
+	PMS_TARGET_AVX512 inline __m512 AbsAVX512(__m512 v)
+	{
+		return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(v), _mm512_set1_epi32(0x7fffffff)));
+	}
+	PMS_TARGET_AVX512 inline __m512 AbsTruncAVX512(__m512 v)
+	{
+		return AbsAVX512(_mm512_roundscale_ps(v, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC));
+	}
+}
+
+PMS_TARGET_AVX2
+float32 CostComputerPMS::ComputeAAVX2(const sint32& x, const sint32& y, const DisparityPlane& param,
+									  const float32& upper_bound) const
+{
+	// 以p点为中心, 聚合区间为[-pat, pat], 列方向裁剪到图像内, 免去逐像素的越界判断
+	const auto pat = patch_size_ / 2;
+	const sint32 c_lo = std::max(-pat, -x);
+	const sint32 c_hi = std::min(pat, width_ - 1 - x);
+
+	// 获取p点颜色值
+	const PPixel& pix_p = packed_left_->Row(y)[x];
+	// 获取p点的缓存权值块及行序
+	const uint8* weights = weight_cache_ ? weight_cache_->GetWeights(x, y) : nullptr;
+	const uint16* order = GetRowOrder(x, y);
+	const bool bounded = upper_bound < Invalid_Float;
+	const __m256 v_pb = _mm256_set1_ps(pix_p.b);
+	const __m256 v_pg = _mm256_set1_ps(pix_p.g);
+	const __m256 v_pr = _mm256_set1_ps(pix_p.r);
+
+	const __m256i v_iota = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256 v_iota_f = _mm256_cvtepi32_ps(v_iota);
+	const __m256 v_a = _mm256_set1_ps(param.param.x);
+	const __m256 v_min = _mm256_set1_ps(static_cast<float32>(min_disp_));
+	const __m256 v_max = _mm256_set1_ps(static_cast<float32>(max_disp_));
+	const __m256i v_halo = _mm256_set1_epi32(packed_right_->HaloX());
+	const __m256 v_halo_f = _mm256_set1_ps(static_cast<float32>(packed_right_->HaloX()));
+	const __m256i v_one = _mm256_set1_epi32(1);
+	const __m256 v_one_f = _mm256_set1_ps(1.0f);
+	const __m256 v_ngamma = _mm256_set1_ps(-1.0f / gamma_);
+	const __m256 v_alpha = _mm256_set1_ps(alpha_);
+	const __m256 v_alpha_c = _mm256_set1_ps(1 - alpha_);
+	const __m256 v_tau_col = _mm256_set1_ps(tau_col_);
+	const __m256 v_tau_grad = _mm256_set1_ps(tau_grad_);
+	const __m256 v_trunc = _mm256_set1_ps((1 - alpha_) * tau_col_ + alpha_ * tau_grad_);
+	const __m256 v_wscale = _mm256_set1_ps(PMSWeightCache::WEIGHT_SCALE);
+
+	__m256 v_cost = _mm256_setzero_ps();
+	sint32 num_punish = 0;
+
+	for (sint32 k = 0; k < patch_size_; k++) {
+		const sint32 i = order ? order[k] : k;
+		const sint32 r = i - pat;
+		const sint32 yr = y + r;
+		if (yr < 0 || yr > height_ - 1) {
+			continue;
+		}
+		const PPixel* row_l = packed_left_->Row(yr);
+		const PPixel* row_r = packed_right_->Row(yr);
+		// 本行的缓存权值, 以列偏移c索引
+		const uint8* wrow = weights ? weights + i * patch_size_ + pat : nullptr;
+		// 本行参与聚合的列, 未设置采样模式时为[c_lo, c_hi]内的连续列
+		const sint32* cols = sample_pattern_ ? sample_pattern_->RowCols(i) : nullptr;
+		const sint32 n = sample_pattern_ ? sample_pattern_->RowCount(i) : c_hi - c_lo + 1;
+
+		// 行首的视差, 沿行方向按平面参数a递增
+		const float32 d_row = param.to_disparity(x + c_lo, yr);
+		float32 d_base = d_row;
+		const float32 d_step = 8 * param.param.x;
+
+		for (sint32 j = 0; j < n; j += 8, d_base += d_step) {
+			__m256i v_c, v_valid, v_xc;
+			__m256 v_d;
+			if (cols) {
+				// 采样列, 裁剪到图像内
+				v_c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cols + j));
+				v_valid = _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_set1_epi32(n - j), v_iota),
+					_mm256_and_si256(_mm256_cmpgt_epi32(v_c, _mm256_set1_epi32(c_lo - 1)),
+									 _mm256_cmpgt_epi32(_mm256_set1_epi32(c_hi + 1), v_c)));
+				v_d = _mm256_fmadd_ps(v_a, _mm256_cvtepi32_ps(_mm256_sub_epi32(v_c, _mm256_set1_epi32(c_lo))),
+									  _mm256_set1_ps(d_row));
+			}
+			else {
+				v_c = _mm256_add_epi32(_mm256_set1_epi32(c_lo + j), v_iota);
+				v_valid = _mm256_cmpgt_epi32(_mm256_set1_epi32(n - j), v_iota);
+				v_d = _mm256_fmadd_ps(v_a, v_iota_f, _mm256_set1_ps(d_base));
+			}
+			v_xc = _mm256_add_epi32(_mm256_set1_epi32(x), v_c);
+
+			// 截断溢出惩罚
+			const __m256 m_in = _mm256_and_ps(_mm256_cmp_ps(v_d, v_min, _CMP_GE_OQ),
+											  _mm256_cmp_ps(v_d, v_max, _CMP_LE_OQ));
+			const __m256 m_valid = _mm256_castsi256_ps(v_valid);
+			num_punish += PopCount(_mm256_movemask_ps(_mm256_andnot_ps(m_in, m_valid)));
+			const __m256 m_ok = _mm256_and_ps(m_in, m_valid);
+			if (_mm256_movemask_ps(m_ok) == 0) {
+				continue;
+			}
+
+			// 邻域像素q的颜色和梯度, 连续列整块读取(外扩边界保证可读)
+			__m256i v_col_q, v_grad_q;
+			if (cols) {
+				GatherPixelAVX2(row_l, v_xc, v_valid, v_col_q, v_grad_q);
+			}
+			else {
+				LoadPixelAVX2(row_l + x + c_lo + j, v_col_q, v_grad_q);
+			}
+
+			// q与p的颜色差, 得到权值
+			const __m256 q0 = Channel0AVX2(v_col_q);
+			const __m256 q1 = Channel1AVX2(v_col_q);
+			const __m256 q2 = Channel2AVX2(v_col_q);
+			__m256 v_w;
+			if (wrow) {
+				// 缓存的量化权值, 连续列一次读取8个, 采样列按列偏移收集
+				const __m256i v_wq = cols ?
+					_mm256_and_si256(_mm256_mask_i32gather_epi32(_mm256_setzero_si256(),
+						reinterpret_cast<const int*>(wrow), v_c, _mm256_castps_si256(m_ok), 1), _mm256_set1_epi32(0xff)) :
+					_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(wrow + c_lo + j)));
+				v_w = _mm256_mul_ps(_mm256_cvtepi32_ps(v_wq), v_wscale);
+			}
+			else {
+				const __m256 v_dcw = _mm256_add_ps(_mm256_add_ps(AbsAVX2(_mm256_sub_ps(v_pb, q0)),
+					AbsAVX2(_mm256_sub_ps(v_pg, q1))), AbsAVX2(_mm256_sub_ps(v_pr, q2)));
+				v_w = FastExpAVX2(_mm256_mul_ps(v_dcw, v_ngamma));
+			}
+
+			// q点梯度
+			const __m256 gqx = GradXAVX2(v_grad_q);
+			const __m256 gqy = GradYAVX2(v_grad_q);
+
+			// 同名点列号xr = xc - d, 加外扩宽度后非负, 截断即向下取整
+			const __m256 v_xr = _mm256_sub_ps(_mm256_cvtepi32_ps(v_xc), v_d);
+			const __m256i v_x1 = _mm256_sub_epi32(_mm256_cvttps_epi32(_mm256_add_ps(v_xr, v_halo_f)), v_halo);
+			const __m256 v_ofs = _mm256_sub_ps(v_xr, _mm256_cvtepi32_ps(v_x1));
+			const __m256 v_ofs_c = _mm256_sub_ps(v_one_f, v_ofs);
+
+			// 两个内插抽头的颜色和梯度, 同名点落在外扩边界(不在右图中)的使用截断参数
+			// 外扩边界复制了最后一列, x2无需裁剪
+			__m256i v_c1, v_g1, v_c2, v_g2;
+			GatherPixelAVX2(row_r, v_x1, _mm256_castps_si256(m_ok), v_c1, v_g1);
+			const __m256 m_r = _mm256_and_ps(m_ok, _mm256_castsi256_ps(ValidAVX2(v_c1)));
+			GatherPixelAVX2(row_r, _mm256_add_epi32(v_x1, v_one), _mm256_castps_si256(m_r), v_c2, v_g2);
+
+			// 右图颜色线性内插
+			const __m256 r0 = _mm256_add_ps(_mm256_mul_ps(v_ofs_c, Channel0AVX2(v_c1)), _mm256_mul_ps(v_ofs, Channel0AVX2(v_c2)));
+			const __m256 r1 = _mm256_add_ps(_mm256_mul_ps(v_ofs_c, Channel1AVX2(v_c1)), _mm256_mul_ps(v_ofs, Channel1AVX2(v_c2)));
+			const __m256 r2 = _mm256_add_ps(_mm256_mul_ps(v_ofs_c, Channel2AVX2(v_c1)), _mm256_mul_ps(v_ofs, Channel2AVX2(v_c2)));
+			const __m256 v_dc = _mm256_min_ps(_mm256_add_ps(_mm256_add_ps(AbsTruncAVX2(_mm256_sub_ps(q0, r0)),
+				AbsTruncAVX2(_mm256_sub_ps(q1, r1))), AbsTruncAVX2(_mm256_sub_ps(q2, r2))), v_tau_col);
+
+			// 右图梯度线性内插
+			const __m256 grx = _mm256_add_ps(_mm256_mul_ps(v_ofs_c, GradXAVX2(v_g1)), _mm256_mul_ps(v_ofs, GradXAVX2(v_g2)));
+			const __m256 gry = _mm256_add_ps(_mm256_mul_ps(v_ofs_c, GradYAVX2(v_g1)), _mm256_mul_ps(v_ofs, GradYAVX2(v_g2)));
+			const __m256 v_dg = _mm256_min_ps(_mm256_add_ps(AbsTruncAVX2(_mm256_sub_ps(gqx, grx)),
+				AbsTruncAVX2(_mm256_sub_ps(gqy, gry))), v_tau_grad);
+
+			// 同名点对的不相似代价值, 加权累加
+			const __m256 v_pc = _mm256_blendv_ps(v_trunc,
+				_mm256_add_ps(_mm256_mul_ps(v_alpha_c, v_dc), _mm256_mul_ps(v_alpha, v_dg)), m_r);
+			v_cost = _mm256_add_ps(v_cost, _mm256_and_ps(m_ok, _mm256_mul_ps(v_w, v_pc)));
+		}
+
+		// 部分和已不小于上界, 提前终止
+		if (bounded && HSumAVX2(v_cost) + num_punish * COST_PUNISH >= upper_bound) {
+			break;
+		}
+	}
+
+	return HSumAVX2(v_cost) + num_punish * COST_PUNISH;
+}
+
+PMS_TARGET_AVX2
+void CostComputerPMS::ComputeABatchAVX2(const sint32& x, const sint32& y, const DisparityPlane* params,
+										const sint32& num, float32* costs, const float32& upper_bound) const
+{
+	// 以p点为中心, 聚合区间为[-pat, pat], 列方向裁剪到图像内
+	const auto pat = patch_size_ / 2;
+	const sint32 c_lo = std::max(-pat, -x);
+	const sint32 c_hi = std::min(pat, width_ - 1 - x);
+
+	const PPixel& pix_p = packed_left_->Row(y)[x];
+	// 获取p点的缓存权值块及行序
+	const uint8* weights = weight_cache_ ? weight_cache_->GetWeights(x, y) : nullptr;
+	const uint16* order = GetRowOrder(x, y);
+	const bool bounded = upper_bound < Invalid_Float;
+	const __m256 v_pb = _mm256_set1_ps(pix_p.b);
+	const __m256 v_pg = _mm256_set1_ps(pix_p.g);
+	const __m256 v_pr = _mm256_set1_ps(pix_p.r);
+
+	const __m256i v_iota = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+	const __m256 v_iota_f = _mm256_cvtepi32_ps(v_iota);
+	const __m256 v_min = _mm256_set1_ps(static_cast<float32>(min_disp_));
+	const __m256 v_max = _mm256_set1_ps(static_cast<float32>(max_disp_));
+	const __m256i v_halo = _mm256_set1_epi32(packed_right_->HaloX());
+	const __m256 v_halo_f = _mm256_set1_ps(static_cast<float32>(packed_right_->HaloX()));
+	const __m256i v_one = _mm256_set1_epi32(1);
+	const __m256 v_one_f = _mm256_set1_ps(1.0f);
+	const __m256 v_ngamma = _mm256_set1_ps(-1.0f / gamma_);
+	const __m256 v_alpha = _mm256_set1_ps(alpha_);
+	const __m256 v_alpha_c = _mm256_set1_ps(1 - alpha_);
+	const __m256 v_tau_col = _mm256_set1_ps(tau_col_);
+	const __m256 v_tau_grad = _mm256_set1_ps(tau_grad_);
+	const __m256 v_trunc = _mm256_set1_ps((1 - alpha_) * tau_col_ + alpha_ * tau_grad_);
+	const __m256 v_wscale = _mm256_set1_ps(PMSWeightCache::WEIGHT_SCALE);
+
+	// 各候选的累加值, 部分和越过上界的候选不再累加
+	__m256 v_cost[MAX_BATCH];
+	sint32 num_punish[MAX_BATCH];
+	bool is_live[MAX_BATCH];
+	for (sint32 h = 0; h < num; h++) {
+		v_cost[h] = _mm256_setzero_ps();
+		num_punish[h] = 0;
+		is_live[h] = true;
+	}
+	sint32 num_live = num;
+
+	for (sint32 k = 0; k < patch_size_ && num_live > 0; k++) {
+		const sint32 i = order ? order[k] : k;
+		const sint32 r = i - pat;
+		const sint32 yr = y + r;
+		if (yr < 0 || yr > height_ - 1) {
+			continue;
+		}
+		const PPixel* row_l = packed_left_->Row(yr);
+		const PPixel* row_r = packed_right_->Row(yr);
+		// 本行的缓存权值, 以列偏移c索引
+		const uint8* wrow = weights ? weights + i * patch_size_ + pat : nullptr;
+		// 本行参与聚合的列, 未设置采样模式时为[c_lo, c_hi]内的连续列
+		const sint32* cols = sample_pattern_ ? sample_pattern_->RowCols(i) : nullptr;
+		const sint32 n = sample_pattern_ ? sample_pattern_->RowCount(i) : c_hi - c_lo + 1;
+
+		// 各候选的行首视差
+		float32 d_row[MAX_BATCH], d_base[MAX_BATCH];
+		for (sint32 h = 0; h < num; h++) {
+			d_row[h] = params[h].to_disparity(x + c_lo, yr);
+			d_base[h] = d_row[h];
+		}
+
+		for (sint32 j = 0; j < n; j += 8) {
+			__m256i v_c, v_valid;
+			if (cols) {
+				// 采样列, 裁剪到图像内
+				v_c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(cols + j));
+				v_valid = _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_set1_epi32(n - j), v_iota),
+					_mm256_and_si256(_mm256_cmpgt_epi32(v_c, _mm256_set1_epi32(c_lo - 1)),
+									 _mm256_cmpgt_epi32(_mm256_set1_epi32(c_hi + 1), v_c)));
+			}
+			else {
+				v_c = _mm256_add_epi32(_mm256_set1_epi32(c_lo + j), v_iota);
+				v_valid = _mm256_cmpgt_epi32(_mm256_set1_epi32(n - j), v_iota);
+			}
+			const __m256i v_xc = _mm256_add_epi32(_mm256_set1_epi32(x), v_c);
+			const __m256 v_xc_f = _mm256_cvtepi32_ps(v_xc);
+			const __m256 m_valid = _mm256_castsi256_ps(v_valid);
+
+			// 以下为各候选共用的部分: 邻域像素q的颜色、梯度及权值
+			__m256i v_col_q, v_grad_q;
+			if (cols) {
+				GatherPixelAVX2(row_l, v_xc, v_valid, v_col_q, v_grad_q);
+			}
+			else {
+				LoadPixelAVX2(row_l + x + c_lo + j, v_col_q, v_grad_q);
+			}
+			const __m256 q0 = Channel0AVX2(v_col_q);
+			const __m256 q1 = Channel1AVX2(v_col_q);
+			const __m256 q2 = Channel2AVX2(v_col_q);
+			__m256 v_w;
+			if (wrow) {
+				const __m256i v_wq = cols ?
+					_mm256_and_si256(_mm256_mask_i32gather_epi32(_mm256_setzero_si256(),
+						reinterpret_cast<const int*>(wrow), v_c, v_valid, 1), _mm256_set1_epi32(0xff)) :
+					_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(wrow + c_lo + j)));
+				v_w = _mm256_mul_ps(_mm256_cvtepi32_ps(v_wq), v_wscale);
+			}
+			else {
+				const __m256 v_dcw = _mm256_add_ps(_mm256_add_ps(AbsAVX2(_mm256_sub_ps(v_pb, q0)),
+					AbsAVX2(_mm256_sub_ps(v_pg, q1))), AbsAVX2(_mm256_sub_ps(v_pr, q2)));
+				v_w = FastExpAVX2(_mm256_mul_ps(v_dcw, v_ngamma));
+			}
+			const __m256 gqx = GradXAVX2(v_grad_q);
+			const __m256 gqy = GradYAVX2(v_grad_q);
+
+			// 逐个候选计算同名点并累加代价
+			for (sint32 h = 0; h < num; h++) {
+				const float32 a = params[h].param.x;
+				const __m256 v_a = _mm256_set1_ps(a);
+				const __m256 v_d = cols ?
+					_mm256_fmadd_ps(v_a, _mm256_cvtepi32_ps(_mm256_sub_epi32(v_c, _mm256_set1_epi32(c_lo))),
+									_mm256_set1_ps(d_row[h])) :
+					_mm256_fmadd_ps(v_a, v_iota_f, _mm256_set1_ps(d_base[h]));
+				d_base[h] += 8 * a;
+				if (!is_live[h]) {
+					continue;
+				}
+
+				// 截断溢出惩罚
+				const __m256 m_in = _mm256_and_ps(_mm256_cmp_ps(v_d, v_min, _CMP_GE_OQ),
+												  _mm256_cmp_ps(v_d, v_max, _CMP_LE_OQ));
+				num_punish[h] += PopCount(_mm256_movemask_ps(_mm256_andnot_ps(m_in, m_valid)));
+				const __m256 m_ok = _mm256_and_ps(m_in, m_valid);
+				if (_mm256_movemask_ps(m_ok) == 0) {
+					continue;
+				}
+
+				// 同名点列号及两个内插抽头
+				const __m256 v_xr = _mm256_sub_ps(v_xc_f, v_d);
+				const __m256i v_x1 = _mm256_sub_epi32(_mm256_cvttps_epi32(_mm256_add_ps(v_xr, v_halo_f)), v_halo);
+				const __m256 v_ofs = _mm256_sub_ps(v_xr, _mm256_cvtepi32_ps(v_x1));
+				const __m256 v_ofs_c = _mm256_sub_ps(v_one_f, v_ofs);
+				__m256i v_c1, v_g1, v_c2, v_g2;
+				GatherPixelAVX2(row_r, v_x1, _mm256_castps_si256(m_ok), v_c1, v_g1);
+				const __m256 m_r = _mm256_and_ps(m_ok, _mm256_castsi256_ps(ValidAVX2(v_c1)));
+				GatherPixelAVX2(row_r, _mm256_add_epi32(v_x1, v_one), _mm256_castps_si256(m_r), v_c2, v_g2);
+
+				// 右图颜色及梯度线性内插
+				const __m256 r0 = _mm256_add_ps(_mm256_mul_ps(v_ofs_c, Channel0AVX2(v_c1)), _mm256_mul_ps(v_ofs, Channel0AVX2(v_c2)));
+				const __m256 r1 = _mm256_add_ps(_mm256_mul_ps(v_ofs_c, Channel1AVX2(v_c1)), _mm256_mul_ps(v_ofs, Channel1AVX2(v_c2)));
+				const __m256 r2 = _mm256_add_ps(_mm256_mul_ps(v_ofs_c, Channel2AVX2(v_c1)), _mm256_mul_ps(v_ofs, Channel2AVX2(v_c2)));
+				const __m256 v_dc = _mm256_min_ps(_mm256_add_ps(_mm256_add_ps(AbsTruncAVX2(_mm256_sub_ps(q0, r0)),
+					AbsTruncAVX2(_mm256_sub_ps(q1, r1))), AbsTruncAVX2(_mm256_sub_ps(q2, r2))), v_tau_col);
+				const __m256 grx = _mm256_add_ps(_mm256_mul_ps(v_ofs_c, GradXAVX2(v_g1)), _mm256_mul_ps(v_ofs, GradXAVX2(v_g2)));
+				const __m256 gry = _mm256_add_ps(_mm256_mul_ps(v_ofs_c, GradYAVX2(v_g1)), _mm256_mul_ps(v_ofs, GradYAVX2(v_g2)));
+				const __m256 v_dg = _mm256_min_ps(_mm256_add_ps(AbsTruncAVX2(_mm256_sub_ps(gqx, grx)),
+					AbsTruncAVX2(_mm256_sub_ps(gqy, gry))), v_tau_grad);
+
+				// 同名点对的不相似代价值, 加权累加
+				const __m256 v_pc = _mm256_blendv_ps(v_trunc,
+					_mm256_add_ps(_mm256_mul_ps(v_alpha_c, v_dc), _mm256_mul_ps(v_alpha, v_dg)), m_r);
+				v_cost[h] = _mm256_add_ps(v_cost[h], _mm256_and_ps(m_ok, _mm256_mul_ps(v_w, v_pc)));
+			}
+		}
+
+		// 部分和已不小于上界的候选提前终止
+		if (bounded) {
+			for (sint32 h = 0; h < num; h++) {
+				if (is_live[h]) {
+					costs[h] = HSumAVX2(v_cost[h]) + num_punish[h] * COST_PUNISH;
+					if (costs[h] >= upper_bound) {
+						is_live[h] = false;
+						num_live--;
+					}
+				}
+			}
+		}
+	}
+
+	for (sint32 h = 0; h < num; h++) {
+		if (is_live[h]) {
+			costs[h] = HSumAVX2(v_cost[h]) + num_punish[h] * COST_PUNISH;
+		}
+	}
+}
+
+PMS_TARGET_AVX512
+float32 CostComputerPMS::ComputeAAVX512(const sint32& x, const sint32& y, const DisparityPlane& param,
+										const float32& upper_bound) const
+{
+	const auto pat = patch_size_ / 2;
+	const sint32 c_lo = std::max(-pat, -x);
+	const sint32 c_hi = std::min(pat, width_ - 1 - x);
+
+	const PPixel& pix_p = packed_left_->Row(y)[x];
+	// 获取p点的缓存权值块及行序
+	const uint8* weights = weight_cache_ ? weight_cache_->GetWeights(x, y) : nullptr;
+	const uint16* order = GetRowOrder(x, y);
+	const bool bounded = upper_bound < Invalid_Float;
+	const __m512 v_pb = _mm512_set1_ps(pix_p.b);
+	const __m512 v_pg = _mm512_set1_ps(pix_p.g);
+	const __m512 v_pr = _mm512_set1_ps(pix_p.r);
+
+	const __m512i v_iota = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	const __m512 v_iota_f = _mm512_cvtepi32_ps(v_iota);
+	const __m512 v_a = _mm512_set1_ps(param.param.x);
+	const __m512 v_min = _mm512_set1_ps(static_cast<float32>(min_disp_));
+	const __m512 v_max = _mm512_set1_ps(static_cast<float32>(max_disp_));
+	const __m512i v_halo = _mm512_set1_epi32(packed_right_->HaloX());
+	const __m512 v_halo_f = _mm512_set1_ps(static_cast<float32>(packed_right_->HaloX()));
+	const __m512i v_one = _mm512_set1_epi32(1);
+	const __m512 v_one_f = _mm512_set1_ps(1.0f);
+	const __m512 v_ngamma = _mm512_set1_ps(-1.0f / gamma_);
+	const __m512 v_alpha = _mm512_set1_ps(alpha_);
+	const __m512 v_alpha_c = _mm512_set1_ps(1 - alpha_);
+	const __m512 v_tau_col = _mm512_set1_ps(tau_col_);
+	const __m512 v_tau_grad = _mm512_set1_ps(tau_grad_);
+	const __m512 v_trunc = _mm512_set1_ps((1 - alpha_) * tau_col_ + alpha_ * tau_grad_);
+	const __m512 v_wscale = _mm512_set1_ps(PMSWeightCache::WEIGHT_SCALE);
+
+	__m512 v_cost = _mm512_setzero_ps();
+	sint32 num_punish = 0;
+
+	for (sint32 k = 0; k < patch_size_; k++) {
+		const sint32 i = order ? order[k] : k;
+		const sint32 r = i - pat;
+		const sint32 yr = y + r;
+		if (yr < 0 || yr > height_ - 1) {
+			continue;
+		}
+		const PPixel* row_l = packed_left_->Row(yr);
+		const PPixel* row_r = packed_right_->Row(yr);
+		// 本行的缓存权值, 以列偏移c索引
+		const uint8* wrow = weights ? weights + i * patch_size_ + pat : nullptr;
+		// 本行参与聚合的列, 未设置采样模式时为[c_lo, c_hi]内的连续列
+		const sint32* cols = sample_pattern_ ? sample_pattern_->RowCols(i) : nullptr;
+		const sint32 n = sample_pattern_ ? sample_pattern_->RowCount(i) : c_hi - c_lo + 1;
+
+		const float32 d_row = param.to_disparity(x + c_lo, yr);
+		float32 d_base = d_row;
+		const float32 d_step = 16 * param.param.x;
+
+		for (sint32 j = 0; j < n; j += 16, d_base += d_step) {
+			const __mmask16 m_lanes = static_cast<__mmask16>((1u << std::min(16, n - j)) - 1);
+			__m512i v_c;
+			__mmask16 m_valid;
+			__m512 v_d;
+			if (cols) {
+				// 采样列, 裁剪到图像内
+				v_c = _mm512_loadu_si512(cols + j);
+				m_valid = m_lanes & _mm512_cmpge_epi32_mask(v_c, _mm512_set1_epi32(c_lo)) &
+						  _mm512_cmple_epi32_mask(v_c, _mm512_set1_epi32(c_hi));
+				v_d = _mm512_fmadd_ps(v_a, _mm512_cvtepi32_ps(_mm512_sub_epi32(v_c, _mm512_set1_epi32(c_lo))),
+									  _mm512_set1_ps(d_row));
+			}
+			else {
+				v_c = _mm512_add_epi32(_mm512_set1_epi32(c_lo + j), v_iota);
+				m_valid = m_lanes;
+				v_d = _mm512_fmadd_ps(v_a, v_iota_f, _mm512_set1_ps(d_base));
+			}
+			const __m512i v_xc = _mm512_add_epi32(_mm512_set1_epi32(x), v_c);
+
+			// 截断溢出惩罚
+			const __mmask16 m_in = _mm512_cmp_ps_mask(v_d, v_min, _CMP_GE_OQ) & _mm512_cmp_ps_mask(v_d, v_max, _CMP_LE_OQ);
+			num_punish += PopCount(m_valid & ~m_in);
+			const __mmask16 m_ok = m_valid & m_in;
+			if (m_ok == 0) {
+				continue;
+			}
+
+			// 邻域像素q的颜色和梯度, 连续列整块读取
+			__m512i v_col_q, v_grad_q;
+			if (cols) {
+				GatherPixelAVX512(row_l, v_xc, m_valid, v_col_q, v_grad_q);
+			}
+			else {
+				LoadPixelAVX512(row_l + x + c_lo + j, v_col_q, v_grad_q);
+			}
+
+			// q点权值
+			const __m512 q0 = Channel0AVX512(v_col_q);
+			const __m512 q1 = Channel1AVX512(v_col_q);
+			const __m512 q2 = Channel2AVX512(v_col_q);
+			__m512 v_w;
+			if (wrow) {
+				// 缓存的量化权值, 连续列一次读取16个, 采样列按列偏移收集
+				const __m512i v_wq = cols ?
+					_mm512_and_si512(_mm512_mask_i32gather_epi32(_mm512_setzero_si512(), m_ok, v_c, wrow, 1),
+									 _mm512_set1_epi32(0xff)) :
+					_mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(wrow + c_lo + j)));
+				v_w = _mm512_mul_ps(_mm512_cvtepi32_ps(v_wq), v_wscale);
+			}
+			else {
+				const __m512 v_dcw = _mm512_add_ps(_mm512_add_ps(AbsAVX512(_mm512_sub_ps(v_pb, q0)),
+					AbsAVX512(_mm512_sub_ps(v_pg, q1))), AbsAVX512(_mm512_sub_ps(v_pr, q2)));
+				v_w = FastExpAVX512(_mm512_mul_ps(v_dcw, v_ngamma));
+			}
+
+			// q点梯度
+			const __m512 gqx = GradXAVX512(v_grad_q);
+			const __m512 gqy = GradYAVX512(v_grad_q);
+
+			// 同名点列号, 加外扩宽度后截断即向下取整
+			const __m512 v_xr = _mm512_sub_ps(_mm512_cvtepi32_ps(v_xc), v_d);
+			const __m512i v_x1 = _mm512_sub_epi32(_mm512_cvttps_epi32(_mm512_add_ps(v_xr, v_halo_f)), v_halo);
+			const __m512 v_ofs = _mm512_sub_ps(v_xr, _mm512_cvtepi32_ps(v_x1));
+			const __m512 v_ofs_c = _mm512_sub_ps(v_one_f, v_ofs);
+
+			// 两个内插抽头, 同名点落在外扩边界的使用截断参数
+			__m512i v_c1, v_g1, v_c2, v_g2;
+			GatherPixelAVX512(row_r, v_x1, m_ok, v_c1, v_g1);
+			const __mmask16 m_r = m_ok & ValidAVX512(v_c1);
+			GatherPixelAVX512(row_r, _mm512_add_epi32(v_x1, v_one), m_r, v_c2, v_g2);
+
+			// 右图颜色线性内插
+			const __m512 r0 = _mm512_add_ps(_mm512_mul_ps(v_ofs_c, Channel0AVX512(v_c1)), _mm512_mul_ps(v_ofs, Channel0AVX512(v_c2)));
+			const __m512 r1 = _mm512_add_ps(_mm512_mul_ps(v_ofs_c, Channel1AVX512(v_c1)), _mm512_mul_ps(v_ofs, Channel1AVX512(v_c2)));
+			const __m512 r2 = _mm512_add_ps(_mm512_mul_ps(v_ofs_c, Channel2AVX512(v_c1)), _mm512_mul_ps(v_ofs, Channel2AVX512(v_c2)));
+			const __m512 v_dc = _mm512_min_ps(_mm512_add_ps(_mm512_add_ps(AbsTruncAVX512(_mm512_sub_ps(q0, r0)),
+				AbsTruncAVX512(_mm512_sub_ps(q1, r1))), AbsTruncAVX512(_mm512_sub_ps(q2, r2))), v_tau_col);
+
+			// 右图梯度线性内插
+			const __m512 grx = _mm512_add_ps(_mm512_mul_ps(v_ofs_c, GradXAVX512(v_g1)), _mm512_mul_ps(v_ofs, GradXAVX512(v_g2)));
+			const __m512 gry = _mm512_add_ps(_mm512_mul_ps(v_ofs_c, GradYAVX512(v_g1)), _mm512_mul_ps(v_ofs, GradYAVX512(v_g2)));
+			const __m512 v_dg = _mm512_min_ps(_mm512_add_ps(AbsTruncAVX512(_mm512_sub_ps(gqx, grx)),
+				AbsTruncAVX512(_mm512_sub_ps(gqy, gry))), v_tau_grad);
+
+			// 同名点对的不相似代价值, 加权累加
+			const __m512 v_pc = _mm512_mask_blend_ps(m_r, v_trunc,
+				_mm512_add_ps(_mm512_mul_ps(v_alpha_c, v_dc), _mm512_mul_ps(v_alpha, v_dg)));
+			v_cost = _mm512_mask_add_ps(v_cost, m_ok, v_cost, _mm512_mul_ps(v_w, v_pc));
+		}
+
+		// 部分和已不小于上界, 提前终止
+		if (bounded && _mm512_reduce_add_ps(v_cost) + num_punish * COST_PUNISH >= upper_bound) {
+			break;
+		}
+	}
+
+	return _mm512_reduce_add_ps(v_cost) + num_punish * COST_PUNISH;
+}
+
+PMS_TARGET_AVX512
+void CostComputerPMS::ComputeABatchAVX512(const sint32& x, const sint32& y, const DisparityPlane* params,
+										  const sint32& num, float32* costs, const float32& upper_bound) const
+{
+	const auto pat = patch_size_ / 2;
+	const sint32 c_lo = std::max(-pat, -x);
+	const sint32 c_hi = std::min(pat, width_ - 1 - x);
+
+	const PPixel& pix_p = packed_left_->Row(y)[x];
+	// 获取p点的缓存权值块及行序
+	const uint8* weights = weight_cache_ ? weight_cache_->GetWeights(x, y) : nullptr;
+	const uint16* order = GetRowOrder(x, y);
+	const bool bounded = upper_bound < Invalid_Float;
+	const __m512 v_pb = _mm512_set1_ps(pix_p.b);
+	const __m512 v_pg = _mm512_set1_ps(pix_p.g);
+	const __m512 v_pr = _mm512_set1_ps(pix_p.r);
+
+	const __m512i v_iota = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	const __m512 v_iota_f = _mm512_cvtepi32_ps(v_iota);
+	const __m512 v_min = _mm512_set1_ps(static_cast<float32>(min_disp_));
+	const __m512 v_max = _mm512_set1_ps(static_cast<float32>(max_disp_));
+	const __m512i v_halo = _mm512_set1_epi32(packed_right_->HaloX());
+	const __m512 v_halo_f = _mm512_set1_ps(static_cast<float32>(packed_right_->HaloX()));
+	const __m512i v_one = _mm512_set1_epi32(1);
+	const __m512 v_one_f = _mm512_set1_ps(1.0f);
+	const __m512 v_ngamma = _mm512_set1_ps(-1.0f / gamma_);
+	const __m512 v_alpha = _mm512_set1_ps(alpha_);
+	const __m512 v_alpha_c = _mm512_set1_ps(1 - alpha_);
+	const __m512 v_tau_col = _mm512_set1_ps(tau_col_);
+	const __m512 v_tau_grad = _mm512_set1_ps(tau_grad_);
+	const __m512 v_trunc = _mm512_set1_ps((1 - alpha_) * tau_col_ + alpha_ * tau_grad_);
+	const __m512 v_wscale = _mm512_set1_ps(PMSWeightCache::WEIGHT_SCALE);
+
+	// 各候选的累加值, 部分和越过上界的候选不再累加
+	__m512 v_cost[MAX_BATCH];
+	sint32 num_punish[MAX_BATCH];
+	bool is_live[MAX_BATCH];
+	for (sint32 h = 0; h < num; h++) {
+		v_cost[h] = _mm512_setzero_ps();
+		num_punish[h] = 0;
+		is_live[h] = true;
+	}
+	sint32 num_live = num;
+
+	for (sint32 k = 0; k < patch_size_ && num_live > 0; k++) {
+		const sint32 i = order ? order[k] : k;
+		const sint32 r = i - pat;
+		const sint32 yr = y + r;
+		if (yr < 0 || yr > height_ - 1) {
+			continue;
+		}
+		const PPixel* row_l = packed_left_->Row(yr);
+		const PPixel* row_r = packed_right_->Row(yr);
+		// 本行的缓存权值, 以列偏移c索引
+		const uint8* wrow = weights ? weights + i * patch_size_ + pat : nullptr;
+		// 本行参与聚合的列, 未设置采样模式时为[c_lo, c_hi]内的连续列
+		const sint32* cols = sample_pattern_ ? sample_pattern_->RowCols(i) : nullptr;
+		const sint32 n = sample_pattern_ ? sample_pattern_->RowCount(i) : c_hi - c_lo + 1;
+
+		// 各候选的行首视差
+		float32 d_row[MAX_BATCH], d_base[MAX_BATCH];
+		for (sint32 h = 0; h < num; h++) {
+			d_row[h] = params[h].to_disparity(x + c_lo, yr);
+			d_base[h] = d_row[h];
+		}
+
+		for (sint32 j = 0; j < n; j += 16) {
+			const __mmask16 m_lanes = static_cast<__mmask16>((1u << std::min(16, n - j)) - 1);
+			__m512i v_c;
+			__mmask16 m_valid;
+			if (cols) {
+				// 采样列, 裁剪到图像内
+				v_c = _mm512_loadu_si512(cols + j);
+				m_valid = m_lanes & _mm512_cmpge_epi32_mask(v_c, _mm512_set1_epi32(c_lo)) &
+						  _mm512_cmple_epi32_mask(v_c, _mm512_set1_epi32(c_hi));
+			}
+			else {
+				v_c = _mm512_add_epi32(_mm512_set1_epi32(c_lo + j), v_iota);
+				m_valid = m_lanes;
+			}
+			const __m512i v_xc = _mm512_add_epi32(_mm512_set1_epi32(x), v_c);
+			const __m512 v_xc_f = _mm512_cvtepi32_ps(v_xc);
+
+			// 以下为各候选共用的部分: 邻域像素q的颜色、梯度及权值
+			__m512i v_col_q, v_grad_q;
+			if (cols) {
+				GatherPixelAVX512(row_l, v_xc, m_valid, v_col_q, v_grad_q);
+			}
+			else {
+				LoadPixelAVX512(row_l + x + c_lo + j, v_col_q, v_grad_q);
+			}
+			const __m512 q0 = Channel0AVX512(v_col_q);
+			const __m512 q1 = Channel1AVX512(v_col_q);
+			const __m512 q2 = Channel2AVX512(v_col_q);
+			__m512 v_w;
+			if (wrow) {
+				const __m512i v_wq = cols ?
+					_mm512_and_si512(_mm512_mask_i32gather_epi32(_mm512_setzero_si512(), m_valid, v_c, wrow, 1),
+									 _mm512_set1_epi32(0xff)) :
+					_mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(wrow + c_lo + j)));
+				v_w = _mm512_mul_ps(_mm512_cvtepi32_ps(v_wq), v_wscale);
+			}
+			else {
+				const __m512 v_dcw = _mm512_add_ps(_mm512_add_ps(AbsAVX512(_mm512_sub_ps(v_pb, q0)),
+					AbsAVX512(_mm512_sub_ps(v_pg, q1))), AbsAVX512(_mm512_sub_ps(v_pr, q2)));
+				v_w = FastExpAVX512(_mm512_mul_ps(v_dcw, v_ngamma));
+			}
+			const __m512 gqx = GradXAVX512(v_grad_q);
+			const __m512 gqy = GradYAVX512(v_grad_q);
+
+			// 逐个候选计算同名点并累加代价
+			for (sint32 h = 0; h < num; h++) {
+				const float32 a = params[h].param.x;
+				const __m512 v_a = _mm512_set1_ps(a);
+				const __m512 v_d = cols ?
+					_mm512_fmadd_ps(v_a, _mm512_cvtepi32_ps(_mm512_sub_epi32(v_c, _mm512_set1_epi32(c_lo))),
+									_mm512_set1_ps(d_row[h])) :
+					_mm512_fmadd_ps(v_a, v_iota_f, _mm512_set1_ps(d_base[h]));
+				d_base[h] += 16 * a;
+				if (!is_live[h]) {
+					continue;
+				}
+
+				// 截断溢出惩罚
+				const __mmask16 m_in = _mm512_cmp_ps_mask(v_d, v_min, _CMP_GE_OQ) & _mm512_cmp_ps_mask(v_d, v_max, _CMP_LE_OQ);
+				num_punish[h] += PopCount(m_valid & ~m_in);
+				const __mmask16 m_ok = m_valid & m_in;
+				if (m_ok == 0) {
+					continue;
+				}
+
+				// 同名点列号及两个内插抽头
+				const __m512 v_xr = _mm512_sub_ps(v_xc_f, v_d);
+				const __m512i v_x1 = _mm512_sub_epi32(_mm512_cvttps_epi32(_mm512_add_ps(v_xr, v_halo_f)), v_halo);
+				const __m512 v_ofs = _mm512_sub_ps(v_xr, _mm512_cvtepi32_ps(v_x1));
+				const __m512 v_ofs_c = _mm512_sub_ps(v_one_f, v_ofs);
+				__m512i v_c1, v_g1, v_c2, v_g2;
+				GatherPixelAVX512(row_r, v_x1, m_ok, v_c1, v_g1);
+				const __mmask16 m_r = m_ok & ValidAVX512(v_c1);
+				GatherPixelAVX512(row_r, _mm512_add_epi32(v_x1, v_one), m_r, v_c2, v_g2);
+
+				// 右图颜色及梯度线性内插
+				const __m512 r0 = _mm512_add_ps(_mm512_mul_ps(v_ofs_c, Channel0AVX512(v_c1)), _mm512_mul_ps(v_ofs, Channel0AVX512(v_c2)));
+				const __m512 r1 = _mm512_add_ps(_mm512_mul_ps(v_ofs_c, Channel1AVX512(v_c1)), _mm512_mul_ps(v_ofs, Channel1AVX512(v_c2)));
+				const __m512 r2 = _mm512_add_ps(_mm512_mul_ps(v_ofs_c, Channel2AVX512(v_c1)), _mm512_mul_ps(v_ofs, Channel2AVX512(v_c2)));
+				const __m512 v_dc = _mm512_min_ps(_mm512_add_ps(_mm512_add_ps(AbsTruncAVX512(_mm512_sub_ps(q0, r0)),
+					AbsTruncAVX512(_mm512_sub_ps(q1, r1))), AbsTruncAVX512(_mm512_sub_ps(q2, r2))), v_tau_col);
+				const __m512 grx = _mm512_add_ps(_mm512_mul_ps(v_ofs_c, GradXAVX512(v_g1)), _mm512_mul_ps(v_ofs, GradXAVX512(v_g2)));
+				const __m512 gry = _mm512_add_ps(_mm512_mul_ps(v_ofs_c, GradYAVX512(v_g1)), _mm512_mul_ps(v_ofs, GradYAVX512(v_g2)));
+				const __m512 v_dg = _mm512_min_ps(_mm512_add_ps(AbsTruncAVX512(_mm512_sub_ps(gqx, grx)),
+					AbsTruncAVX512(_mm512_sub_ps(gqy, gry))), v_tau_grad);
+
+				// 同名点对的不相似代价值, 加权累加
+				const __m512 v_pc = _mm512_mask_blend_ps(m_r, v_trunc,
+					_mm512_add_ps(_mm512_mul_ps(v_alpha_c, v_dc), _mm512_mul_ps(v_alpha, v_dg)));
+				v_cost[h] = _mm512_mask_add_ps(v_cost[h], m_ok, v_cost[h], _mm512_mul_ps(v_w, v_pc));
+			}
+		}
+
+		// 部分和已不小于上界的候选提前终止
+		if (bounded) {
+			for (sint32 h = 0; h < num; h++) {
+				if (is_live[h]) {
+					costs[h] = _mm512_reduce_add_ps(v_cost[h]) + num_punish[h] * COST_PUNISH;
+					if (costs[h] >= upper_bound) {
+						is_live[h] = false;
+						num_live--;
+					}
+				}
+			}
+		}
+	}
+
+	for (sint32 h = 0; h < num; h++) {
+		if (is_live[h]) {
+			costs[h] = _mm512_reduce_add_ps(v_cost[h]) + num_punish[h] * COST_PUNISH;
+		}
+	}
+}
+
+#else
+
+// 非x86平台无向量化实现, 回退到标量实现
+float32 CostComputerPMS::ComputeAAVX2(const sint32& x, const sint32& y, const DisparityPlane& param,
+									  const float32& upper_bound) const
+{
+	return ComputeAScalar(x, y, param, upper_bound);
+}
+
+float32 CostComputerPMS::ComputeAAVX512(const sint32& x, const sint32& y, const DisparityPlane& param,
+										const float32& upper_bound) const
+{
+	return ComputeAScalar(x, y, param, upper_bound);
+}
+
+void CostComputerPMS::ComputeABatchAVX2(const sint32& x, const sint32& y, const DisparityPlane* params,
+										const sint32& num, float32* costs, const float32& upper_bound) const
+{
+	ComputeABatchScalar(x, y, params, num, costs, upper_bound);
+}
+
+void CostComputerPMS::ComputeABatchAVX512(const sint32& x, const sint32& y, const DisparityPlane* params,
+										  const sint32& num, float32* costs, const float32& upper_bound) const
+{
+	ComputeABatchScalar(x, y, params, num, costs, upper_bound);
+}
+
+#endif
@@ -0,0 +1,101 @@
+/* -*-c++-*- PatchMatchStereo - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+*			  https://github.com/ethan-li-coding
+* Describe	: implement of pms_census_image
+*/
+
+#include "stdafx.h"
+#include "pms_census_image.h"
+#include "pms_preprocess.h"
+#include "pms_thread_pool.h"
+#include <algorithm>
+
+
+void PMSCensusImage::Build(const PImageView& img,
+						   const sint32& census_w, const sint32& census_h,
+						   const sint32& halo_x, const sint32& halo_y)
+{
+	if (!img.IsValid()) {
+		Build(nullptr, img.width, img.height, census_w, census_h, halo_x, halo_y);
+		return;
+	}
+
+	// 彩色转灰度, 灰度图只拷贝
+	const sint32 width = img.width;
+	const sint32 height = img.height;
+	vector<uint8> gray(width * height);
+	for (sint32 y = 0; y < height; y++) {
+		uint8* row_g = &gray[y * width];
+		if (img.format == PixelFormat::GRAY) {
+			memcpy(row_g, img.Row(y), width);
+			continue;
+		}
+		for (sint32 x = 0; x < width; x++) {
+			row_g[x] = pms_preprocess::Gray(img.Color(x, y));
+		}
+	}
+	Build(gray.data(), width, height, census_w, census_h, halo_x, halo_y);
+}
+
+void PMSCensusImage::Build(const uint8* gray, const sint32& width, const sint32& height,
+						   const sint32& census_w, const sint32& census_h,
+						   const sint32& halo_x, const sint32& halo_y,
+						   PMSThreadPool* pool)
+{
+	width_ = width;
+	height_ = height;
+	halo_x_ = std::max(halo_x, 0);
+	halo_y_ = std::max(halo_y, 0);
+	stride_ = width + 2 * halo_x_;
+	data_.clear();
+	if (gray == nullptr || width <= 0 || height <= 0) {
+		return;
+	}
+
+	// 窗口取奇数, 限制在3x3~MAX_WIDTH x MAX_HEIGHT之间
+	radius_x_ = WindowRadius(census_w, MAX_WIDTH);
+	radius_y_ = WindowRadius(census_h, MAX_HEIGHT);
+	const sint32 rx = radius_x_, ry = radius_y_;
+	num_bits_ = (2 * rx + 1) * (2 * ry + 1) - 1;
+
+	data_.resize(static_cast<uint64>(stride_) * (height + 2 * halo_y_));
+
+	// 逐行census变换, 窗口超出图像的部分复制最近的图像像素; 左右外扩复制行首行尾
+	const auto census_row = [&](const sint32 y) {
+		uint64* row_c = data_.data() + static_cast<sint64>(y + halo_y_) * stride_ + halo_x_;
+		for (sint32 x = 0; x < width; x++) {
+			const uint8 center = gray[y * width + x];
+			uint64 bits = 0;
+			for (sint32 r = -ry; r <= ry; r++) {
+				const sint32 yr = std::max(0, std::min(height - 1, y + r));
+				const uint8* row = gray + yr * width;
+				for (sint32 c = -rx; c <= rx; c++) {
+					if (r == 0 && c == 0) {
+						continue;
+					}
+					const sint32 xc = std::max(0, std::min(width - 1, x + c));
+					bits = (bits << 1) | (row[xc] < center ? 1 : 0);
+				}
+			}
+			row_c[x] = bits;
+		}
+		std::fill(row_c - halo_x_, row_c, row_c[0]);
+		std::fill(row_c + width, row_c + width + halo_x_, row_c[width - 1]);
+	};
+	if (pool != nullptr && height > 1) {
+		pool->ParallelFor(height, census_row);
+	}
+	else {
+		for (sint32 y = 0; y < height; y++) {
+			census_row(y);
+		}
+	}
+
+	// 上下外扩复制首行和末行
+	const uint64* first = data_.data() + static_cast<sint64>(halo_y_) * stride_;
+	const uint64* last = data_.data() + static_cast<sint64>(height - 1 + halo_y_) * stride_;
+	for (sint32 i = 0; i < halo_y_; i++) {
+		memcpy(data_.data() + static_cast<sint64>(i) * stride_, first, stride_ * sizeof(uint64));
+		memcpy(data_.data() + static_cast<sint64>(height + halo_y_ + i) * stride_, last, stride_ * sizeof(uint64));
+	}
+}
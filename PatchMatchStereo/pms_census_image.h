@@ -0,0 +1,100 @@
+/* -*-c++-*- PatchMatchStereo - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+*			  https://github.com/ethan-li-coding
+* Describe	: header of pms_census_image
+*/
+
+#ifndef PATCH_MATCH_STEREO_CENSUS_IMAGE_H_
+#define PATCH_MATCH_STEREO_CENSUS_IMAGE_H_
+#include "pms_types.h"
+#include <algorithm>
+
+class PMSThreadPool;
+
+/**
+ * \brief Census变换图像
+ * 每个像素为一个64位的比特串, 窗口内(除中心外)灰度小于中心的邻域像素置1, 窗口最大为9x7(62位)
+ * 外扩边界与PMSPackedImage相同, 复制最近的图像像素, 像素是否在图像内由打包图像的有效标记判断
+ */
+class PMSCensusImage final {
+public:
+	// 窗口最大宽高
+	static constexpr sint32 MAX_WIDTH = 9;
+	static constexpr sint32 MAX_HEIGHT = 7;
+
+	PMSCensusImage() : width_(0), height_(0), halo_x_(0), halo_y_(0), stride_(0), radius_x_(0), radius_y_(0), num_bits_(0) {}
+	~PMSCensusImage() = default;
+
+	/**
+	 * \brief 由彩色图像构建census图像, 灰度转换方式与预处理一致(pms_preprocess::Gray)
+	 * \param img			图像, 灰度图直接使用
+	 * \param census_w		census窗口宽, 取奇数且不大于MAX_WIDTH
+	 * \param census_h		census窗口高, 取奇数且不大于MAX_HEIGHT
+	 * \param halo_x		左右外扩宽度
+	 * \param halo_y		上下外扩宽度
+	 */
+	void Build(const PImageView& img,
+			   const sint32& census_w, const sint32& census_h,
+			   const sint32& halo_x, const sint32& halo_y);
+
+	/**
+	 * \brief 由灰度数据构建census图像, 各行的变换相互独立, 可分给线程池
+	 * \param gray			灰度数据, 与图像等尺寸紧密排列
+	 * \param width			图像宽
+	 * \param height		图像高
+	 * \param census_w		census窗口宽, 取奇数且不大于MAX_WIDTH
+	 * \param census_h		census窗口高, 取奇数且不大于MAX_HEIGHT
+	 * \param halo_x		左右外扩宽度
+	 * \param halo_y		上下外扩宽度
+	 * \param pool			线程池, 为空时单线程执行
+	 */
+	void Build(const uint8* gray, const sint32& width, const sint32& height,
+			   const sint32& census_w, const sint32& census_h,
+			   const sint32& halo_x, const sint32& halo_y,
+			   PMSThreadPool* pool = nullptr);
+
+	/**
+	 * \brief 获取第y行第0列像素的指针, 行列号的范围同PMSPackedImage::Row
+	 * \param y		行号
+	 * \return const uint64*	行指针
+	 */
+	inline const uint64* Row(const sint32& y) const
+	{
+		return data_.data() + static_cast<sint64>(y + halo_y_) * stride_ + halo_x_;
+	}
+
+	// 比特串的有效位数, 即窗口像素数减1
+	sint32 NumBits() const { return num_bits_; }
+
+	bool Empty() const { return data_.empty(); }
+
+	// 是否已按census_w x census_h的窗口构建, 且外扩宽度满足要求
+	bool Covers(const sint32& census_w, const sint32& census_h, const sint32& halo_x, const sint32& halo_y) const
+	{
+		return !data_.empty() && radius_x_ == WindowRadius(census_w, MAX_WIDTH) &&
+			   radius_y_ == WindowRadius(census_h, MAX_HEIGHT) && halo_x_ >= halo_x && halo_y_ >= halo_y;
+	}
+
+	// 占用的内存字节数
+	uint64 Bytes() const { return data_.capacity() * sizeof(uint64); }
+
+private:
+	// 窗口半径: 窗口取奇数, 限制在3~max_size之间(按值传参, 传入MAX_WIDTH/MAX_HEIGHT时不需要其类外定义)
+	static sint32 WindowRadius(const sint32 size, const sint32 max_size)
+	{
+		return std::max(1, std::min(max_size, size) / 2);
+	}
+
+	sint32 width_;
+	sint32 height_;
+	sint32 halo_x_;
+	sint32 halo_y_;
+	// 每行的像素数(含外扩)
+	sint32 stride_;
+	sint32 radius_x_;
+	sint32 radius_y_;
+	sint32 num_bits_;
+	vector<uint64> data_;
+};
+
+#endif
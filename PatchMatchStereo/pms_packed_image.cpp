@@ -0,0 +1,78 @@
+/* -*-c++-*- PatchMatchStereo - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+*			  https://github.com/ethan-li-coding
+* Describe	: implement of pms_packed_image
+*/
+
+#include "stdafx.h"
+#include "pms_packed_image.h"
+
+
+void PMSPackedImage::Build(const PImageView& img, const PGradient* grad_data,
+						   const sint32& halo_x, const sint32& halo_y)
+{
+	if (!img.IsValid()) {
+		Allocate(0, 0, halo_x, halo_y);
+		data_.clear();
+		return;
+	}
+	const sint32 width = img.width;
+	const sint32 height = img.height;
+	Allocate(width, height, halo_x, halo_y);
+
+	for (sint32 y = 0; y < height; y++) {
+		PPixel* row = Row(y);
+		for (sint32 x = 0; x < width; x++) {
+			const PColor col = img.Color(x, y);
+			PPixel& pixel = row[x];
+			pixel.b = col.b;
+			pixel.g = col.g;
+			pixel.r = col.r;
+			pixel.valid = 1;
+			pixel.grad = grad_data ? grad_data[y * width + x] : PGradient();
+		}
+		FillHalo(y);
+	}
+}
+
+void PMSPackedImage::Allocate(const sint32& width, const sint32& height, const sint32& halo_x, const sint32& halo_y)
+{
+	width_ = std::max(width, 0);
+	height_ = std::max(height, 0);
+	halo_x_ = std::max(halo_x, 0);
+	halo_y_ = std::max(halo_y, 0);
+	stride_ = width_ + 2 * halo_x_;
+	// 全部像素都会被写入, 已有数据无需清零
+	data_.resize(static_cast<uint64>(stride_) * (height_ + 2 * halo_y_));
+}
+
+void PMSPackedImage::FillHalo(const sint32& y)
+{
+	if (y < 0 || y >= height_) {
+		return;
+	}
+
+	// 外扩边界复制最近的图像像素, 有效标记为0
+	PPixel* row = Row(y);
+	PPixel first = row[0], last = row[width_ - 1];
+	first.valid = 0;
+	last.valid = 0;
+	std::fill(row - halo_x_, row, first);
+	std::fill(row + width_, row + width_ + halo_x_, last);
+
+	// 上下外扩各行复制首末行(含左右外扩), 只有一行时两者都写入
+	const PPixel* src = row - halo_x_;
+	for (sint32 side = 0; side < 2; side++) {
+		if (y != ((side == 0) ? 0 : height_ - 1)) {
+			continue;
+		}
+		const sint32 i0 = (side == 0) ? -halo_y_ : height_;
+		for (sint32 i = i0; i < i0 + halo_y_; i++) {
+			PPixel* dst = Row(i) - halo_x_;
+			for (sint32 j = 0; j < stride_; j++) {
+				dst[j] = src[j];
+				dst[j].valid = 0;
+			}
+		}
+	}
+}
@@ -0,0 +1,103 @@
+/* -*-c++-*- PatchMatchStereo - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+*			  https://github.com/ethan-li-coding
+* Describe	: header of pms_packed_image
+*/
+
+#ifndef PATCH_MATCH_STEREO_PACKED_IMAGE_H_
+#define PATCH_MATCH_STEREO_PACKED_IMAGE_H_
+#include "pms_types.h"
+#include <algorithm>
+#include <cstdlib>
+
+
+/**
+ * \brief 打包的颜色+梯度图像
+ * 每个像素为一个PPixel记录, 四周外扩边界: 边界像素复制最近的图像像素, 有效标记为0
+ * 外扩宽度覆盖聚合窗口半径与视差范围, 聚合时邻域像素和同名点的读取无需逐像素判断坐标越界
+ */
+class PMSPackedImage final {
+public:
+	PMSPackedImage() : width_(0), height_(0), halo_x_(0), halo_y_(0), stride_(0) {}
+	~PMSPackedImage() = default;
+
+	/**
+	 * \brief 构建打包图像
+	 * \param img			图像
+	 * \param grad_data		梯度数据, 与图像等尺寸紧密排列, 为空时梯度置0(代价不使用梯度时)
+	 * \param halo_x		左右外扩宽度
+	 * \param halo_y		上下外扩宽度
+	 */
+	void Build(const PImageView& img, const PGradient* grad_data,
+			   const sint32& halo_x, const sint32& halo_y);
+
+	/**
+	 * \brief 分配打包图像, 不写入数据; 由调用方逐行写入图像内的像素后调用FillHalo
+	 * \param width		图像宽
+	 * \param height	图像高
+	 * \param halo_x	左右外扩宽度
+	 * \param halo_y	上下外扩宽度
+	 */
+	void Allocate(const sint32& width, const sint32& height, const sint32& halo_x, const sint32& halo_y);
+
+	/**
+	 * \brief 写入第y行的外扩边界: 左右外扩复制该行的首末像素; y为首行(末行)时同时写入上(下)外扩的各行.
+	 * 只读写第y行及其对应的外扩行, 不同的行可由不同线程处理
+	 * \param y		行号
+	 */
+	void FillHalo(const sint32& y);
+
+	/**
+	 * \brief 聚合所需的左右外扩宽度
+	 * 邻域像素最远在窗口半径之外, 同名点最远再偏移一个视差, 另加16列供向量化实现整块读取
+	 * \param patch_size	局部块大小
+	 * \param min_disp		最小视差值
+	 * \param max_disp		最大视差值
+	 * \return sint32		外扩宽度
+	 */
+	static sint32 RequiredHaloX(const sint32& patch_size, const sint32& min_disp, const sint32& max_disp)
+	{
+		return patch_size / 2 + std::max(abs(min_disp), abs(max_disp)) + 16;
+	}
+
+	// 聚合所需的上下外扩宽度
+	static sint32 RequiredHaloY(const sint32& patch_size) { return patch_size / 2; }
+
+	/**
+	 * \brief 获取第y行第0列像素的指针, y可在[-halo_y, height+halo_y)内, 列号可在[-halo_x, width+halo_x)内
+	 * \param y		行号
+	 * \return const PPixel*	行指针
+	 */
+	inline const PPixel* Row(const sint32& y) const
+	{
+		return data_.data() + static_cast<sint64>(y + halo_y_) * stride_ + halo_x_;
+	}
+	inline PPixel* Row(const sint32& y)
+	{
+		return data_.data() + static_cast<sint64>(y + halo_y_) * stride_ + halo_x_;
+	}
+
+	// 是否已构建, 且外扩宽度满足要求
+	bool Covers(const sint32& halo_x, const sint32& halo_y) const
+	{
+		return !data_.empty() && halo_x_ >= halo_x && halo_y_ >= halo_y;
+	}
+
+	sint32 Width() const { return width_; }
+	sint32 Height() const { return height_; }
+	sint32 HaloX() const { return halo_x_; }
+
+	// 占用的内存字节数
+	uint64 Bytes() const { return data_.capacity() * sizeof(PPixel); }
+
+private:
+	sint32 width_;
+	sint32 height_;
+	sint32 halo_x_;
+	sint32 halo_y_;
+	// 每行的像素数(含外扩)
+	sint32 stride_;
+	vector<PPixel> data_;
+};
+
+#endif
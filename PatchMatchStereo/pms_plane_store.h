@@ -0,0 +1,198 @@
+/* -*-c++-*- PatchMatchStereo - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+*			  https://github.com/ethan-li-coding
+* Describe	: header of pms_plane_store
+*/
+
+#ifndef PATCH_MATCH_STEREO_PLANE_STORE_H_
+#define PATCH_MATCH_STEREO_PLANE_STORE_H_
+#include "pms_types.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(PMS_COMPACT_PLANE) && defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+
+#ifdef PMS_COMPACT_PLANE
+/**
+ * \brief 视差平面的紧凑编码(6字节)
+ * 斜率a,b为半精度浮点; 截距c与像素坐标相关, 大图像上半精度无法表示, 改存平面在本像素处的视差, 为1/32像素的定点数
+ */
+struct PPlaneCode {
+	uint16 a;	// 半精度x方向斜率
+	uint16 b;	// 半精度y方向斜率
+	sint16 d;	// 本像素处的视差*32
+};
+typedef PPlaneCode	PPlaneStore;	// 平面的存储类型
+typedef uint16		PCostStore;		// 代价的存储类型(半精度)
+#else
+typedef DisparityPlane	PPlaneStore;	// 平面的存储类型
+typedef float32			PCostStore;		// 代价的存储类型
+#endif
+
+/**
+ * \brief 平面集及代价集的存储编解码
+ * 默认按DisparityPlane/float32原样存储, 编解码不做任何事; 编译时定义PMS_COMPACT_PLANE则使用紧凑编码,
+ * 每像素每视图的平面和代价由16字节减为8字节, 传播时读写的数据量减半.
+ * 紧凑编码与像素位置有关, 候选平面须先用Quantize量化到所在像素的存储精度再比较和计算代价, 使存入的平面与其代价一致
+ */
+class PMSPlaneStore final {
+public:
+	// 定点视差的比例, 可表示的视差范围约为[-1024, 1024)
+	static constexpr float32 DISP_SCALE = 32.0f;
+	// 代价存为半精度前乘以的比例, 使带惩罚的窗口代价不超出半精度的表示范围
+	static constexpr float32 COST_SCALE = 1.0f / 16.0f;
+
+	/**
+	 * \brief 解码像素(x,y)处存储的平面
+	 * \param s		存储的平面
+	 * \param x		像素x坐标
+	 * \param y		像素y坐标
+	 * \return DisparityPlane	视差平面
+	 */
+	static DisparityPlane Load(const PPlaneStore& s, const sint32& x, const sint32& y)
+	{
+#ifdef PMS_COMPACT_PLANE
+		const float32 a = HalfToFloat(s.a);
+		const float32 b = HalfToFloat(s.b);
+		return DisparityPlane(a, b, s.d * (1.0f / DISP_SCALE) - a * x - b * y);
+#else
+		(void)x; (void)y;
+		return s;
+#endif
+	}
+
+	/**
+	 * \brief 编码平面, 存储于像素(x,y)处
+	 * \param plane	视差平面
+	 * \param x		像素x坐标
+	 * \param y		像素y坐标
+	 * \return PPlaneStore	存储的平面
+	 */
+	static PPlaneStore Store(const DisparityPlane& plane, const sint32& x, const sint32& y)
+	{
+#ifdef PMS_COMPACT_PLANE
+		// 斜率截断到半精度的最大有限值, 视差截断到定点数的范围
+		const float32 half_max = 65504.0f;
+		const float32 d = std::min(std::max(plane.to_disparity(x, y) * DISP_SCALE, -32768.0f), 32767.0f);
+		PPlaneCode s;
+		s.a = FloatToHalf(std::min(std::max(plane.param.x, -half_max), half_max));
+		s.b = FloatToHalf(std::min(std::max(plane.param.y, -half_max), half_max));
+		s.d = static_cast<sint16>(lround(d));
+		return s;
+#else
+		(void)x; (void)y;
+		return plane;
+#endif
+	}
+
+	/**
+	 * \brief 将平面量化到像素(x,y)处的存储精度, 即编码后再解码
+	 * \param plane	视差平面
+	 * \param x		像素x坐标
+	 * \param y		像素y坐标
+	 * \return DisparityPlane	量化后的平面
+	 */
+	static DisparityPlane Quantize(const DisparityPlane& plane, const sint32& x, const sint32& y)
+	{
+#ifdef PMS_COMPACT_PLANE
+		return Load(Store(plane, x, y), x, y);
+#else
+		(void)x; (void)y;
+		return plane;
+#endif
+	}
+
+	// 解码代价
+	static float32 LoadCost(const PCostStore& s)
+	{
+#ifdef PMS_COMPACT_PLANE
+		return HalfToFloat(s) * (1.0f / COST_SCALE);
+#else
+		return s;
+#endif
+	}
+
+	// 编码代价
+	static PCostStore StoreCost(const float32& cost)
+	{
+#ifdef PMS_COMPACT_PLANE
+		return FloatToHalf(cost * COST_SCALE);
+#else
+		return cost;
+#endif
+	}
+
+#ifdef PMS_COMPACT_PLANE
+private:
+	// 单精度转半精度, 就近舍入(偶数优先), 溢出为inf
+	static uint16 FloatToHalf(const float32& v)
+	{
+#if defined(__F16C__)
+		return static_cast<uint16>(_cvtss_sh(v, 0));
+#else
+		uint32 f;
+		memcpy(&f, &v, sizeof(f));
+		const uint32 sign = f & 0x80000000u;
+		f ^= sign;
+		uint32 h;
+		if (f >= (143u << 23)) {
+			// 不小于65536, inf或nan
+			h = (f > (255u << 23)) ? 0x7e00u : 0x7c00u;
+		}
+		else if (f < (113u << 23)) {
+			// 半精度的非规格化数, 借助浮点加法完成舍入
+			const uint32 magic_bits = 126u << 23;
+			float32 fv, magic;
+			memcpy(&fv, &f, sizeof(fv));
+			memcpy(&magic, &magic_bits, sizeof(magic));
+			fv += magic;
+			memcpy(&h, &fv, sizeof(h));
+			h -= magic_bits;
+		}
+		else {
+			const uint32 mant_odd = (f >> 13) & 1u;
+			f += (static_cast<uint32>(15 - 127) << 23) + 0xfffu;
+			f += mant_odd;
+			h = f >> 13;
+		}
+		return static_cast<uint16>(h | (sign >> 16));
+#endif
+	}
+
+	// 半精度转单精度
+	static float32 HalfToFloat(const uint16& h)
+	{
+#if defined(__F16C__)
+		return _cvtsh_ss(h);
+#else
+		const uint32 shifted_exp = 0x7c00u << 13;
+		uint32 f = (h & 0x7fffu) << 13;
+		const uint32 exp = shifted_exp & f;
+		f += static_cast<uint32>(127 - 15) << 23;
+		if (exp == shifted_exp) {
+			// inf或nan
+			f += static_cast<uint32>(128 - 16) << 23;
+		}
+		else if (exp == 0) {
+			// 非规格化数, 重新规格化
+			const uint32 magic_bits = 113u << 23;
+			float32 fv, magic;
+			f += 1u << 23;
+			memcpy(&fv, &f, sizeof(fv));
+			memcpy(&magic, &magic_bits, sizeof(magic));
+			fv -= magic;
+			memcpy(&f, &fv, sizeof(f));
+		}
+		f |= static_cast<uint32>(h & 0x8000u) << 16;
+		float32 v;
+		memcpy(&v, &f, sizeof(v));
+		return v;
+#endif
+	}
+#endif
+};
+
+#endif
@@ -0,0 +1,314 @@
+/* -*-c++-*- PatchMatchStereo - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+*			  https://github.com/ethan-li-coding
+* Describe	: implement of pms_preprocess
+*/
+
+#include "stdafx.h"
+#include "pms_preprocess.h"
+#include "pms_packed_image.h"
+#include "pms_thread_pool.h"
+#include "pms_util.h"
+
+#ifdef PMS_SIMD_X86
+#include <immintrin.h>
+#endif
+
+using namespace pms_preprocess;
+
+namespace
+{
+	// 打包格式的颜色: 低3字节为b,g,r, 最高字节为有效标记1, 与PPixel的前4字节一致
+	const uint32 VALID_BIT = 1u << 24;
+
+	/**
+	 * @brief 读取图像第y行[x0, width)的像素, 转为打包格式的颜色及灰度
+	 * @param img		图像
+	 * @param y			行号
+	 * @param x0		起始列
+	 * @param color		输出, 打包格式的颜色
+	 * @param gray		输出, 灰度
+	 */
+	void ColorRow(const PImageView& img, const sint32& y, const sint32& x0, uint32* color, uint8* gray)
+	{
+		for (sint32 x = x0; x < img.width; x++) {
+			const PColor col = img.Color(x, y);
+			color[x] = col.b | (col.g << 8) | (col.r << 16) | VALID_BIT;
+			gray[x] = Gray(col);
+		}
+	}
+
+	/**
+	 * @brief 计算一行[x0, x1)的Sobel梯度, 左右越界的列复制最近的图像像素
+	 * @param up		上一行灰度(首行时为本行)
+	 * @param mid		本行灰度
+	 * @param down		下一行灰度(末行时为本行)
+	 * @param width		图像宽
+	 * @param x0		起始列
+	 * @param x1		结束列(不含)
+	 * @param grad		输出, 本行梯度
+	 */
+	void GradientRow(const uint8* up, const uint8* mid, const uint8* down, const sint32& width,
+					 const sint32& x0, const sint32& x1, PGradient* grad)
+	{
+		for (sint32 x = x0; x < x1; x++) {
+			const sint32 l = std::max(x - 1, 0);
+			const sint32 r = std::min(x + 1, width - 1);
+			const sint32 grad_x = (-up[l] + up[r]) + (-2 * mid[l] + 2 * mid[r]) + (-down[l] + down[r]);
+			const sint32 grad_y = (-up[l] - up[r]) + (-2 * up[x] + 2 * down[x]) + (down[l] + down[r]);
+
+			// 这里除以8是为了让梯度的最大值不超过255, 这样计算代价时梯度差和颜色差位于同一个尺度
+			grad[x].x = static_cast<sint16>(grad_x / 8);
+			grad[x].y = static_cast<sint16>(grad_y / 8);
+		}
+	}
+
+	/**
+	 * @brief 将一行[x0, width)的颜色与梯度写为打包像素
+	 * @param color		打包格式的颜色
+	 * @param grad		梯度
+	 * @param x0		起始列
+	 * @param width		图像宽
+	 * @param pixels	输出, 打包像素
+	 */
+	void PackRow(const uint32* color, const PGradient* grad, const sint32& x0, const sint32& width, PPixel* pixels)
+	{
+		for (sint32 x = x0; x < width; x++) {
+			PPixel& pixel = pixels[x];
+			pixel.b = static_cast<uint8>(color[x]);
+			pixel.g = static_cast<uint8>(color[x] >> 8);
+			pixel.r = static_cast<uint8>(color[x] >> 16);
+			pixel.valid = 1;
+			pixel.grad = grad[x];
+		}
+	}
+
+#ifdef PMS_SIMD_X86
+	/**
+	 * @brief 由8个打包格式的颜色计算灰度, 与Gray的定点计算一致
+	 * @param c			颜色, 有效标记为1
+	 * @return __m128i	低8字节为灰度
+	 */
+	PMS_TARGET_AVX2 inline __m128i GrayAVX2(const __m256i& c)
+	{
+		// 16位对(b,r)与(g,1)分别乘加, 有效标记1乘以舍入常数
+		const __m256i mask = _mm256_set1_epi32(0x00ff00ff);
+		const __m256i w_br = _mm256_set1_epi32((GRAY_WR << 16) | GRAY_WB);
+		const __m256i w_g1 = _mm256_set1_epi32(((1 << (GRAY_SHIFT - 1)) << 16) | GRAY_WG);
+		const __m256i br = _mm256_and_si256(c, mask);
+		const __m256i g1 = _mm256_and_si256(_mm256_srli_epi32(c, 8), mask);
+		__m256i s = _mm256_add_epi32(_mm256_madd_epi16(br, w_br), _mm256_madd_epi16(g1, w_g1));
+		s = _mm256_srli_epi32(s, GRAY_SHIFT);
+		// 各128位内压缩为字节, 再拼接两半
+		s = _mm256_packus_epi32(s, s);
+		s = _mm256_packus_epi16(s, s);
+		return _mm_unpacklo_epi32(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1));
+	}
+
+	/**
+	 * @brief ColorRow的AVX2实现, 每次处理8个像素, 剩余的像素由调用方按标量处理
+	 * @return sint32	已处理到的列
+	 */
+	PMS_TARGET_AVX2 sint32 ColorRowAVX2(const PImageView& img, const sint32& y, uint32* color, uint8* gray)
+	{
+		const uint8* src = img.Row(y);
+		const sint32 width = img.width;
+		const __m256i valid = _mm256_set1_epi32(VALID_BIT);
+		sint32 x = 0;
+		switch (img.format) {
+		case PixelFormat::GRAY:
+			for (; x + 8 <= width; x += 8) {
+				const __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + x)));
+				const __m256i c = _mm256_or_si256(_mm256_or_si256(v, _mm256_slli_epi32(v, 8)),
+												  _mm256_or_si256(_mm256_slli_epi32(v, 16), valid));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(color + x), c);
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(gray + x), _mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + x)));
+			}
+			break;
+		case PixelFormat::BGR:
+		case PixelFormat::RGB: {
+			// 每128位取4个像素(12字节)扩展为4个32位颜色; 第二次读取越过所需字节4个, 留出余量
+			const __m256i shuffle = (img.format == PixelFormat::BGR) ?
+				_mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+								 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1) :
+				_mm256_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1,
+								 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+			for (; x + 10 <= width; x += 8) {
+				const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 3 * x));
+				const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 3 * x + 12));
+				__m256i c = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+				c = _mm256_or_si256(_mm256_shuffle_epi8(c, shuffle), valid);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(color + x), c);
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(gray + x), GrayAVX2(c));
+			}
+			break;
+		}
+		case PixelFormat::BGRA:
+		case PixelFormat::RGBA: {
+			const __m256i shuffle = (img.format == PixelFormat::BGRA) ?
+				_mm256_setr_epi8(0, 1, 2, -1, 4, 5, 6, -1, 8, 9, 10, -1, 12, 13, 14, -1,
+								 0, 1, 2, -1, 4, 5, 6, -1, 8, 9, 10, -1, 12, 13, 14, -1) :
+				_mm256_setr_epi8(2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12, -1,
+								 2, 1, 0, -1, 6, 5, 4, -1, 10, 9, 8, -1, 14, 13, 12, -1);
+			for (; x + 8 <= width; x += 8) {
+				__m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 4 * x));
+				c = _mm256_or_si256(_mm256_shuffle_epi8(c, shuffle), valid);
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(color + x), c);
+				_mm_storel_epi64(reinterpret_cast<__m128i*>(gray + x), GrayAVX2(c));
+			}
+			break;
+		}
+		}
+		return x;
+	}
+
+	// 读取16个灰度, 扩展为16位
+	PMS_TARGET_AVX2 inline __m256i LoadGrayAVX2(const uint8* p)
+	{
+		return _mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+	}
+
+	// 16位整数除以8, 向零取整, 与整数除法一致
+	PMS_TARGET_AVX2 inline __m256i Div8AVX2(const __m256i& v)
+	{
+		const __m256i bias = _mm256_and_si256(_mm256_srai_epi16(v, 15), _mm256_set1_epi16(7));
+		return _mm256_srai_epi16(_mm256_add_epi16(v, bias), 3);
+	}
+
+	/**
+	 * @brief GradientRow的AVX2实现, 从第1列起每次处理16个像素, 不读取越界的列
+	 * @return sint32	已处理到的列
+	 */
+	PMS_TARGET_AVX2 sint32 GradientRowAVX2(const uint8* up, const uint8* mid, const uint8* down, const sint32& width,
+										   PGradient* grad)
+	{
+		sint32 x = 1;
+		for (; x + 17 <= width; x += 16) {
+			const __m256i ul = LoadGrayAVX2(up + x - 1), uc = LoadGrayAVX2(up + x), ur = LoadGrayAVX2(up + x + 1);
+			const __m256i ml = LoadGrayAVX2(mid + x - 1), mr = LoadGrayAVX2(mid + x + 1);
+			const __m256i dl = LoadGrayAVX2(down + x - 1), dc = LoadGrayAVX2(down + x), dr = LoadGrayAVX2(down + x + 1);
+			const __m256i gx = _mm256_add_epi16(_mm256_add_epi16(_mm256_sub_epi16(ur, ul), _mm256_sub_epi16(dr, dl)),
+												_mm256_slli_epi16(_mm256_sub_epi16(mr, ml), 1));
+			const __m256i gy = _mm256_sub_epi16(_mm256_add_epi16(_mm256_add_epi16(dl, dr), _mm256_slli_epi16(dc, 1)),
+												_mm256_add_epi16(_mm256_add_epi16(ul, ur), _mm256_slli_epi16(uc, 1)));
+			// 交错为(x,y)对; unpack在各128位内进行, 再按像素顺序重排两半
+			const __m256i qx = Div8AVX2(gx), qy = Div8AVX2(gy);
+			const __m256i lo = _mm256_unpacklo_epi16(qx, qy);
+			const __m256i hi = _mm256_unpackhi_epi16(qx, qy);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(grad + x), _mm256_permute2x128_si256(lo, hi, 0x20));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(grad + x + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+		}
+		return x;
+	}
+
+	/**
+	 * @brief PackRow的AVX2实现, 每次处理8个像素
+	 * @return sint32	已处理到的列
+	 */
+	PMS_TARGET_AVX2 sint32 PackRowAVX2(const uint32* color, const PGradient* grad, const sint32& width, PPixel* pixels)
+	{
+		sint32 x = 0;
+		for (; x + 8 <= width; x += 8) {
+			const __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(color + x));
+			const __m256i g = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(grad + x));
+			const __m256i lo = _mm256_unpacklo_epi32(c, g);
+			const __m256i hi = _mm256_unpackhi_epi32(c, g);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels + x), _mm256_permute2x128_si256(lo, hi, 0x20));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(pixels + x + 4), _mm256_permute2x128_si256(lo, hi, 0x31));
+		}
+		return x;
+	}
+#endif
+}
+
+void pms_preprocess::Preprocess(const PImageView& img, uint8* gray, PGradient* grad,
+								PMSPackedImage* packed, const sint32& halo_x, const sint32& halo_y,
+								const SimdLevel& simd, PMSThreadPool* pool)
+{
+	if (!img.IsValid() || gray == nullptr || grad == nullptr) {
+		return;
+	}
+	const sint32 width = img.width;
+	const sint32 height = img.height;
+	if (packed) {
+		packed->Allocate(width, height, halo_x, halo_y);
+	}
+
+#ifdef PMS_SIMD_X86
+	const bool avx2 = pms_util::ResolveSimdLevel(simd) != SimdLevel::NONE;
+#else
+	const bool avx2 = false;
+	(void)simd;
+#endif
+
+	// 读取一行颜色, 转为打包格式及灰度
+	const auto color_row = [&img, avx2](const sint32& y, uint32* color, uint8* gray_row) {
+		sint32 x = 0;
+#ifdef PMS_SIMD_X86
+		if (avx2) x = ColorRowAVX2(img, y, color, gray_row);
+#endif
+		ColorRow(img, y, x, color, gray_row);
+	};
+	const auto gradient_row = [width, avx2](const uint8* up, const uint8* mid, const uint8* down, PGradient* grad_row) {
+		sint32 x = 1;
+#ifdef PMS_SIMD_X86
+		if (avx2) x = GradientRowAVX2(up, mid, down, width, grad_row);
+#endif
+		GradientRow(up, mid, down, width, 0, 1, grad_row);
+		GradientRow(up, mid, down, width, x, width, grad_row);
+	};
+	const auto pack_row = [width, avx2](const uint32* color, const PGradient* grad_row, PPixel* pixels) {
+		sint32 x = 0;
+#ifdef PMS_SIMD_X86
+		if (avx2) x = PackRowAVX2(color, grad_row, width, pixels);
+#endif
+		PackRow(color, grad_row, x, width, pixels);
+	};
+
+	// 行块: 多线程时每个线程约4块, 以均衡负载
+	const sint32 num_threads = pool ? pool->NumThreads() : 1;
+	const sint32 block = (num_threads > 1) ? std::max(16, (height + 4 * num_threads - 1) / (4 * num_threads)) : height;
+	const sint32 num_blocks = (height + block - 1) / block;
+
+	const auto process_block = [&](sint32 b) {
+		const sint32 y0 = b * block;
+		const sint32 y1 = std::min(y0 + block, height);
+		// 相邻两行的颜色轮换使用; 行块上下相邻行的灰度属于其他行块, 写入局部缓存
+		vector<uint32> colors(2 * static_cast<size_t>(width));
+		vector<uint8> edges(2 * static_cast<size_t>(width));
+		const auto color_of = [&colors, width](const sint32& y) { return &colors[(y & 1) * static_cast<size_t>(width)]; };
+
+		const uint8* cur = gray + static_cast<sint64>(y0) * width;
+		color_row(y0, color_of(y0), gray + static_cast<sint64>(y0) * width);
+		const uint8* prev = cur;
+		if (y0 > 0) {
+			color_row(y0 - 1, color_of(y0 - 1), &edges[0]);
+			prev = &edges[0];
+		}
+		for (sint32 y = y0; y < y1; y++) {
+			// 先读入下一行, 本行的梯度需要上下两行的灰度; 末行复制本行
+			const uint8* next = cur;
+			if (y + 1 < height) {
+				uint8* dst = (y + 1 < y1) ? gray + static_cast<sint64>(y + 1) * width : &edges[width];
+				color_row(y + 1, color_of(y + 1), dst);
+				next = dst;
+			}
+			PGradient* grad_row = grad + static_cast<sint64>(y) * width;
+			gradient_row(prev, cur, next, grad_row);
+			if (packed) {
+				pack_row(color_of(y), grad_row, packed->Row(y));
+				packed->FillHalo(y);
+			}
+			prev = cur;
+			cur = next;
+		}
+	};
+	if (pool && num_blocks > 1) {
+		pool->ParallelFor(num_blocks, process_block);
+	}
+	else {
+		for (sint32 b = 0; b < num_blocks; b++) {
+			process_block(b);
+		}
+	}
+}
@@ -0,0 +1,52 @@
+/* -*-c++-*- PatchMatchStereo - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+*			  https://github.com/ethan-li-coding
+* Describe	: header of pms_preprocess
+*/
+
+#ifndef PATCH_MATCH_STEREO_PREPROCESS_H_
+#define PATCH_MATCH_STEREO_PREPROCESS_H_
+#include "pms_types.h"
+
+class PMSPackedImage;
+class PMSThreadPool;
+
+namespace pms_preprocess
+{
+	// 灰度的定点加权系数(14位小数), 和为1<<14, 三个通道相同时灰度等于通道值
+	const sint32 GRAY_SHIFT = 14;
+	const sint32 GRAY_WB = 1868;	// 0.114
+	const sint32 GRAY_WG = 9617;	// 0.587
+	const sint32 GRAY_WR = 4899;	// 0.299
+
+	/**
+	 * @brief 彩色转灰度, 定点加权后四舍五入
+	 * @param col	颜色
+	 * @return uint8 灰度
+	 */
+	inline uint8 Gray(const PColor& col)
+	{
+		return static_cast<uint8>((col.b * GRAY_WB + col.g * GRAY_WG + col.r * GRAY_WR +
+								   (1 << (GRAY_SHIFT - 1))) >> GRAY_SHIFT);
+	}
+
+	/**
+	 * @brief 预处理一个视图: 逐行一次遍历计算灰度、Sobel梯度, 并写入打包图像
+	 * 每行的颜色读入后即转为灰度及打包格式, 下一行的灰度就绪后计算本行梯度并写出打包行;
+	 * 图像按行块分给线程池, 行块边界的上下相邻行另行计算灰度, 各线程只写自己的行.
+	 * 梯度在图像边界复制最近的图像像素(与打包图像的外扩方式一致), 边界行列的梯度也有定义
+	 * @param img		图像
+	 * @param gray		输出, 灰度数据, 与图像等尺寸紧密排列
+	 * @param grad		输出, 梯度数据(Sobel/8), 与图像等尺寸紧密排列
+	 * @param packed	输出, 打包图像, 为空时不构建
+	 * @param halo_x	打包图像的左右外扩宽度
+	 * @param halo_y	打包图像的上下外扩宽度
+	 * @param simd		SIMD指令集, AUTO为运行时检测
+	 * @param pool		线程池, 为空时单线程执行
+	 */
+	void Preprocess(const PImageView& img, uint8* gray, PGradient* grad,
+					PMSPackedImage* packed, const sint32& halo_x, const sint32& halo_y,
+					const SimdLevel& simd, PMSThreadPool* pool);
+}
+
+#endif
@@ -6,47 +6,210 @@
 
 #include "stdafx.h"
 #include "pms_propagation.h"
+#include "pms_util.h"
+#include <chrono>
 
 
-PMSPropagation::PMSPropagation(const sint32 width, const sint32 height,
-							   const uint8* img_left, const uint8* img_right,
+namespace
+{
+	/**
+	 * @brief 根据参数创建代价计算类对象
+	 * @param option		PMS算法参数
+	 * @param img_left		左图像数据
+	 * @param img_right		右图像数据
+	 * @param grad_left		左图像梯度数据
+	 * @param grad_right	右图像梯度数据
+	 * @param width			图像宽
+	 * @param height		图像高
+	 * @param min_disp		最小视差值
+	 * @param max_disp		最大视差值
+	 * @param packed_left	左图像打包数据
+	 * @param packed_right	右图像打包数据
+	 * @param census_left	左图像census数据, 仅census代价使用
+	 * @param census_right	右图像census数据, 仅census代价使用
+	 * @return CostT*		代价计算类对象, 参数指定的代价类型不是CostT时为nullptr
+	 */
+	template <class CostT>
+	CostT* CreateCostComputer(const PMSOption& option,
+							  const PImageView& img_left, const PImageView& img_right,
+							  const PGradient* grad_left, const PGradient* grad_right,
+							  const sint32& width, const sint32& height,
+							  const sint32& min_disp, const sint32& max_disp,
+							  const PMSPackedImage* packed_left, const PMSPackedImage* packed_right,
+							  const PMSCensusImage* census_left, const PMSCensusImage* census_right)
+	{
+		CostComputer* cost_cpt = nullptr;
+		switch (option.cost_type) {
+		case CostType::PMS_FIXED:
+			cost_cpt = new CostComputerPMSFixed(img_left, img_right, grad_left, grad_right,
+												width, height, option.patch_size, min_disp, max_disp,
+												option.gamma, option.alpha, option.tau_col, option.tau_grad,
+												packed_left, packed_right);
+			break;
+		case CostType::CENSUS:
+			cost_cpt = new CostComputerCensus(img_left, img_right,
+											  width, height, option.patch_size, min_disp, max_disp,
+											  option.gamma, option.alpha, option.tau_col, option.tau_grad,
+											  option.census_width, option.census_height, option.is_census_interpolate,
+											  pms_util::ResolveSimdLevel(option.simd_level), packed_left, packed_right,
+											  census_left, census_right);
+			break;
+		default:
+			// 按CPU支持情况选择聚合代价的SIMD实现
+			cost_cpt = new CostComputerPMS(img_left, img_right, grad_left, grad_right,
+										   width, height, option.patch_size, min_disp, max_disp,
+										   option.gamma, option.alpha, option.tau_col, option.tau_grad,
+										   pms_util::ResolveSimdLevel(option.simd_level), packed_left, packed_right);
+			break;
+		}
+		auto* cost_cpt_t = dynamic_cast<CostT*>(cost_cpt);
+		if (!cost_cpt_t) {
+			delete cost_cpt;
+		}
+		return cost_cpt_t;
+	}
+
+	/**
+	 * @brief 计算聚合代价, 已知具体代价类型时直接调用(可内联), 不经虚函数表
+	 * @param cost_cpt		代价计算类对象
+	 * @param x				p点x坐标
+	 * @param y 			p点y坐标
+	 * @param plane			视差平面
+	 * @param upper_bound	代价上界, 不提前终止时为Invalid_Float
+	 * @return float32		聚合代价值, 或不小于上界的部分和
+	 */
+	template <class CostT>
+	inline float32 AggregateCost(const CostT* cost_cpt, const sint32& x, const sint32& y,
+								 const DisparityPlane& plane, const float32& upper_bound)
+	{
+		return cost_cpt->CostT::ComputeA(x, y, plane, upper_bound);
+	}
+
+	// 基类只能经虚函数调用, 自定义的代价计算子类走此路径
+	template <>
+	inline float32 AggregateCost<CostComputer>(const CostComputer* cost_cpt, const sint32& x, const sint32& y,
+											   const DisparityPlane& plane, const float32& upper_bound)
+	{
+		return cost_cpt->ComputeA(x, y, plane, upper_bound);
+	}
+
+	/**
+	 * @brief 批量计算p点在多个候选平面下的聚合代价, 调用方式同AggregateCost
+	 * @param cost_cpt		代价计算类对象
+	 * @param x				p点x坐标
+	 * @param y 			p点y坐标
+	 * @param planes		候选平面数组
+	 * @param num			候选平面个数
+	 * @param costs			输出, 各候选的聚合代价值, 或不小于上界的部分和
+	 * @param upper_bound	代价上界, 不提前终止时为Invalid_Float
+	 */
+	template <class CostT>
+	inline void AggregateCostBatch(const CostT* cost_cpt, const sint32& x, const sint32& y,
+								   const DisparityPlane* planes, const sint32& num, float32* costs,
+								   const float32& upper_bound)
+	{
+		cost_cpt->CostT::ComputeABatch(x, y, planes, num, costs, upper_bound);
+	}
+
+	template <>
+	inline void AggregateCostBatch<CostComputer>(const CostComputer* cost_cpt, const sint32& x, const sint32& y,
+												 const DisparityPlane* planes, const sint32& num, float32* costs,
+												 const float32& upper_bound)
+	{
+		cost_cpt->ComputeABatch(x, y, planes, num, costs, upper_bound);
+	}
+}
+
+PMSViewMailbox::PMSViewMailbox(const sint32& height) :
+							   rows_(std::max(height, 0)), locks_(std::max(height, 0)) {}
+
+void PMSViewMailbox::Post(const sint32& x, const sint32& y, const DisparityPlane& plane)
+{
+	std::lock_guard<std::mutex> lock(locks_[y]);
+	rows_[y].emplace_back(x, plane);
+}
+
+void PMSViewMailbox::Take(const sint32& y, vector<pair<sint32, DisparityPlane>>& out)
+{
+	out.clear();
+	std::lock_guard<std::mutex> lock(locks_[y]);
+	out.swap(rows_[y]);
+}
+
+template <class CostT, bool kFrontoPW, bool kIntDisp>
+PMSPropagation<CostT, kFrontoPW, kIntDisp>::PMSPropagation(const sint32 width, const sint32 height,
+							   const PImageView& img_left, const PImageView& img_right,
 							   const PGradient* grad_left, const PGradient* grad_right,
-							   DisparityPlane* plane_left, DisparityPlane* plane_right,
+							   PPlaneStore* plane_left, PPlaneStore* plane_right,
 							   const PMSOption& option, 
-							   float32* cost_left, float32* cost_right,
-							   float32* disparity_map) :
-							   cost_cpt_left_(nullptr), cost_cpt_right_(nullptr),
+							   PCostStore* cost_left, PCostStore* cost_right,
+							   float32* disparity_map,
+							   const PMSPackedImage* packed_left, const PMSPackedImage* packed_right,
+							   const PMSCensusImage* census_left, const PMSCensusImage* census_right,
+							   PMSThreadPool* thread_pool) :
+							   cost_cpt_left_(nullptr), cost_cpt_right_(nullptr), weight_cache_(nullptr), sample_pattern_(nullptr),
+							   thread_pool_(thread_pool), inbox_(nullptr), outbox_(nullptr),
 							   width_(width), height_(height), num_iter_(0),
 							   img_left_(img_left), img_right_(img_right),
 							   grad_left_(grad_left), grad_right_(grad_right),
 							   plane_left_(plane_left), plane_right_(plane_right),
 							   cost_left_(cost_left), cost_right_(cost_right),
-							   disparity_map_(disparity_map)
+							   disparity_map_(disparity_map),
+							   stamp_left_(nullptr), stamp_right_(nullptr), num_active_(0),
+							   seed_(option.seed), refine_radius_(0.0f)
 {
 	// 代价计算类对象
-	cost_cpt_left_ = new CostComputerPMS(img_left, img_right,
-										 grad_left, grad_right,
-										 width, height, option.patch_size,
-										 option.min_disparity, option.max_disparity,
-										 option.gamma, option.alpha,
-										 option.tau_col, option.tau_grad);
-	cost_cpt_right_ = new CostComputerPMS(img_right, img_left,
-										  grad_right, grad_left,
-										  width, height, option.patch_size,
-										  -option.max_disparity, -option.min_disparity,
-										  option.gamma, option.alpha,
-										  option.tau_col, option.tau_grad);
+	cost_cpt_left_ = CreateCostComputer<CostT>(option, img_left, img_right, grad_left, grad_right,
+											   width, height, option.min_disparity, option.max_disparity,
+											   packed_left, packed_right, census_left, census_right);
+	if (!option.is_left_view_only) {
+		cost_cpt_right_ = CreateCostComputer<CostT>(option, img_right, img_left, grad_right, grad_left,
+													width, height, -option.max_disparity, -option.min_disparity,
+													packed_right, packed_left, census_right, census_left);
+	}
 	option_ = option;
+	if (!cost_cpt_left_ || (!cost_cpt_right_ && !option.is_left_view_only)) {
+		return;
+	}
+
+	// 本视图的支持权值缓存
+	if (option.is_use_weight_cache) {
+		const uint64 budget = static_cast<uint64>(std::max(option.weight_cache_mb, 0)) * 1024 * 1024 / 2;
+		weight_cache_ = new PMSWeightCache(img_left, option.patch_size, option.gamma,
+										   budget, option.is_lazy_weight_cache,
+										   option.is_early_termination && option.is_weighted_row_order);
+		// 未预先计算全图的缓存在访问时会计算和淘汰分块, 多线程时不使用
+		if (thread_pool_ && !weight_cache_->IsResident()) {
+			delete weight_cache_;
+			weight_cache_ = nullptr;
+		}
+		cost_cpt_left_->SetWeightCache(weight_cache_);
+	}
+
+	// 提前终止时优先聚合权值大的行
+	if (option.is_early_termination && option.is_weighted_row_order) {
+		cost_cpt_left_->SetWeightedRowOrder(true);
+		if (cost_cpt_right_) cost_cpt_right_->SetWeightedRowOrder(true);
+	}
+
+	// 聚合窗口的采样模式, 左右视图共用
+	if (option.sample_pattern != SamplePattern::FULL) {
+		sample_pattern_ = new PMSSamplePattern(option.patch_size, option.sample_pattern, option.sample_stride);
+		cost_cpt_left_->SetSamplePattern(sample_pattern_);
+		if (cost_cpt_right_) cost_cpt_right_->SetSamplePattern(sample_pattern_);
+	}
 
-	// 视差/法线的随机数生成器
-	rand_disp_ = new std::uniform_real_distribution<float32>(-1.0f, 1.0f);
-	rand_norm_ = new std::uniform_real_distribution<float32>(-1.0f, 1.0f);
+	// 未设置种子时每次运行取一个随机种子
+	if (seed_ == 0) {
+		seed_ = std::random_device()();
+	}
 
 	// 计算初始代价数据
 	ComputeCostData();
 }
 
-PMSPropagation::~PMSPropagation()
+template <class CostT, bool kFrontoPW, bool kIntDisp>
+PMSPropagation<CostT, kFrontoPW, kIntDisp>::~PMSPropagation()
 {
 	if(cost_cpt_left_) {
 		delete cost_cpt_left_;
@@ -56,22 +219,41 @@ PMSPropagation::~PMSPropagation()
 		delete cost_cpt_right_;
 		cost_cpt_right_ = nullptr;
 	}
-	if (rand_disp_) {
-		delete rand_disp_;
-		rand_disp_ = nullptr;
+	if (weight_cache_) {
+		delete weight_cache_;
+		weight_cache_ = nullptr;
 	}
-	if (rand_norm_) {
-		delete rand_norm_;
-		rand_norm_ = nullptr;
+	if (sample_pattern_) {
+		delete sample_pattern_;
+		sample_pattern_ = nullptr;
 	}
 }
 
-void PMSPropagation::DoPropagation()
+template <class CostT, bool kFrontoPW, bool kIntDisp>
+void PMSPropagation<CostT, kFrontoPW, kIntDisp>::DoPropagation()
 {
-	if(!cost_cpt_left_ || !cost_cpt_right_ || \
-	   !img_left_ || !img_right_ || !grad_left_ || !grad_right_ || \
+	if(!cost_cpt_left_ || (!cost_cpt_right_ && !option_.is_left_view_only) || \
+	   !img_left_.IsValid() || !img_right_.IsValid() || !grad_left_ || !grad_right_ || \
 	   !cost_left_ || !plane_left_ || !plane_right_ || \
-	   !disparity_map_ || !rand_disp_ || !rand_norm_) {
+	   !disparity_map_) {
+		return;
+	}
+	num_active_.store(0);
+
+	if (option_.propagation_mode == PropagationMode::RED_BLACK) {
+		DoPropagationRedBlack();
+		++num_iter_;
+		return;
+	}
+	if (option_.propagation_mode == PropagationMode::WAVEFRONT && thread_pool_) {
+		DoPropagationWavefront();
+		++num_iter_;
+		return;
+	}
+	// 分块之间的视图传播须经信箱传递, 只计算左视图时没有视图传播
+	if (option_.propagation_mode == PropagationMode::TILED && thread_pool_ && (outbox_ || !cost_cpt_right_)) {
+		DoPropagationTiles();
+		++num_iter_;
 		return;
 	}
 
@@ -80,86 +262,396 @@ void PMSPropagation::DoPropagation()
 	const sint32 dir = (num_iter_%2==0) ? 1 : -1;
 	sint32 y = (dir == 1) ? 0 : height_ - 1;
 
+	sint32 num_active = 0;
 	for (sint32 i = 0; i < height_; i++) {
+		// 先处理另一视图投递到本行的候选
+		if (inbox_) DrainViewMailboxRow(y);
 		sint32 x = (dir == 1) ? 0 : width_ - 1;
 		for (sint32 j = 0; j < width_; j++) {
+			// 活跃集模式下跳过自身及邻域平面都未变化的像素
+			const bool active = IsActive(x, y, 1);
+			num_active += active;
 			// 空间传播
-			SpatialPropagation(x, y, dir);
+			if (active) SpatialPropagation(x, y, dir);
 			// 平面优化
-			if (!option_.is_fource_fpw) PlaneRefine(x, y);
+			if (!kFrontoPW && (active || IsRefineSampled(x, y))) PlaneRefine(x, y);
 			// 视图传播
-			ViewPropagation(x, y);
+			if (IsChanged(x, y)) ViewPropagation(x, y);
 			x += dir;
 		}
 		y += dir;
 	}
+	num_active_.store(num_active);
 	++num_iter_;
 }
 
-void PMSPropagation::ComputeCostData() const
+template <class CostT, bool kFrontoPW, bool kIntDisp>
+void PMSPropagation<CostT, kFrontoPW, kIntDisp>::DoPropagationRedBlack()
+{
+	for (sint32 phase = 0; phase < 2; phase++) {
+		// 同一相位的像素互不依赖, 按行分配给各线程
+		const auto update_row = [this, phase](sint32 y) {
+			sint32 num_active = 0;
+			for (sint32 x = (y + phase) % 2; x < width_; x += 2) {
+				// 活跃集模式下跳过自身及候选邻域平面都未变化的像素
+				const bool active = IsActive(x, y, 5);
+				num_active += active;
+				// 空间传播
+				if (active) RedBlackSpatialPropagation(x, y);
+				// 平面优化
+				if (!kFrontoPW && (active || IsRefineSampled(x, y))) PlaneRefine(x, y);
+				// 视图传播
+				if (IsChanged(x, y)) ViewPropagation(x, y);
+			}
+			num_active_ += num_active;
+		};
+		if (thread_pool_) {
+			thread_pool_->ParallelFor(height_, update_row);
+		}
+		else {
+			for (sint32 y = 0; y < height_; y++) {
+				update_row(y);
+			}
+		}
+	}
+}
+
+template <class CostT, bool kFrontoPW, bool kIntDisp>
+void PMSPropagation<CostT, kFrontoPW, kIntDisp>::DoPropagationWavefront()
+{
+	// 扫描方向同DoPropagation
+	const sint32 dir = (num_iter_ % 2 == 0) ? 1 : -1;
+
+	// 每行已完成的像素数, 按扫描顺序计
+	vector<std::atomic<sint32>> progress(height_);
+	for (auto& done : progress) {
+		done.store(0, std::memory_order_relaxed);
+	}
+
+	// 任务按扫描顺序领取, 第i个任务依赖的第i-1行总是已被领取, 不会死锁
+	const auto sweep_row = [this, dir, &progress](sint32 i) {
+		const sint32 y = (dir == 1) ? i : height_ - 1 - i;
+		sint32 x = (dir == 1) ? 0 : width_ - 1;
+		sint32 num_active = 0;
+		for (sint32 j = 0; j < width_; j++) {
+			// 等待上一行完成同一列, 即p的上(下)侧邻域已更新
+			if (i > 0) {
+				while (progress[i - 1].load(std::memory_order_acquire) <= j) {
+					std::this_thread::yield();
+				}
+			}
+			// 活跃集模式下跳过自身及邻域平面都未变化的像素
+			const bool active = IsActive(x, y, 1);
+			num_active += active;
+			// 空间传播
+			if (active) SpatialPropagation(x, y, dir);
+			// 平面优化
+			if (!kFrontoPW && (active || IsRefineSampled(x, y))) PlaneRefine(x, y);
+			// 视图传播, 只写入右视图的同一行
+			if (IsChanged(x, y)) ViewPropagation(x, y);
+			progress[i].store(j + 1, std::memory_order_release);
+			x += dir;
+		}
+		num_active_ += num_active;
+	};
+	thread_pool_->ParallelFor(height_, sweep_row);
+}
+
+template <class CostT, bool kFrontoPW, bool kIntDisp>
+void PMSPropagation<CostT, kFrontoPW, kIntDisp>::DoPropagationTiles()
+{
+	// 划分分块
+	if (tiles_.empty()) {
+		const sint32 size = std::max(option_.tile_size, 1);
+		for (sint32 ty = 0; ty < height_; ty += size) {
+			for (sint32 tx = 0; tx < width_; tx += size) {
+				PTileTiming tile;
+				tile.x = tx;
+				tile.y = ty;
+				tile.width = std::min(size, width_ - tx);
+				tile.height = std::min(size, height_ - ty);
+				tiles_.push_back(tile);
+			}
+		}
+	}
+
+	// 处理另一视图上次迭代投递的候选, 然后保存平面快照(交换块边界)
+	DrainViewMailbox();
+	plane_halo_.assign(plane_left_, plane_left_ + width_ * height_);
+
+	// 扫描方向同DoPropagation
+	const sint32 dir = (num_iter_ % 2 == 0) ? 1 : -1;
+	const auto sweep_tile = [this, dir](sint32 t) {
+		auto& tile = tiles_[t];
+		const auto start = std::chrono::steady_clock::now();
+		sint32 y = (dir == 1) ? tile.y : tile.y + tile.height - 1;
+		sint32 num_active = 0;
+		for (sint32 i = 0; i < tile.height; i++) {
+			sint32 x = (dir == 1) ? tile.x : tile.x + tile.width - 1;
+			for (sint32 j = 0; j < tile.width; j++) {
+				// 活跃集模式下跳过自身及邻域平面都未变化的像素
+				const bool active = IsActive(x, y, 1, &tile);
+				num_active += active;
+				// 空间传播
+				if (active) SpatialPropagation(x, y, dir, &tile);
+				// 平面优化
+				if (!kFrontoPW && (active || IsRefineSampled(x, y))) PlaneRefine(x, y);
+				// 视图传播
+				if (IsChanged(x, y)) ViewPropagation(x, y);
+				x += dir;
+			}
+			y += dir;
+		}
+		num_active_ += num_active;
+		tile.seconds += std::chrono::duration<float64>(std::chrono::steady_clock::now() - start).count();
+	};
+	thread_pool_->ParallelFor(static_cast<sint32>(tiles_.size()), sweep_tile);
+}
+
+template <class CostT, bool kFrontoPW, bool kIntDisp>
+void PMSPropagation<CostT, kFrontoPW, kIntDisp>::ShareWeightCache(const PMSPropagation& other) const
+{
+	if (cost_cpt_right_) {
+		cost_cpt_right_->SetWeightCache(other.weight_cache_);
+	}
+}
+
+template <class CostT, bool kFrontoPW, bool kIntDisp>
+void PMSPropagation<CostT, kFrontoPW, kIntDisp>::SetViewMailboxes(PMSViewMailbox* inbox, PMSViewMailbox* outbox)
+{
+	inbox_ = inbox;
+	outbox_ = outbox;
+}
+
+template <class CostT, bool kFrontoPW, bool kIntDisp>
+void PMSPropagation<CostT, kFrontoPW, kIntDisp>::SetActiveSet(sint32* stamp_left, sint32* stamp_right)
+{
+	stamp_left_ = stamp_left;
+	stamp_right_ = stamp_right;
+}
+
+template <class CostT, bool kFrontoPW, bool kIntDisp>
+bool PMSPropagation<CostT, kFrontoPW, kIntDisp>::IsActive(const sint32& x, const sint32& y, const sint32& reach,
+														  const PTileTiming* tile) const
+{
+	if (!stamp_left_) {
+		return true;
+	}
+	// 上一次迭代开始以来有变化
+	const sint32 since = num_iter_ - 1;
+	if (stamp_left_[y * width_ + x] >= since) {
+		return true;
+	}
+	const sint32 dists[2] = { 1, reach };
+	const sint32 num_dists = (reach > 1) ? 2 : 1;
+	for (sint32 k = 0; k < num_dists; k++) {
+		const sint32 offsets[4][2] = { {-dists[k], 0}, {dists[k], 0}, {0, -dists[k]}, {0, dists[k]} };
+		for (const auto& ofs : offsets) {
+			const sint32 xd = x + ofs[0];
+			const sint32 yd = y + ofs[1];
+			if (xd < 0 || xd >= width_ || yd < 0 || yd >= height_) {
+				continue;
+			}
+			if (tile && (xd < tile->x || xd >= tile->x + tile->width || yd < tile->y || yd >= tile->y + tile->height)) {
+				return true;
+			}
+			if (stamp_left_[yd * width_ + xd] >= since) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+template <class CostT, bool kFrontoPW, bool kIntDisp>
+bool PMSPropagation<CostT, kFrontoPW, kIntDisp>::IsRefineSampled(const sint32& x, const sint32& y) const
 {
-	if (!cost_cpt_left_ || !cost_cpt_right_ || \
-		!img_left_ || !img_right_ || !grad_left_ || !grad_right_ || \
+	// 与平面优化使用不同的随机数流
+	PMSRandom gen(pms_util::MixSeed(seed_, pms_util::SeedPurpose::ACTIVE_SAMPLE, num_iter_, x, y));
+	return gen.Uniform(0.0f, 1.0f) < option_.active_refine_ratio;
+}
+
+template <class CostT, bool kFrontoPW, bool kIntDisp>
+void PMSPropagation<CostT, kFrontoPW, kIntDisp>::DrainViewMailbox() const
+{
+	if (!inbox_ || !cost_cpt_left_ || !plane_left_ || !cost_left_) {
+		return;
+	}
+	// 各行的候选只涉及本行像素, 可按行并行
+	const auto drain_row = [this](sint32 y) { DrainViewMailboxRow(y); };
+	if (thread_pool_) {
+		thread_pool_->ParallelFor(height_, drain_row);
+	}
+	else {
+		for (sint32 y = 0; y < height_; y++) {
+			drain_row(y);
+		}
+	}
+}
+
+template <class CostT, bool kFrontoPW, bool kIntDisp>
+void PMSPropagation<CostT, kFrontoPW, kIntDisp>::DrainViewMailboxRow(const sint32& y) const
+{
+	// 每个线程复用自己的候选缓冲
+	static thread_local vector<pair<sint32, DisparityPlane>> letters;
+	inbox_->Take(y, letters);
+
+	auto* cost_cpt = cost_cpt_left_;
+	const bool bounded = option_.is_early_termination;
+	for (const auto& letter : letters) {
+		const sint32 x = letter.first;
+		const auto plane = PMSPlaneStore::Quantize(letter.second, x, y);
+		const auto plane_p = PMSPlaneStore::Load(plane_left_[y * width_ + x], x, y);
+		const auto cost_p = PMSPlaneStore::LoadCost(cost_left_[y * width_ + x]);
+		if (plane == plane_p) {
+			continue;
+		}
+		const auto cost = AggregateCost(cost_cpt, x, y, plane, bounded ? cost_p : Invalid_Float);
+		if (cost < cost_p) {
+			plane_left_[y * width_ + x] = PMSPlaneStore::Store(plane, x, y);
+			cost_left_[y * width_ + x] = PMSPlaneStore::StoreCost(cost);
+			if (stamp_left_) stamp_left_[y * width_ + x] = num_iter_;
+		}
+	}
+}
+
+template <class CostT, bool kFrontoPW, bool kIntDisp>
+void PMSPropagation<CostT, kFrontoPW, kIntDisp>::ComputeCostData() const
+{
+	if (!cost_cpt_left_ || (!cost_cpt_right_ && !option_.is_left_view_only) || \
+		!img_left_.IsValid() || !img_right_.IsValid() || !grad_left_ || !grad_right_ || \
 		!cost_left_ || !plane_left_ || !plane_right_ || \
-		!disparity_map_ || !rand_disp_ || !rand_norm_) {
+		!disparity_map_) {
 		return;
 	}
 
-	// 将一个基类对象指针(或引用)转换到继承类指针
-	auto* cost_cpt = dynamic_cast<CostComputerPMS*>(cost_cpt_left_);
-	for (sint32 y = 0; y < height_; y++) {
+	auto* cost_cpt = cost_cpt_left_;
+	const auto compute_row = [this, cost_cpt](sint32 y) {
 		for (sint32 x = 0; x < width_; x++) {
-			const auto& plane_p = plane_left_[y * width_ + x];
-			cost_left_[y * width_ + x] = cost_cpt->ComputeA(x, y, plane_p);
+			const auto plane_p = PMSPlaneStore::Load(plane_left_[y * width_ + x], x, y);
+			cost_left_[y * width_ + x] = PMSPlaneStore::StoreCost(AggregateCost(cost_cpt, x, y, plane_p, Invalid_Float));
+		}
+	};
+	if (thread_pool_) {
+		thread_pool_->ParallelFor(height_, compute_row);
+	}
+	else {
+		for (sint32 y = 0; y < height_; y++) {
+			compute_row(y);
 		}
 	}
 }
 
-void PMSPropagation::SpatialPropagation(const sint32& x, const sint32& y, const sint32& direction) const
+template <class CostT, bool kFrontoPW, bool kIntDisp>
+void PMSPropagation<CostT, kFrontoPW, kIntDisp>::SpatialPropagation(const sint32& x, const sint32& y, const sint32& direction,
+																	const PTileTiming* tile) const
 {
 	// 偶数次迭代从左上到右下传播
 	// 奇数次迭代从右下到左上传播
 	const sint32 dir = direction;
 
 	// 获取p当前的视差平面并计算代价
-	auto& plane_p = plane_left_[y * width_ + x];
-	auto& cost_p = cost_left_[y * width_ + x];
-	auto* cost_cpt = dynamic_cast<CostComputerPMS*>(cost_cpt_left_);
-
-	// 获取p左(右)侧像素的视差平面, 计算将平面分配给p时的代价, 取较小值
+	auto plane_p = PMSPlaneStore::Load(plane_left_[y * width_ + x], x, y);
+	auto cost_p = PMSPlaneStore::LoadCost(cost_left_[y * width_ + x]);
+	auto* cost_cpt = cost_cpt_left_;
+	const bool bounded = option_.is_early_termination;
+
+	// 候选为p左(右)侧和上(下)侧像素的视差平面, 一次遍历局部块计算两者分配给p时的代价
+	DisparityPlane planes[2];
+	sint32 num = 0;
 	const sint32 xd = x - dir;
 	if (xd >= 0 && xd < width_) {
-		auto& plane = plane_left_[y * width_ + xd];
+		// 分块传播时块外的邻域从快照读取
+		const bool outside = tile && (xd < tile->x || xd >= tile->x + tile->width);
+		const auto& stored = outside ? plane_halo_[y * width_ + xd] : plane_left_[y * width_ + xd];
+		const auto plane = PMSPlaneStore::Quantize(PMSPlaneStore::Load(stored, xd, y), x, y);
 		if (plane != plane_p) {
-			const auto cost = cost_cpt->ComputeA(x, y, plane);
-			if (cost < cost_p) {
-				plane_p = plane;
-				cost_p = cost;
-			}
+			planes[num++] = plane;
 		}
 	}
-
-	// 获取p上(下)侧像素的视差平面, 计算将平面分配给p时的代价, 取较小值
 	const sint32 yd = y - dir;
 	if (yd >= 0 && yd < height_) {
-		auto& plane = plane_left_[yd * width_ + x];
-		if (plane != plane_p) {
-			const auto cost = cost_cpt->ComputeA(x, y, plane);
-			if (cost < cost_p) {
-				plane_p = plane;
-				cost_p = cost;
-			}
+		const bool outside = tile && (yd < tile->y || yd >= tile->y + tile->height);
+		const auto& stored = outside ? plane_halo_[yd * width_ + x] : plane_left_[yd * width_ + x];
+		const auto plane = PMSPlaneStore::Quantize(PMSPlaneStore::Load(stored, x, yd), x, y);
+		if (plane != plane_p && (num == 0 || plane != planes[0])) {
+			planes[num++] = plane;
+		}
+	}
+	if (num == 0) {
+		return;
+	}
+
+	// 依次与当前最优代价比较, 取较小值
+	float32 costs[2];
+	AggregateCostBatch(cost_cpt, x, y, planes, num, costs, bounded ? cost_p : Invalid_Float);
+	for (sint32 h = 0; h < num; h++) {
+		if (costs[h] < cost_p) {
+			plane_p = planes[h];
+			cost_p = costs[h];
+			plane_left_[y * width_ + x] = PMSPlaneStore::Store(plane_p, x, y);
+			cost_left_[y * width_ + x] = PMSPlaneStore::StoreCost(cost_p);
+			if (stamp_left_) stamp_left_[y * width_ + x] = num_iter_;
+		}
+	}
+}
+
+template <class CostT, bool kFrontoPW, bool kIntDisp>
+void PMSPropagation<CostT, kFrontoPW, kIntDisp>::RedBlackSpatialPropagation(const sint32& x, const sint32& y) const
+{
+	// 候选邻域: 上下左右距离1和5的像素, 距离为奇数, 与p处于不同相位
+	static const sint32 offsets[8][2] = { {-1, 0}, {1, 0}, {0, -1}, {0, 1},
+										  {-5, 0}, {5, 0}, {0, -5}, {0, 5} };
+
+	auto plane_p = PMSPlaneStore::Load(plane_left_[y * width_ + x], x, y);
+	auto cost_p = PMSPlaneStore::LoadCost(cost_left_[y * width_ + x]);
+	auto* cost_cpt = cost_cpt_left_;
+	const bool bounded = option_.is_early_termination;
+
+	// 收集与p当前平面不同的候选, 一次遍历局部块计算全部候选的代价
+	DisparityPlane planes[8];
+	sint32 num = 0;
+	for (const auto& ofs : offsets) {
+		const sint32 xd = x + ofs[0];
+		const sint32 yd = y + ofs[1];
+		if (xd < 0 || xd >= width_ || yd < 0 || yd >= height_) {
+			continue;
+		}
+		const auto plane = PMSPlaneStore::Quantize(PMSPlaneStore::Load(plane_left_[yd * width_ + xd], xd, yd), x, y);
+		if (plane != plane_p && std::find(planes, planes + num, plane) == planes + num) {
+			planes[num++] = plane;
+		}
+	}
+	if (num == 0) {
+		return;
+	}
+
+	float32 costs[8];
+	AggregateCostBatch(cost_cpt, x, y, planes, num, costs, bounded ? cost_p : Invalid_Float);
+	for (sint32 h = 0; h < num; h++) {
+		if (costs[h] < cost_p) {
+			plane_p = planes[h];
+			cost_p = costs[h];
+			plane_left_[y * width_ + x] = PMSPlaneStore::Store(plane_p, x, y);
+			cost_left_[y * width_ + x] = PMSPlaneStore::StoreCost(cost_p);
+			if (stamp_left_) stamp_left_[y * width_ + x] = num_iter_;
 		}
 	}
 }
 
-void PMSPropagation::ViewPropagation(const sint32& x, const sint32& y) const
+template <class CostT, bool kFrontoPW, bool kIntDisp>
+void PMSPropagation<CostT, kFrontoPW, kIntDisp>::ViewPropagation(const sint32& x, const sint32& y) const
 {
+	// 只计算左视图时没有右视图
+	if (!cost_cpt_right_) {
+		return;
+	}
+
 	// 搜索p在右视图的同名点q, 更新q的平面
 	// 左视图匹配点p的位置及其视差平面 
 	const sint32 p = y * width_ + x;
-	const auto& plane_p = plane_left_[p];
-	auto* cost_cpt = dynamic_cast<CostComputerPMS*>(cost_cpt_right_);
+	const auto plane_p = PMSPlaneStore::Load(plane_left_[p], x, y);
+	auto* cost_cpt = cost_cpt_right_;
 
 	const float32 d_p = plane_p.to_disparity(x, y);
 
@@ -169,35 +661,39 @@ void PMSPropagation::ViewPropagation(const sint32& x, const sint32& y) const
 		return;
 	}
 
-	const sint32 q = y * width_ + xr;
-	auto& plane_q = plane_right_[q];
-	auto& cost_q = cost_right_[q];
-
 	// 将左视图的视差平面转换到右视图
 	const auto plane_p2q = plane_p.to_another_view(x, y);
-	const float32 d_q = plane_p2q.to_disparity(xr,y);
-	const auto cost = cost_cpt->ComputeA(xr, y, plane_p2q);
+
+	// 并发传播时投递给右视图, 由右视图的线程计算代价并择优替换
+	if (outbox_) {
+		outbox_->Post(xr, y, plane_p2q);
+		return;
+	}
+
+	const sint32 q = y * width_ + xr;
+	const auto plane_q = PMSPlaneStore::Quantize(plane_p2q, xr, y);
+	const auto cost_q = PMSPlaneStore::LoadCost(cost_right_[q]);
+	const auto cost = AggregateCost(cost_cpt, xr, y, plane_q, option_.is_early_termination ? cost_q : Invalid_Float);
 	if (cost < cost_q) {
-		plane_q = plane_p2q;
-		cost_q = cost;
+		plane_right_[q] = PMSPlaneStore::Store(plane_q, xr, y);
+		cost_right_[q] = PMSPlaneStore::StoreCost(cost);
+		if (stamp_right_) stamp_right_[q] = num_iter_;
 	}
 }
 
-void PMSPropagation::PlaneRefine(const sint32& x, const sint32& y) const
+template <class CostT, bool kFrontoPW, bool kIntDisp>
+void PMSPropagation<CostT, kFrontoPW, kIntDisp>::PlaneRefine(const sint32& x, const sint32& y) const
 {
 	const auto max_disp = static_cast<float32>(option_.max_disparity);
 	const auto min_disp = static_cast<float32>(option_.min_disparity);
 
-	// 随机数生成器
-	std::random_device rd;
-	std::mt19937 gen(rd());
-	auto& rand_d = *rand_disp_;
-	auto& rand_n = *rand_norm_;
+	// 随机数生成器, 由种子、迭代次数和像素位置确定, 与调度顺序无关
+	PMSRandom gen(pms_util::MixSeed(seed_, pms_util::SeedPurpose::REFINE, num_iter_, x, y));
 
 	// 像素p的平面/代价/视差/法线
-	auto& plane_p = plane_left_[y * width_ + x];
-	auto& cost_p = cost_left_[y * width_ + x];
-	auto* cost_cpt = dynamic_cast<CostComputerPMS*>(cost_cpt_left_);
+	auto plane_p = PMSPlaneStore::Load(plane_left_[y * width_ + x], x, y);
+	auto cost_p = PMSPlaneStore::LoadCost(cost_left_[y * width_ + x]);
+	auto* cost_cpt = cost_cpt_left_;
 
 	float32 d_p = plane_p.to_disparity(x, y);
 	PVector3f norm_p = plane_p.to_normal();
@@ -205,58 +701,102 @@ void PMSPropagation::PlaneRefine(const sint32& x, const sint32& y) const
 	float32 disp_update = (max_disp - min_disp) / 2.0f;
 	float32 norm_update = 1.0f;
 	const float32 stop_thres = 0.1f;
+	// 限定了扰动半径时跳过更大的扰动
+	while (refine_radius_ > 0.0f && disp_update > refine_radius_) {
+		disp_update /= 2.0f;
+		norm_update /= 2.0f;
+	}
+
+	const bool bounded = option_.is_early_termination;
 
-	// 迭代优化
+	// 迭代优化: 扰动范围逐次减半, 每批最多MAX_BATCH个候选, 同一批的候选都由批开始时的最优平面扰动得到,
+	// 一次遍历局部块计算整批候选的代价, 再依次择优
+	DisparityPlane planes[CostComputer::MAX_BATCH];
+	float32 disps[CostComputer::MAX_BATCH];
+	PVector3f norms[CostComputer::MAX_BATCH];
+	float32 costs[CostComputer::MAX_BATCH];
 	while (disp_update > stop_thres) {
-		// 在 -disp_update ~ disp_update 范围内随机一个视差增量
-		float32 disp_rd = rand_d(gen) * disp_update;
-		if (option_.is_integer_disp) {
-			disp_rd = static_cast<float32>(round(disp_rd));
-		}
+		sint32 num = 0;
+		while (disp_update > stop_thres && num < CostComputer::MAX_BATCH) {
+			// 在 -disp_update ~ disp_update 范围内随机一个视差增量
+			float32 disp_rd = gen.Uniform(-1.0f, 1.0f) * disp_update;
+			if (kIntDisp) {
+				disp_rd = static_cast<float32>(round(disp_rd));
+			}
 
-		// 计算像素p新的视差
-		const float32 d_p_new = d_p + disp_rd;
-		if (d_p_new < min_disp || d_p_new > max_disp) {
-			disp_update /= 2;
-			norm_update /= 2;
-			continue;
-		}
+			// 计算像素p新的视差
+			const float32 d_p_new = d_p + disp_rd;
+			if (d_p_new < min_disp || d_p_new > max_disp) {
+				disp_update /= 2;
+				norm_update /= 2;
+				continue;
+			}
 
-		// 在 -norm_update ~ norm_update 范围内随机三个值作为法线增量的三个分量
-		PVector3f norm_rd;
-		if (!option_.is_fource_fpw) {
-			norm_rd.x = rand_n(gen) * norm_update;
-			norm_rd.y = rand_n(gen) * norm_update;
-			float32 z = rand_n(gen) * norm_update;
-			while (z == 0.0f) {
-				z = rand_n(gen) * norm_update;
+			// 在 -norm_update ~ norm_update 范围内随机三个值作为法线增量的三个分量
+			PVector3f norm_rd;
+			if (!kFrontoPW) {
+				norm_rd.x = gen.Uniform(-1.0f, 1.0f) * norm_update;
+				norm_rd.y = gen.Uniform(-1.0f, 1.0f) * norm_update;
+				float32 z = gen.Uniform(-1.0f, 1.0f) * norm_update;
+				while (z == 0.0f) {
+					z = gen.Uniform(-1.0f, 1.0f) * norm_update;
+				}
+				norm_rd.z = z;
+			}
+			else {
+				norm_rd.x = 0.0f; norm_rd.y = 0.0f;	norm_rd.z = 0.0f;
 			}
-			norm_rd.z = z;
-		}
-		else {
-			norm_rd.x = 0.0f; norm_rd.y = 0.0f;	norm_rd.z = 0.0f;
-		}
 
-		// 计算像素p新的法线
-		auto norm_p_new = norm_p + norm_rd;
-		norm_p_new.normalize();
+			// 计算像素p新的法线
+			auto norm_p_new = norm_p + norm_rd;
+			norm_p_new.normalize();
+
+			// 计算新的视差平面
+			const auto plane_new = PMSPlaneStore::Quantize(DisparityPlane(x, y, norm_p_new, d_p_new), x, y);
+			if (plane_new != plane_p) {
+				planes[num] = plane_new;
+				disps[num] = d_p_new;
+				norms[num] = norm_p_new;
+				num++;
+			}
 
-		// 计算新的视差平面
-		auto plane_new = DisparityPlane(x, y, norm_p_new, d_p_new);
+			disp_update /= 2.0f;
+			norm_update /= 2.0f;
+		}
+		if (num == 0) {
+			continue;
+		}
 
 		// 比较Cost
-		if (plane_new != plane_p) {
-			const float32 cost = cost_cpt->ComputeA(x, y, plane_new);
-
-			if (cost < cost_p) {
-				plane_p = plane_new;
-				cost_p = cost;
-				d_p = d_p_new;
-				norm_p = norm_p_new;
+		AggregateCostBatch(cost_cpt, x, y, planes, num, costs, bounded ? cost_p : Invalid_Float);
+		for (sint32 h = 0; h < num; h++) {
+			if (costs[h] < cost_p) {
+				plane_p = planes[h];
+				cost_p = costs[h];
+				d_p = disps[h];
+				norm_p = norms[h];
+				plane_left_[y * width_ + x] = PMSPlaneStore::Store(plane_p, x, y);
+				cost_left_[y * width_ + x] = PMSPlaneStore::StoreCost(cost_p);
+				if (stamp_left_) stamp_left_[y * width_ + x] = num_iter_;
 			}
 		}
-
-		disp_update /= 2.0f;
-		norm_update /= 2.0f;
 	}
 }
+
+// 显式实例化, 由PatchMatchStereo::Propagation按代价类型及参数选择
+template class PMSPropagation<CostComputerPMS, false, false>;
+template class PMSPropagation<CostComputerPMS, false, true>;
+template class PMSPropagation<CostComputerPMS, true, false>;
+template class PMSPropagation<CostComputerPMS, true, true>;
+template class PMSPropagation<CostComputerPMSFixed, false, false>;
+template class PMSPropagation<CostComputerPMSFixed, false, true>;
+template class PMSPropagation<CostComputerPMSFixed, true, false>;
+template class PMSPropagation<CostComputerPMSFixed, true, true>;
+template class PMSPropagation<CostComputerCensus, false, false>;
+template class PMSPropagation<CostComputerCensus, false, true>;
+template class PMSPropagation<CostComputerCensus, true, false>;
+template class PMSPropagation<CostComputerCensus, true, true>;
+template class PMSPropagation<CostComputer, false, false>;
+template class PMSPropagation<CostComputer, false, true>;
+template class PMSPropagation<CostComputer, true, false>;
+template class PMSPropagation<CostComputer, true, true>;
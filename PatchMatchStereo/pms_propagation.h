@@ -8,58 +8,218 @@
 #define PATCH_MATCH_STEREO_PROPAGATION_H_
 #include "pms_types.h"
 #include "cost_computor.hpp"
-#include <random>
+#include "pms_thread_pool.h"
+#include <mutex>
+#include "pms_random.h"
+#include "pms_plane_store.h"
+
+
+/**
+ * @brief 视图传播的跨视图信箱
+ * 两个视图并发传播时, 视图传播不直接写另一视图的平面/代价, 而是按行投递候选平面,
+ * 由该视图的传播线程在处理到对应行时取出, 计算代价并择优替换. 每行一个互斥锁, 只在投递/取出时短暂持有
+ */
+class PMSViewMailbox final {
+public:
+	/**
+	 * @brief 构造信箱
+	 * @param height	图像高, 即行数
+	 */
+	explicit PMSViewMailbox(const sint32& height);
+	~PMSViewMailbox() = default;
+
+	/**
+	 * @brief 投递候选平面
+	 * @param x			目标像素x坐标
+	 * @param y			目标像素y坐标
+	 * @param plane		候选平面(已转换到目标视图)
+	 */
+	void Post(const sint32& x, const sint32& y, const DisparityPlane& plane);
+
+	/**
+	 * @brief 取出第y行的全部候选
+	 * @param y			行号
+	 * @param out		输出, 候选像素的x坐标及平面, 原内容被替换
+	 */
+	void Take(const sint32& y, vector<pair<sint32, DisparityPlane>>& out);
+
+private:
+	vector<vector<pair<sint32, DisparityPlane>>> rows_;
+	vector<std::mutex> locks_;
+};
 
 
 /**
  * @brief 传播类
  * final 禁止被继承
+ * 代价计算类型和传播策略都是模板参数, 逐像素的代价调用和参数判断在编译期确定.
+ * 实例由PatchMatchStereo::Propagation按参数选择, 见pms_propagation.cpp末尾的显式实例化
+ * @tparam CostT		代价计算类. 为CostComputer时经虚函数调用, 可用于任意自定义的代价计算子类
+ * @tparam kFrontoPW	是否强制为前端平行窗口(不做平面优化)
+ * @tparam kIntDisp		是否为整数视差
  */
+template <class CostT, bool kFrontoPW, bool kIntDisp>
 class PMSPropagation final{
 public:
 	/**
 	 * @brief PMSPropagation带参数构造方法
 	 * @param width 			图像宽
 	 * @param height 			图像高
-	 * @param img_left 			左图像数据
-	 * @param img_right 		右图像数据
+	 * @param img_left 			左图像视图
+	 * @param img_right 		右图像视图
 	 * @param grad_left 		左图像梯度数据
 	 * @param grad_right 		右图像梯度数据
-	 * @param plane_left 		左图像平面数据
-	 * @param plane_right 		右图像平面数据
+	 * @param plane_left 		左图像平面数据(存储编码见PMSPlaneStore)
+	 * @param plane_right 		右图像平面数据(存储编码见PMSPlaneStore)
 	 * @param option 			PMS算法参数
-	 * @param cost_left 		左图像代价数据
-	 * @param cost_right 		右图像代价数据
+	 * @param cost_left 		左图像代价数据(存储编码见PMSPlaneStore)
+	 * @param cost_right 		右图像代价数据(存储编码见PMSPlaneStore)
 	 * @param disparity_map 	视差数据
+	 * @param packed_left 		左图像打包数据(颜色+梯度), 为空时由代价计算类自行构建
+	 * @param packed_right 		右图像打包数据(颜色+梯度), 为空时由代价计算类自行构建
+	 * @param census_left 		左图像census数据, 仅census代价使用, 为空时由代价计算类自行构建
+	 * @param census_right 		右图像census数据, 仅census代价使用, 为空时由代价计算类自行构建
+	 * @param thread_pool 		并行模式(RED_BLACK/WAVEFRONT/TILED)使用的线程池, 为空时单线程执行
 	 */
 	PMSPropagation(const sint32 width, const sint32 height,
-					const uint8* img_left, const uint8* img_right,
+					const PImageView& img_left, const PImageView& img_right,
 					const PGradient* grad_left, const PGradient* grad_right,
-					DisparityPlane* plane_left, DisparityPlane* plane_right,
+					PPlaneStore* plane_left, PPlaneStore* plane_right,
 					const PMSOption& option,
-					float32* cost_left, float32* cost_right,
-					float32* disparity_map);
+					PCostStore* cost_left, PCostStore* cost_right,
+					float32* disparity_map,
+					const PMSPackedImage* packed_left = nullptr,
+					const PMSPackedImage* packed_right = nullptr,
+					const PMSCensusImage* census_left = nullptr,
+					const PMSCensusImage* census_right = nullptr,
+					PMSThreadPool* thread_pool = nullptr);
 
 	~PMSPropagation();
 
 public:
-	// 执行传播一次
+	// 执行传播一次, 按option.propagation_mode选择调度方式
 	void DoPropagation();
 
+	/**
+	 * @brief 视图传播使用另一视图传播实例构建的权值缓存, 两个视图的权值各自只计算一次
+	 * @param other 另一视图的传播实例
+	 */
+	void ShareWeightCache(const PMSPropagation& other) const;
+
+	/**
+	 * @brief 设置跨视图信箱, 用于两个视图在不同线程上并发传播(SEQUENTIAL调度)及分块传播(TILED调度)
+	 * 设置后视图传播向outbox投递候选; 顺序扫描到每一行时先处理inbox中该行的候选, 分块传播在每次迭代开始时处理全部候选
+	 * @param inbox		本视图的信箱
+	 * @param outbox	另一视图的信箱
+	 */
+	void SetViewMailboxes(PMSViewMailbox* inbox, PMSViewMailbox* outbox);
+
+	// 处理inbox中所有行的候选, 两个视图的传播都结束后调用, 使最后投递的候选生效
+	void DrainViewMailbox() const;
+
+	/**
+	 * @brief 获取分块传播各块的范围及累计耗时, 未使用TILED调度时为空
+	 * @return const vector<PTileTiming>&	按行优先排列的分块, view字段为0
+	 */
+	const vector<PTileTiming>& GetTileTimings() const { return tiles_; }
+
+	/**
+	 * @brief 启用活跃集, 记录每个像素平面最近一次变化的迭代序号
+	 * 两个视图共用同一对数组(本视图的stamp_left即另一视图的stamp_right), 初值为-1, 即随机初始化视为第-1次迭代的变化
+	 * @param stamp_left	本视图各像素平面最近变化的迭代序号
+	 * @param stamp_right	另一视图各像素平面最近变化的迭代序号
+	 */
+	void SetActiveSet(sint32* stamp_left, sint32* stamp_right);
+
+	// 最近一次传播中参与空间传播的像素数, 未启用活跃集时为全部像素
+	sint32 NumActive() const { return num_active_.load(); }
+
+	/**
+	 * @brief 设置平面优化的初始视差扰动半径, 用于由较粗金字塔层初始化的平面, 只需在小范围内优化
+	 * 扰动序列与默认相同(视差和法线扰动同步减半), 只是跳过视差扰动大于该半径的部分
+	 * @param radius	视差扰动半径, 不大于0时为视差范围的一半(默认)
+	 */
+	void SetRefineRadius(const float32& radius) { refine_radius_ = radius; }
+
 private:
 	// 计算代价数据
 	void ComputeCostData() const;
 
+	/**
+	 * @brief 棋盘格(red-black)传播一次
+	 * 像素按(x+y)的奇偶分为两个相位, 依次更新. 候选平面取自上下左右奇数距离的邻域, 与本像素相位不同,
+	 * 因此同一相位内的像素互不依赖; 视图传播只写入右视图的同一行, 按行并行时也无冲突
+	 */
+	void DoPropagationRedBlack();
+
+	/**
+	 * @brief 行流水并行的顺序传播一次, 扫描顺序及结果与单线程的DoPropagation相同
+	 * 像素只依赖同一行的前一个像素和上一行(逆向扫描时为下一行)的同一列, 各行由不同线程执行,
+	 * 每个像素开始前等待上一行完成同一列; 视图传播只写入右视图的同一行, 各行互不影响
+	 */
+	void DoPropagationWavefront();
+
+	/**
+	 * @brief 分块并行传播一次
+	 * 各块在块内按DoPropagation的顺序扫描, 由不同线程执行. 聚合只读取图像数据, 各块无需复制图像;
+	 * 块外的邻域平面(一个像素宽的外圈)取自迭代开始时的快照, 块之间只在迭代之间交换边界平面.
+	 * 视图传播经信箱投递, 需先设置信箱
+	 */
+	void DoPropagationTiles();
+
 	/**
 	 * @brief 空间传播
 	 * @param x 像素x坐标
 	 * @param y 像素y坐标
 	 * @param direction 传播方向
+	 * @param tile 所在分块, 非空时块外的邻域平面从快照读取
+	 */
+	void SpatialPropagation(const sint32& x, const sint32& y, const sint32& direction,
+							const PTileTiming* tile = nullptr) const;
+
+	/**
+	 * @brief 棋盘格模式的空间传播, 候选为四个方向距离1和5的邻域像素平面
+	 * @param x 像素x坐标
+	 * @param y 像素y坐标
+	 */
+	void RedBlackSpatialPropagation(const sint32& x, const sint32& y) const;
+
+	/**
+	 * @brief 判断像素是否活跃, 即自身或候选邻域的平面在上一次迭代以来有变化. 未启用活跃集时总是活跃
+	 * @param x 像素x坐标
+	 * @param y 像素y坐标
+	 * @param reach 候选邻域的最大距离, 检查上下左右距离1及reach的邻域
+	 * @param tile 所在分块, 非空时邻域在块外即视为活跃(块外的记录可能正被其他线程写入)
+	 * @return bool 是否活跃
 	 */
-	void SpatialPropagation(const sint32& x, const sint32& y, const sint32& direction) const;
+	bool IsActive(const sint32& x, const sint32& y, const sint32& reach, const PTileTiming* tile = nullptr) const;
+
+	/**
+	 * @brief 判断非活跃像素是否仍做平面优化, 按active_refine_ratio随机抽取, 与调度顺序无关
+	 * @param x 像素x坐标
+	 * @param y 像素y坐标
+	 * @return bool 是否做平面优化
+	 */
+	bool IsRefineSampled(const sint32& x, const sint32& y) const;
+
+	/**
+	 * @brief 判断像素的平面在上一次迭代以来是否有变化, 有变化时才需做视图传播. 未启用活跃集时总是返回true
+	 * @param x 像素x坐标
+	 * @param y 像素y坐标
+	 * @return bool 是否有变化
+	 */
+	bool IsChanged(const sint32& x, const sint32& y) const {
+		return !stamp_left_ || stamp_left_[y * width_ + x] >= num_iter_ - 1;
+	}
+
+	/**
+	 * @brief 处理inbox中第y行的候选平面, 代价更低时替换
+	 * @param y 行号
+	 */
+	void DrainViewMailboxRow(const sint32& y) const;
 	
 	/**
-	 * @brief 视图传播
+	 * @brief 视图传播, 只计算左视图时不做
 	 * @param x 像素x坐标
 	 * @param y 像素y坐标
 	 */
@@ -72,9 +232,24 @@ private:
 	 */
 	void PlaneRefine(const sint32& x, const sint32& y) const;
 private:
-	// 代价计算类对象
-	CostComputer* cost_cpt_left_;
-	CostComputer* cost_cpt_right_;
+	// 代价计算类对象, 右视图的用于视图传播, 只计算左视图(option.is_left_view_only)时为空
+	CostT* cost_cpt_left_;
+	CostT* cost_cpt_right_;
+
+	// 本视图(左图像)的支持权值缓存, 未启用时为空
+	PMSWeightCache* weight_cache_;
+	// 聚合窗口的采样模式, 全采样时为空
+	PMSSamplePattern* sample_pattern_;
+	// 线程池, 不由本类释放, 为空时单线程执行
+	PMSThreadPool* thread_pool_;
+	// 跨视图信箱, 不由本类释放, 为空时视图传播直接写另一视图
+	PMSViewMailbox* inbox_;
+	PMSViewMailbox* outbox_;
+
+	// 分块传播的分块及累计耗时
+	vector<PTileTiming> tiles_;
+	// 分块传播时迭代开始的平面快照, 供读取块外邻域
+	vector<PPlaneStore> plane_halo_;
 
 	PMSOption option_;
 	// 传播迭代次数
@@ -83,23 +258,31 @@ private:
 	sint32 width_;  
 	sint32 height_;
 
-	const uint8* img_left_;
-	const uint8* img_right_;
+	PImageView img_left_;
+	PImageView img_right_;
 
 	const PGradient* grad_left_;
 	const PGradient* grad_right_;
 
-	DisparityPlane* plane_left_;
-	DisparityPlane* plane_right_;
+	PPlaneStore* plane_left_;
+	PPlaneStore* plane_right_;
 
-	float32* cost_left_;
-	float32* cost_right_;
+	PCostStore* cost_left_;
+	PCostStore* cost_right_;
 
 	float32* disparity_map_;
 
-	// 视差/法线的随机数生成器
-	std::uniform_real_distribution<float32>* rand_disp_;
-	std::uniform_real_distribution<float32>* rand_norm_;
+	// 活跃集: 左右视图各像素平面最近变化的迭代序号, 未启用时为空
+	sint32* stamp_left_;
+	sint32* stamp_right_;
+	// 最近一次传播的活跃像素数
+	std::atomic<sint32> num_active_;
+
+	// 随机数种子, 未设置种子时在构造时取一个随机值, 平面优化按迭代次数和像素位置从中派生随机数流
+	uint32 seed_;
+
+	// 平面优化的初始视差扰动半径, 不大于0时为视差范围的一半
+	float32 refine_radius_;
 };
 
 #endif
\ No newline at end of file
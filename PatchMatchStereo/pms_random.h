@@ -0,0 +1,53 @@
+/* -*-c++-*- PatchMatchStereo - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+*			  https://github.com/ethan-li-coding
+* Describe	: header of pms_random
+*/
+
+#ifndef PATCH_MATCH_STEREO_RANDOM_H_
+#define PATCH_MATCH_STEREO_RANDOM_H_
+#include "pms_types.h"
+
+
+/**
+ * \brief 轻量随机数生成器(PCG32, XSH-RR输出)
+ * 状态仅16字节, 构造和生成都只需几次整数运算, 可在每个像素上按需构造;
+ * 相同的种子和流号总是生成相同的序列, 不同流号的序列互不相关
+ */
+class PMSRandom final {
+public:
+	/**
+	 * \brief 构造生成器
+	 * \param seed		种子
+	 * \param stream	流号
+	 */
+	explicit PMSRandom(const uint64& seed, const uint64& stream = 0) :
+		state_(0), inc_((stream << 1) | 1)
+	{
+		Next();
+		state_ += seed;
+		Next();
+	}
+
+	// 生成一个32位随机整数
+	uint32 Next()
+	{
+		const uint64 old = state_;
+		state_ = old * 6364136223846793005ULL + inc_;
+		const uint32 xorshifted = static_cast<uint32>(((old >> 18) ^ old) >> 27);
+		const uint32 rot = static_cast<uint32>(old >> 59);
+		return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+	}
+
+	// 生成[lo, hi)区间内均匀分布的随机实数, 取高24位对应float的有效位数
+	float32 Uniform(const float32& lo, const float32& hi)
+	{
+		return lo + (hi - lo) * (static_cast<float32>(Next() >> 8) * (1.0f / 16777216.0f));
+	}
+
+private:
+	uint64 state_;
+	uint64 inc_;
+};
+
+#endif
@@ -0,0 +1,74 @@
+/* -*-c++-*- PatchMatchStereo - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+*			  https://github.com/ethan-li-coding
+* Describe	: implement of pms_sample_pattern
+*/
+
+#include "stdafx.h"
+#include "pms_sample_pattern.h"
+#include <algorithm>
+#include <random>
+
+
+PMSSamplePattern::PMSSamplePattern(const sint32& patch_size, const SamplePattern& type, const sint32& stride,
+								   const uint32& seed) :
+								   patch_size_(patch_size / 2 * 2 + 1), num_samples_(0)
+{
+	const sint32 pat = patch_size_ / 2;
+	const sint32 k = std::max(stride, 1);
+
+	// 每行的采样列, 格网以中心像素对齐, 中心像素始终参与聚合
+	vector<vector<sint32>> rows(patch_size_);
+	switch (type) {
+	case SamplePattern::STRIDE:
+	case SamplePattern::CHECKERBOARD:
+		for (sint32 r = -pat; r <= pat; r++) {
+			for (sint32 c = -pat; c <= pat; c++) {
+				if (r % k != 0 || c % k != 0) {
+					continue;
+				}
+				if (type == SamplePattern::CHECKERBOARD && (r / k + c / k) % 2 != 0) {
+					continue;
+				}
+				rows[r + pat].push_back(c);
+			}
+		}
+		break;
+	case SamplePattern::JITTER: {
+		// 每个格网点在其k*k邻域内随机偏移
+		std::mt19937 gen(seed);
+		std::uniform_int_distribution<sint32> rand_ofs(-(k - 1) / 2, k / 2);
+		for (sint32 r0 = -pat / k * k; r0 <= pat; r0 += k) {
+			for (sint32 c0 = -pat / k * k; c0 <= pat; c0 += k) {
+				sint32 r = r0, c = c0;
+				if (r0 != 0 || c0 != 0) {
+					r = std::max(-pat, std::min(pat, r0 + rand_ofs(gen)));
+					c = std::max(-pat, std::min(pat, c0 + rand_ofs(gen)));
+				}
+				rows[r + pat].push_back(c);
+			}
+		}
+		break;
+	}
+	default:
+		for (sint32 r = -pat; r <= pat; r++) {
+			for (sint32 c = -pat; c <= pat; c++) {
+				rows[r + pat].push_back(c);
+			}
+		}
+		break;
+	}
+
+	// 各行列偏移升序去重后连续存放
+	row_begin_.resize(patch_size_ + 1);
+	for (sint32 i = 0; i < patch_size_; i++) {
+		auto& row = rows[i];
+		std::sort(row.begin(), row.end());
+		row.erase(std::unique(row.begin(), row.end()), row.end());
+		row_begin_[i] = static_cast<sint32>(cols_.size());
+		cols_.insert(cols_.end(), row.begin(), row.end());
+	}
+	row_begin_[patch_size_] = static_cast<sint32>(cols_.size());
+	num_samples_ = static_cast<sint32>(cols_.size());
+	cols_.resize(cols_.size() + 16, 0);
+}
@@ -0,0 +1,52 @@
+/* -*-c++-*- PatchMatchStereo - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+*			  https://github.com/ethan-li-coding
+* Describe	: header of pms_sample_pattern
+*/
+
+#ifndef PATCH_MATCH_STEREO_SAMPLE_PATTERN_H_
+#define PATCH_MATCH_STEREO_SAMPLE_PATTERN_H_
+#include "pms_types.h"
+
+
+/**
+ * \brief 聚合窗口的采样模式
+ * 以块内行号(0~patch_size-1)组织, 每行记录参与聚合的列偏移(-patch_size/2~patch_size/2, 升序)
+ * 所有行的列偏移连续存放, 末尾多留16个元素, 使向量化实现可按16个一组读取任意行
+ */
+class PMSSamplePattern final {
+public:
+	/**
+	 * \brief 构造采样模式
+	 * \param patch_size	局部块大小, 按实际聚合区间[-patch_size/2, patch_size/2]取奇数
+	 * \param type			采样方式
+	 * \param stride		采样步长k, STRIDE/CHECKERBOARD/JITTER在k*k的格网上采样
+	 * \param seed			JITTER随机抖动的种子, 相同种子生成相同的模式
+	 */
+	PMSSamplePattern(const sint32& patch_size, const SamplePattern& type, const sint32& stride,
+					 const uint32& seed = 0);
+
+	~PMSSamplePattern() = default;
+
+	// 是否为全采样
+	bool IsFull() const { return num_samples_ == patch_size_ * patch_size_; }
+
+	// 第i行的采样列偏移
+	const sint32* RowCols(const sint32& i) const { return cols_.data() + row_begin_[i]; }
+
+	// 第i行的采样个数
+	sint32 RowCount(const sint32& i) const { return row_begin_[i + 1] - row_begin_[i]; }
+
+	// 采样总数
+	sint32 NumSamples() const { return num_samples_; }
+
+private:
+	sint32 patch_size_;
+	sint32 num_samples_;
+	// 每行在cols_中的起始位置, 共patch_size+1项
+	vector<sint32> row_begin_;
+	// 各行的采样列偏移
+	vector<sint32> cols_;
+};
+
+#endif
@@ -0,0 +1,209 @@
+/* -*-c++-*- PatchMatchStereo - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+*			  https://github.com/ethan-li-coding
+* Describe	: implement of pms_strip_matcher
+*/
+
+#include "stdafx.h"
+#include "pms_strip_matcher.h"
+#include "pms_util.h"
+#include "pms_plane_store.h"
+#include "PatchMatchStereo.h"
+#include <cctype>
+#include <memory>
+
+namespace
+{
+	using FilePtr = std::unique_ptr<FILE, int(*)(FILE*)>;
+
+	FilePtr OpenFile(const char* path, const char* mode)
+	{
+		return FilePtr(path ? fopen(path, mode) : nullptr, &fclose);
+	}
+
+	// 定位到文件的64位偏移处
+	bool Seek(FILE* fp, const sint64& offset)
+	{
+#if defined(_MSC_VER)
+		return _fseeki64(fp, offset, SEEK_SET) == 0;
+#else
+		return fseeko(fp, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+	}
+
+	// 读取PPM文件头中的一个十进制整数, 跳过空白及注释
+	bool ReadHeaderValue(FILE* fp, sint64& value)
+	{
+		sint32 c = fgetc(fp);
+		while (c != EOF && (isspace(c) || c == '#')) {
+			if (c == '#') {
+				while (c != EOF && c != '\n') c = fgetc(fp);
+			}
+			c = fgetc(fp);
+		}
+		if (c == EOF || !isdigit(c)) {
+			return false;
+		}
+		value = 0;
+		while (c != EOF && isdigit(c)) {
+			value = value * 10 + (c - '0');
+			c = fgetc(fp);
+		}
+		// 数值后的单个空白字符属于文件头
+		return c != EOF && isspace(c);
+	}
+
+	/**
+	 * @brief 读取PPM(P6, 8位)文件头
+	 * @param fp		文件
+	 * @param width		输出, 影像宽
+	 * @param height	输出, 影像高
+	 * @param offset	输出, 像素数据在文件中的起始偏移
+	 * @return bool		是否为支持的PPM文件
+	 */
+	bool ReadPPMHeader(FILE* fp, sint32& width, sint32& height, sint64& offset)
+	{
+		if (fgetc(fp) != 'P' || fgetc(fp) != '6') {
+			return false;
+		}
+		sint64 w = 0, h = 0, max_val = 0;
+		if (!ReadHeaderValue(fp, w) || !ReadHeaderValue(fp, h) || !ReadHeaderValue(fp, max_val)) {
+			return false;
+		}
+		const sint64 max_size = std::numeric_limits<sint32>::max();
+		if (w <= 0 || h <= 0 || w > max_size || h > max_size || max_val != 255) {
+			return false;
+		}
+		width = static_cast<sint32>(w);
+		height = static_cast<sint32>(h);
+		offset = ftell(fp);
+		return offset > 0;
+	}
+
+	/**
+	 * @brief 读取PPM影像的若干行, 转换为b,g,r顺序
+	 * @param fp		文件
+	 * @param offset	像素数据在文件中的起始偏移
+	 * @param width		影像宽
+	 * @param y0		起始行
+	 * @param rows		行数
+	 * @param data		输出, 3通道影像数据
+	 * @return bool
+	 */
+	bool ReadPPMRows(FILE* fp, const sint64& offset, const sint32& width, const sint32& y0, const sint32& rows,
+					 uint8* data)
+	{
+		const size_t size = static_cast<size_t>(width) * rows * 3;
+		if (!Seek(fp, offset + static_cast<sint64>(y0) * width * 3) || fread(data, 1, size, fp) != size) {
+			return false;
+		}
+		for (size_t i = 0; i < size; i += 3) {
+			std::swap(data[i], data[i + 2]);
+		}
+		return true;
+	}
+}
+
+PMSStripMatcher::PMSStripMatcher(const PMSOption& option, const sint32& memory_mb, const sint32& margin) :
+								 option_(option), memory_mb_(memory_mb), margin_(std::max(margin, 0)) { }
+
+sint64 PMSStripMatcher::BytesPerPixel(const PMSOption& option)
+{
+	// 左右视图的灰度、梯度、代价、视差、平面及打包影像, 另加条带的输入影像和输出视差;
+	// 平面和代价按存储类型计, 紧凑编码时每视图少16字节
+	const sint64 plane_bytes = sizeof(PPlaneStore) + sizeof(PCostStore);
+	sint64 bytes = 64 + 2 * plane_bytes;
+	// 左右视图的census比特串(含外扩边界)
+	if (option.cost_type == CostType::CENSUS) bytes += 20;
+	// 活跃集的迭代序号
+	if (option.is_active_set) bytes += 8;
+	// 分块传播的平面快照
+	if (option.propagation_mode == PropagationMode::TILED) bytes += 2 * sizeof(PPlaneStore);
+	// 金字塔各粗层的面积之和不超过本层的1/3
+	if (option.num_levels > 1) bytes = bytes * 4 / 3;
+	return bytes;
+}
+
+bool PMSStripMatcher::Match(const char* path_left, const char* path_right, const char* path_disp)
+{
+	strips_.clear();
+
+	auto file_left = OpenFile(path_left, "rb");
+	auto file_right = OpenFile(path_right, "rb");
+	if (!file_left || !file_right) {
+		return false;
+	}
+	sint32 width = 0, height = 0, width_r = 0, height_r = 0;
+	sint64 offset_left = 0, offset_right = 0;
+	if (!ReadPPMHeader(file_left.get(), width, height, offset_left) ||
+		!ReadPPMHeader(file_right.get(), width_r, height_r, offset_right) ||
+		width != width_r || height != height_r) {
+		return false;
+	}
+
+	// 由内存预算确定条带高度, 各条带的核心行数均分
+	sint64 budget = static_cast<sint64>(memory_mb_) * 1024 * 1024;
+	if (option_.is_use_weight_cache) budget -= static_cast<sint64>(std::max(option_.weight_cache_mb, 0)) * 1024 * 1024;
+	const sint64 rows_fit = budget / (static_cast<sint64>(width) * BytesPerPixel(option_));
+	const sint64 core_fit = std::min(rows_fit - 2 * margin_, static_cast<sint64>(height));
+	if (core_fit <= 0) {
+		return false;
+	}
+	const sint32 num_strips = static_cast<sint32>((height + core_fit - 1) / core_fit);
+	const sint32 core_height = (height + num_strips - 1) / num_strips;
+
+	// 输出PFM: 小端(比例因子为负), 行序自下而上
+	auto file_disp = OpenFile(path_disp, "wb");
+	if (!file_disp) {
+		return false;
+	}
+	char header[64];
+	const sint32 header_size = sprintf(header, "Pf\n%d %d\n-1.0\n", width, height);
+	if (fwrite(header, 1, header_size, file_disp.get()) != static_cast<size_t>(header_size)) {
+		return false;
+	}
+
+	vector<uint8> strip_left, strip_right;
+	vector<float32> strip_disp;
+	for (sint32 s = 0; s < num_strips; s++) {
+		// 核心行[c0, c1), 上下各外扩margin行
+		const sint32 c0 = s * core_height;
+		const sint32 c1 = std::min(c0 + core_height, height);
+		const sint32 y0 = std::max(c0 - margin_, 0);
+		const sint32 y1 = std::min(c1 + margin_, height);
+		const sint32 rows = y1 - y0;
+
+		const size_t strip_size = static_cast<size_t>(width) * rows;
+		strip_left.resize(strip_size * 3);
+		strip_right.resize(strip_size * 3);
+		strip_disp.resize(strip_size);
+		if (!ReadPPMRows(file_left.get(), offset_left, width, y0, rows, strip_left.data()) ||
+			!ReadPPMRows(file_right.get(), offset_right, width, y0, rows, strip_right.data())) {
+			return false;
+		}
+
+		// 各条带使用不同的随机数流
+		PMSOption option_strip = option_;
+		option_strip.seed = (option_.seed != 0) ? pms_util::MixSeed(option_.seed, pms_util::SeedPurpose::STRIP, s, 0, 0) : 0;
+		{
+			PatchMatchStereo pms;
+			if (!pms.Initialize(width, rows, option_strip) ||
+				!pms.Match(strip_left.data(), strip_right.data(), strip_disp.data())) {
+				return false;
+			}
+		}
+
+		// 只写出核心行, 接缝位于重叠部分的中线
+		for (sint32 y = c0; y < c1; y++) {
+			const sint64 pos = header_size + static_cast<sint64>(height - 1 - y) * width * sizeof(float32);
+			if (!Seek(file_disp.get(), pos) ||
+				fwrite(&strip_disp[static_cast<size_t>(y - y0) * width], sizeof(float32), width, file_disp.get()) !=
+				static_cast<size_t>(width)) {
+				return false;
+			}
+		}
+		strips_.emplace_back(0, y0, width, rows);
+	}
+
+	return fclose(file_disp.release()) == 0;
+}
@@ -0,0 +1,60 @@
+/* -*-c++-*- PatchMatchStereo - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+*			  https://github.com/ethan-li-coding
+* Describe	: header of pms_strip_matcher
+*/
+
+#ifndef PATCH_MATCH_STEREO_STRIP_MATCHER_H_
+#define PATCH_MATCH_STEREO_STRIP_MATCHER_H_
+#include "pms_types.h"
+
+
+/**
+ * \brief 超大影像的分条带匹配(外存处理)
+ * 核线影像的同名点位于同一行, 影像按行划分为上下重叠的水平条带即可独立匹配, 无需外扩视差范围.
+ * 逐条带从磁盘读入左右影像、匹配并写出视差, 内存中只驻留一个条带, 条带高度由内存预算确定;
+ * 相邻条带在重叠部分的中线处拼接, 每个像素的视差取自离条带边界较远的条带
+ * 输入为二进制PPM(P6, 8位)彩色影像, 输出为PFM灰度视差图(无效视差为inf)
+ */
+class PMSStripMatcher final {
+public:
+	/**
+	 * \brief 构造
+	 * \param option		匹配参数
+	 * \param memory_mb		内存预算(MB), 含权值缓存的预算
+	 * \param margin		条带上下各外扩的行数, 相邻条带重叠2*margin行; 不小于patch_size/2时接缝两侧的窗口都是完整的
+	 */
+	PMSStripMatcher(const PMSOption& option, const sint32& memory_mb, const sint32& margin);
+
+	/**
+	 * \brief 匹配
+	 * \param path_left		左影像路径(PPM)
+	 * \param path_right	右影像路径(PPM)
+	 * \param path_disp		输出视差图路径(PFM)
+	 * \return bool			影像无法读取或尺寸不一致、内存预算容纳不下一个条带、写出失败时返回false
+	 */
+	bool Match(const char* path_left, const char* path_right, const char* path_disp);
+
+	/**
+	 * \brief 获取最近一次匹配的条带
+	 * \return const vector<PRect>&		各条带的范围(含外扩部分), 自上而下
+	 */
+	const vector<PRect>& GetStrips() const { return strips_; }
+
+	/**
+	 * \brief 按参数估算匹配时每个像素占用的内存, 含条带的输入输出缓存, 不含权值缓存
+	 * \param option		匹配参数
+	 * \return sint64		字节数
+	 */
+	static sint64 BytesPerPixel(const PMSOption& option);
+
+private:
+	PMSOption option_;
+	sint32 memory_mb_;
+	sint32 margin_;
+
+	// 最近一次匹配的条带
+	vector<PRect> strips_;
+};
+
+#endif
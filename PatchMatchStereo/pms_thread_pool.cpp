@@ -0,0 +1,98 @@
+/* -*-c++-*- PatchMatchStereo - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+*			  https://github.com/ethan-li-coding
+* Describe	: implement of pms_thread_pool
+*/
+
+#include "stdafx.h"
+#include "pms_thread_pool.h"
+
+
+PMSThreadPool::PMSThreadPool(const sint32& num_threads) :
+							 func_(nullptr), num_tasks_(0), generation_(0),
+							 num_active_(0), is_stop_(false), next_task_(0)
+{
+	sint32 n = num_threads;
+	if (n <= 0) {
+		n = std::max(1, static_cast<sint32>(std::thread::hardware_concurrency()));
+	}
+	for (sint32 i = 1; i < n; i++) {
+		workers_.emplace_back(&PMSThreadPool::WorkerLoop, this);
+	}
+}
+
+PMSThreadPool::~PMSThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		is_stop_ = true;
+	}
+	cv_start_.notify_all();
+	for (auto& worker : workers_) {
+		worker.join();
+	}
+}
+
+void PMSThreadPool::ParallelFor(const sint32& n, const std::function<void(sint32)>& func)
+{
+	if (n <= 0) {
+		return;
+	}
+	// 无工作线程或只有一个任务时直接执行
+	if (workers_.empty() || n == 1) {
+		for (sint32 i = 0; i < n; i++) {
+			func(i);
+		}
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		func_ = &func;
+		num_tasks_ = n;
+		next_task_.store(0);
+		num_active_ = static_cast<sint32>(workers_.size());
+		++generation_;
+	}
+	cv_start_.notify_all();
+
+	// 调用线程参与执行
+	RunTasks();
+
+	// 等待工作线程结束本轮任务
+	std::unique_lock<std::mutex> lock(mutex_);
+	cv_done_.wait(lock, [this] { return num_active_ == 0; });
+	func_ = nullptr;
+}
+
+void PMSThreadPool::WorkerLoop()
+{
+	uint64 generation = 0;
+	while (true) {
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			cv_start_.wait(lock, [this, generation] { return is_stop_ || generation_ != generation; });
+			if (is_stop_) {
+				return;
+			}
+			generation = generation_;
+		}
+
+		RunTasks();
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			--num_active_;
+		}
+		cv_done_.notify_one();
+	}
+}
+
+void PMSThreadPool::RunTasks()
+{
+	const auto& func = *func_;
+	const sint32 n = num_tasks_;
+	for (sint32 i = next_task_.fetch_add(1); i < n; i = next_task_.fetch_add(1)) {
+		func(i);
+	}
+}
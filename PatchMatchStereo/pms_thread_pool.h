@@ -0,0 +1,73 @@
+/* -*-c++-*- PatchMatchStereo - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+*			  https://github.com/ethan-li-coding
+* Describe	: header of pms_thread_pool
+*/
+
+#ifndef PATCH_MATCH_STEREO_THREAD_POOL_H_
+#define PATCH_MATCH_STEREO_THREAD_POOL_H_
+#include "pms_types.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+
+/**
+ * \brief 线程池
+ * 固定数量的工作线程, 以ParallelFor的形式执行任务: 任务序号由原子计数器动态分配, 调用线程也参与执行
+ * 同一时刻只执行一个ParallelFor, 不可在任务中嵌套调用
+ */
+class PMSThreadPool final {
+public:
+	/**
+	 * \brief 构造线程池
+	 * \param num_threads	线程总数(含调用线程), 不大于0时取CPU的硬件线程数
+	 */
+	explicit PMSThreadPool(const sint32& num_threads);
+	~PMSThreadPool();
+
+	PMSThreadPool(const PMSThreadPool&) = delete;
+	PMSThreadPool& operator=(const PMSThreadPool&) = delete;
+
+	/**
+	 * \brief 并行执行func(i), i取[0, n), 返回时全部任务已完成
+	 * \param n			任务数
+	 * \param func		任务函数
+	 */
+	void ParallelFor(const sint32& n, const std::function<void(sint32)>& func);
+
+	// 线程总数(含调用线程)
+	sint32 NumThreads() const { return static_cast<sint32>(workers_.size()) + 1; }
+
+private:
+	// 工作线程的主循环
+	void WorkerLoop();
+
+	// 领取并执行任务, 直到任务分配完
+	void RunTasks();
+
+private:
+	vector<std::thread> workers_;
+
+	std::mutex mutex_;
+	// 通知工作线程有新任务或退出
+	std::condition_variable cv_start_;
+	// 通知调用线程工作线程已全部结束本轮任务
+	std::condition_variable cv_done_;
+
+	// 当前任务, 由mutex_保护
+	const std::function<void(sint32)>* func_;
+	sint32 num_tasks_;
+	// 任务轮次, 工作线程据此判断是否有新任务
+	uint64 generation_;
+	// 本轮尚未结束的工作线程数
+	sint32 num_active_;
+	bool is_stop_;
+
+	// 下一个待领取的任务序号
+	std::atomic<sint32> next_task_;
+};
+
+#endif
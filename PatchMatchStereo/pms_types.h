@@ -34,6 +34,46 @@ typedef double			float64;	// 双精度浮点
 // float32无效值
 constexpr auto Invalid_Float = std::numeric_limits<float32>::infinity();
 
+// SIMD指令集级别
+enum class SimdLevel : sint32 {
+	NONE = 0,	// 标量实现(参考实现)
+	AVX2,		// AVX2, 每次处理8列
+	AVX512,		// AVX-512, 每次处理16列
+	AUTO		// 运行时检测CPU支持的最高级别
+};
+
+// 代价计算方法
+enum class CostType : sint32 {
+	PMS = 0,	// 原文的颜色+梯度代价(浮点实现, 可SIMD加速)
+	PMS_FIXED,	// 原文的颜色+梯度代价(定点实现, 权值查表)
+	CENSUS		// census变换的汉明距离代价(对光照变化鲁棒)
+};
+
+// 聚合窗口的采样方式
+enum class SamplePattern : sint32 {
+	FULL = 0,		// 逐像素聚合
+	STRIDE,			// 每隔k行k列采样, 约为1/k^2
+	CHECKERBOARD,	// k*k格网上的棋盘格采样, 约为1/(2k^2)
+	JITTER			// 每个k*k单元内随机抖动采样一个像素(模式固定), 约为1/k^2
+};
+
+// 传播的调度方式
+enum class PropagationMode : sint32 {
+	SEQUENTIAL = 0,	// 逐像素光栅扫描(原文), 奇偶迭代方向交替, 单线程
+	RED_BLACK,		// 棋盘格两相位更新, 同相位的像素相互独立, 按行多线程并行
+	WAVEFRONT,		// 与SEQUENTIAL相同的扫描顺序, 各行流水并行(每行滞后上一行一个像素), 结果与SEQUENTIAL一致
+	TILED			// 图像划分为矩形分块, 各块独立顺序扫描并多线程并行, 块外邻域平面取自迭代开始时的快照
+};
+
+// 输入图像的像素格式
+enum class PixelFormat : sint32 {
+	BGR = 0,	// 3通道, b,g,r顺序(OpenCV默认)
+	RGB,		// 3通道, r,g,b顺序
+	BGRA,		// 4通道, b,g,r,a顺序, 忽略a
+	RGBA,		// 4通道, r,g,b,a顺序, 忽略a
+	GRAY		// 单通道灰度, 视为三个通道相同的彩色
+};
+
 // PMS参数结构体
 struct PMSOption {
 	sint32	patch_size;			// 块大小, 局部窗口: patch_size*patch_size
@@ -52,14 +92,61 @@ struct PMSOption {
 
 	bool	is_fill_holes;		// 是否填充视差空洞
 
+	bool	is_left_view_only;	// 是否只计算左视图: 不传播右视图也不做视图传播, 耗时约减半; 此时不做一致性检查和视差填充, 右视图视差图无效
+
 	bool	is_fource_fpw;		// 是否强制为Frontal-Parallel Window
 	bool	is_integer_disp;	// 是否为整像素视差
+
+	CostType cost_type;			// 代价计算方法
+	SimdLevel simd_level;		// 聚合代价计算使用的SIMD指令集, AUTO为运行时检测
+
+	bool	is_use_weight_cache;	// 是否缓存支持权值(权值与候选平面无关, 每个像素只计算一次)
+	bool	is_lazy_weight_cache;	// 权值缓存是否惰性计算(只计算被访问到的分块)
+	sint32	weight_cache_mb;		// 权值缓存的内存预算(MB), 左右视图各占一半
+	bool	is_early_termination;	// 是否在聚合的部分代价已不小于当前最优代价时提前终止(不改变结果)
+	bool	is_weighted_row_order;	// 提前终止时是否优先聚合权值大的行
+
+	SamplePattern sample_pattern;	// 聚合窗口的采样方式
+	sint32	sample_stride;			// 采样步长k
+
+	sint32	census_width;			// census窗口宽(奇数, 3~9)
+	sint32	census_height;			// census窗口高(奇数, 3~7)
+	bool	is_census_interpolate;	// census汉明距离是否按亚像素线性内插, 否则取最近列
+
+	PropagationMode propagation_mode;	// 传播的调度方式
+	sint32	num_threads;				// 预处理及RED_BLACK/WAVEFRONT/TILED模式的线程数, 不大于0时取CPU的硬件线程数
+	sint32	tile_size;					// TILED模式的分块边长(像素)
+	bool	is_concurrent_views;		// SEQUENTIAL模式下左右视图是否在两个线程上并发传播(跨视图更新经信箱传递)
+	uint32	seed;						// 随机数种子, 非0时随机初始化和平面优化可复现(与调度方式及线程数无关), 0为每次运行不同
+
+	bool	is_active_set;				// 是否只处理活跃像素(自身或邻域平面在上一次迭代以来有变化), 其余像素跳过空间传播和视图传播
+	float32	active_refine_ratio;		// 活跃集模式下非活跃像素仍做平面优化的比例(0~1), 按种子随机抽取
+	float32	converge_ratio;				// 活跃集模式下一次迭代中平面变化的像素比例不大于该值时提前结束迭代, num_iters为迭代次数上限
+
+	sint32	num_levels;					// 金字塔层数, 大于1时由粗到精匹配: 最粗层随机初始化并迭代num_iters次, 较精层由上一层的平面初始化
+	sint32	num_fine_iters;				// 金字塔较精层(含原始分辨率)的传播迭代次数
+	float32	fine_refine_radius;			// 金字塔较精层及视频后续帧平面优化的初始视差扰动半径(该层像素), 法线扰动按同样比例缩小
+
+	sint32	num_stream_iters;			// 视频序列(MatchNext)后续帧的传播迭代次数, 平面由上一帧初始化
+	float32	stream_random_ratio;		// 视频序列后续帧重新随机初始化的像素比例(0~1), 用于捕获新出现的表面
+
+	bool	is_huge_pages;				// 匹配实例的缓存是否建议系统以大页映射(仅Linux)
 	
 	PMSOption() : patch_size(35), min_disparity(0), max_disparity(64),
 				  gamma(10.0f), alpha(0.9f), tau_col(10.0f), tau_grad(2.0f),
 				  num_iters(3),
 				  is_check_lr(false), lrcheck_thres(0),
-	              is_fill_holes(false), is_fource_fpw(false), is_integer_disp(false) {}
+	              is_fill_holes(false), is_left_view_only(false), is_fource_fpw(false), is_integer_disp(false),
+				  cost_type(CostType::PMS), simd_level(SimdLevel::AUTO),
+				  is_use_weight_cache(false), is_lazy_weight_cache(false), weight_cache_mb(1024),
+				  is_early_termination(true), is_weighted_row_order(true),
+				  sample_pattern(SamplePattern::FULL), sample_stride(2),
+				  census_width(9), census_height(7), is_census_interpolate(true),
+				  propagation_mode(PropagationMode::SEQUENTIAL), num_threads(0), tile_size(128), is_concurrent_views(false), seed(0),
+				  is_active_set(false), active_refine_ratio(0.1f), converge_ratio(0.001f),
+				  num_levels(1), num_fine_iters(1), fine_refine_radius(2.0f),
+				  num_stream_iters(1), stream_random_ratio(0.05f),
+				  is_huge_pages(false) {}
 };
 
 // 颜色结构体
@@ -80,6 +167,101 @@ struct PGradient {
 	}
 };
 
+// 分块传播的分块范围及耗时
+struct PTileTiming {
+	sint32	view;			// 0-左视图 1-右视图
+	sint32	x, y;			// 分块左上角
+	sint32	width, height;	// 分块尺寸
+	float64	seconds;		// 所有迭代中传播该块的耗时之和(秒)
+	PTileTiming() : view(0), x(0), y(0), width(0), height(0), seconds(0.0) {}
+};
+
+// 矩形区域
+struct PRect {
+	sint32	x, y;			// 左上角
+	sint32	width, height;	// 尺寸
+	PRect() : x(0), y(0), width(0), height(0) {}
+	PRect(const sint32& _x, const sint32& _y, const sint32& _width, const sint32& _height) {
+		x = _x; y = _y; width = _width; height = _height;
+	}
+};
+
+/**
+ * @brief 图像视图: 引用外部的图像数据, 不拷贝也不持有
+ * 第y行的首地址为data + y*stride, 行内像素紧密排列, 可直接引用cv::Mat(含ROI)、相机缓冲区或内存映射文件
+ */
+struct PImageView {
+	const uint8*	data;			// 首行首像素地址
+	sint32			width, height;	// 尺寸
+	sint64			stride;			// 行跨度(字节)
+	PixelFormat		format;			// 像素格式
+	PImageView() : data(nullptr), width(0), height(0), stride(0), format(PixelFormat::BGR) {}
+	/**
+	 * @param _data		首行首像素地址
+	 * @param _width	图像宽
+	 * @param _height	图像高
+	 * @param _stride	行跨度(字节), 为0时按紧密排列计算
+	 * @param _format	像素格式
+	 */
+	PImageView(const uint8* _data, const sint32& _width, const sint32& _height,
+			   const sint64& _stride = 0, const PixelFormat& _format = PixelFormat::BGR) {
+		data = _data; width = _width; height = _height; format = _format;
+		stride = (_stride != 0) ? _stride : static_cast<sint64>(_width) * Channels();
+	}
+
+	// 数据是否有效
+	bool IsValid() const { return data != nullptr && width > 0 && height > 0; }
+
+	// 每个像素的字节数
+	sint32 Channels() const {
+		switch (format) {
+		case PixelFormat::GRAY: return 1;
+		case PixelFormat::BGRA:
+		case PixelFormat::RGBA: return 4;
+		default: return 3;
+		}
+	}
+
+	// 第y行的首地址
+	const uint8* Row(const sint32& y) const { return data + y * stride; }
+
+	// 像素(x,y)的颜色, 灰度图三个通道相同
+	PColor Color(const sint32& x, const sint32& y) const {
+		const uint8* pixel = Row(y) + x * Channels();
+		switch (format) {
+		case PixelFormat::GRAY: return { pixel[0], pixel[0], pixel[0] };
+		case PixelFormat::RGB:
+		case PixelFormat::RGBA: return { pixel[2], pixel[1], pixel[0] };
+		default: return { pixel[0], pixel[1], pixel[2] };
+		}
+	}
+
+	// 子区域的视图, 与原视图共用数据
+	PImageView Crop(const PRect& rect) const {
+		return PImageView(Row(rect.y) + rect.x * Channels(), rect.width, rect.height, stride, format);
+	}
+};
+
+// 活跃集模式下每次迭代的统计
+struct PIterationStat {
+	sint32	iter;			// 迭代序号
+	sint32	view;			// 0-左视图 1-右视图
+	float32	active_ratio;	// 参与空间传播的像素比例
+	float32	changed_ratio;	// 本次迭代中平面有变化的像素比例(含另一视图的视图传播)
+	PIterationStat() : iter(0), view(0), active_ratio(0.0f), changed_ratio(0.0f) {}
+};
+
+/**
+ * \brief 打包的像素记录(8字节), 颜色与梯度相邻存放, 内插时两个抽头的颜色和梯度位于同一缓存行
+ * 颜色按b,g,r顺序, 与图像数据一致
+ */
+struct PPixel {
+	uint8 b, g, r;
+	uint8 valid;		// 有效标记, 图像内为1, 外扩边界为0
+	PGradient grad;
+	PPixel() : b(0), g(0), r(0), valid(0) {}
+};
+
 // 二维矢量结构体
 struct PVector2f {
 
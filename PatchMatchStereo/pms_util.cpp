@@ -7,6 +7,18 @@
 #include "stdafx.h"
 #include "pms_util.h"
 
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <malloc.h>
+#else
+#include <stdlib.h>
+#endif
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
 
 PColor pms_util::GetColor(const uint8* img_data,
 						  const sint32& width, const sint32& height,
@@ -54,13 +66,14 @@ void pms_util::MedianFilter(const float32* in,
 	}
 }
 
-void pms_util::WeightedMedianFilter(const uint8* img_data,
-									const sint32& width, const sint32& height,
+void pms_util::WeightedMedianFilter(const PImageView& img,
 									const sint32& wnd_size,
 									const float32& gamma,
 									const vector<pair<int, int>>& filter_pixels,
 									float32* disparity_map)
 {
+	const sint32 width = img.width;
+	const sint32 height = img.height;
 	const sint32 wnd_size2 = wnd_size / 2; // 中心点
 
 	// 带权视差集
@@ -72,7 +85,7 @@ void pms_util::WeightedMedianFilter(const uint8* img_data,
 		const sint32 y = pix.second;	
 		// weighted median filter
 		disps.clear();
-		const auto& col_p = GetColor(img_data, width, height, x, y);
+		const auto col_p = img.Color(x, y);
 		float32 total_w = 0.0f;
 		for (sint32 r = -wnd_size2; r <= wnd_size2; r++) {
 			for (sint32 c = -wnd_size2; c <= wnd_size2; c++) {
@@ -86,7 +99,7 @@ void pms_util::WeightedMedianFilter(const uint8* img_data,
 					continue;
 				}
 				// 计算权值
-				const auto& col_q = GetColor(img_data, width, height, xc, yr);
+				const auto col_q = img.Color(xc, yr);
 				const auto dc = abs(col_p.r - col_q.r) + abs(col_p.g - col_q.g) + abs(col_p.b - col_q.b);
 				const auto w = exp(-dc / gamma);
 				total_w += w;
@@ -110,3 +123,140 @@ void pms_util::WeightedMedianFilter(const uint8* img_data,
 		}
 	}
 }
+
+SimdLevel pms_util::DetectSimdLevel()
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) {
+		return SimdLevel::AVX512;
+	}
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+		return SimdLevel::AVX2;
+	}
+	return SimdLevel::NONE;
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+	sint32 info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7) {
+		return SimdLevel::NONE;
+	}
+	// 操作系统需开启YMM/ZMM寄存器状态保存
+	__cpuid(info, 1);
+	const bool os_xsave = (info[2] & (1 << 27)) != 0;
+	const bool fma = (info[2] & (1 << 12)) != 0;
+	if (!os_xsave) {
+		return SimdLevel::NONE;
+	}
+	const auto xcr0 = _xgetbv(0);
+	__cpuidex(info, 7, 0);
+	if ((xcr0 & 0xe6) == 0xe6 && (info[1] & (1 << 16))) {
+		return SimdLevel::AVX512;
+	}
+	if ((xcr0 & 0x6) == 0x6 && (info[1] & (1 << 5)) && fma) {
+		return SimdLevel::AVX2;
+	}
+	return SimdLevel::NONE;
+#else
+	return SimdLevel::NONE;
+#endif
+}
+
+SimdLevel pms_util::ResolveSimdLevel(const SimdLevel& request)
+{
+	static const SimdLevel detected = DetectSimdLevel();
+	if (request == SimdLevel::AUTO) {
+		return detected;
+	}
+	return static_cast<sint32>(request) <= static_cast<sint32>(detected) ? request : detected;
+}
+
+uint32 pms_util::MixSeed(const uint32& seed, const SeedPurpose& purpose, const uint32& a, const uint32& b, const uint32& c)
+{
+	// splitmix64的混合函数, 先并入用途再逐个并入计数值
+	uint64 h = seed;
+	for (const uint64 v : { uint64(purpose), uint64(a), uint64(b), uint64(c) }) {
+		h += 0x9e3779b97f4a7c15ULL + v;
+		h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+		h ^= h >> 31;
+	}
+	return static_cast<uint32>(h ^ (h >> 32));
+}
+
+void pms_util::PyramidDown(const PImageView& in, uint8* out)
+{
+	const sint32 width = in.width;
+	const sint32 height = in.height;
+	const sint32 width_d = (width + 1) / 2;
+	const sint32 height_d = (height + 1) / 2;
+	const sint32 ch = in.Channels();
+	static const sint32 kernel[5] = { 1, 4, 6, 4, 1 };
+
+	// 水平平滑, 只计算取样列, 各通道(含alpha)分别平滑; 中间结果不超过255*16
+	vector<uint16> temp(static_cast<size_t>(height) * width_d * ch);
+	for (sint32 y = 0; y < height; y++) {
+		const uint8* row = in.Row(y);
+		uint16* row_t = &temp[static_cast<size_t>(y) * width_d * ch];
+		for (sint32 x = 0; x < width_d; x++) {
+			sint32 sum[4] = { 0, 0, 0, 0 };
+			for (sint32 k = -2; k <= 2; k++) {
+				const sint32 xk = std::min(std::max(2 * x + k, 0), width - 1);
+				for (sint32 n = 0; n < ch; n++) {
+					sum[n] += kernel[k + 2] * row[ch * xk + n];
+				}
+			}
+			for (sint32 n = 0; n < ch; n++) {
+				row_t[ch * x + n] = static_cast<uint16>(sum[n]);
+			}
+		}
+	}
+
+	// 竖直平滑, 只计算取样行, 四舍五入
+	for (sint32 y = 0; y < height_d; y++) {
+		uint8* row_o = out + static_cast<size_t>(y) * width_d * ch;
+		for (sint32 x = 0; x < ch * width_d; x++) {
+			sint32 sum = 0;
+			for (sint32 k = -2; k <= 2; k++) {
+				const sint32 yk = std::min(std::max(2 * y + k, 0), height - 1);
+				sum += kernel[k + 2] * temp[static_cast<size_t>(yk) * width_d * ch + x];
+			}
+			row_o[x] = static_cast<uint8>((sum + 128) >> 8);
+		}
+	}
+}
+
+void* pms_util::AlignedAlloc(const uint64& size, const uint64& alignment, const bool& huge_pages)
+{
+	if (size == 0) {
+		return nullptr;
+	}
+#if defined(_MSC_VER)
+	(void)huge_pages;
+	return _aligned_malloc(static_cast<size_t>(size), static_cast<size_t>(alignment));
+#else
+	// 大页需要按2MB对齐
+	const uint64 huge_size = 2ULL << 20;
+	const bool huge = huge_pages && size >= huge_size;
+	void* ptr = nullptr;
+	if (posix_memalign(&ptr, static_cast<size_t>(huge ? std::max(alignment, huge_size) : alignment),
+					   static_cast<size_t>(size)) != 0) {
+		return nullptr;
+	}
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+	if (huge) {
+		madvise(ptr, static_cast<size_t>(size), MADV_HUGEPAGE);
+	}
+#endif
+	return ptr;
+#endif
+}
+
+void pms_util::AlignedFree(void* ptr)
+{
+#if defined(_MSC_VER)
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
@@ -7,6 +7,30 @@
 #pragma once
 #include "pms_types.h"
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PMS_SIMD_X86
+#endif
+
+// SIMD核函数的指令集属性: GCC/Clang需按函数开启指令集, 以便在不加-mavx2等编译选项的情况下由运行时检测选择
+#if defined(PMS_SIMD_X86) && (defined(__GNUC__) || defined(__clang__))
+#define PMS_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define PMS_TARGET_AVX512 __attribute__((target("avx512f,avx2,fma")))
+#define PMS_TARGET_POPCNT __attribute__((target("popcnt")))
+#else
+#define PMS_TARGET_AVX2
+#define PMS_TARGET_AVX512
+#define PMS_TARGET_POPCNT
+#endif
+
+// 强制内联, 被内联的代码才按调用方函数的指令集属性展开
+#if defined(__GNUC__) || defined(__clang__)
+#define PMS_FORCE_INLINE inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define PMS_FORCE_INLINE __forceinline
+#else
+#define PMS_FORCE_INLINE inline
+#endif
+
 
 namespace pms_util
 {
@@ -38,18 +62,75 @@ namespace pms_util
 
 	/**
 	 * @brief 加权中值滤波
-	 * @param img_data		颜色数组
-	 * @param width			图像宽
-	 * @param height		图像高
+	 * @param img			图像
 	 * @param wnd_size		窗口大小
 	 * @param gamma			gamma值
 	 * @param filter_pixels 需要滤波的像素集
-	 * @param disparity_map 视差图
+	 * @param disparity_map 视差图, 与图像等尺寸紧密排列
 	 */
-	void WeightedMedianFilter(const uint8* img_data,
-							  const sint32& width, const sint32& height,
+	void WeightedMedianFilter(const PImageView& img,
 							  const sint32& wnd_size,
 							  const float32& gamma,
 							  const vector<pair<int, int>>& filter_pixels,
 							  float32* disparity_map);
+
+	/**
+	 * @brief 检测当前CPU支持的最高SIMD指令集级别
+	 * @return SimdLevel	NONE/AVX2/AVX512
+	 */
+	SimdLevel DetectSimdLevel();
+
+	/**
+	 * @brief 根据参数请求的级别和CPU实际支持的级别, 确定最终使用的SIMD级别
+	 * @param request		参数请求的级别, AUTO为自动检测
+	 * @return SimdLevel	不超过CPU支持级别的SIMD级别
+	 */
+	SimdLevel ResolveSimdLevel(const SimdLevel& request);
+
+	// 派生种子的用途, 混合时最先并入, 不同用途的计数值相同时种子也互不相关
+	enum class SeedPurpose : uint32 {
+		INIT = 0,		// 随机初始化, 每视图每行一个流
+		REFINE,			// 平面优化, 每次迭代每像素一个流
+		ACTIVE_SAMPLE,	// 活跃集中非活跃像素的平面优化抽样
+		VIEW,			// 右视图的种子
+		PYRAMID,		// 金字塔粗层的种子
+		STREAM,			// 视频序列各帧的种子
+		ROI,			// 各ROI的种子
+		STRIP			// 各条带的种子
+	};
+
+	/**
+	 * @brief 由种子、用途和若干计数值混合出一个随机数种子, 用于按像素/迭代划分互不相关的随机数流
+	 * 结果只取决于输入, 与调用顺序和线程无关
+	 * @param seed		基础种子
+	 * @param purpose	用途
+	 * @param a			计数值a(如迭代次数)
+	 * @param b			计数值b(如像素x坐标)
+	 * @param c			计数值c(如像素y坐标)
+	 * @return uint32	混合后的种子
+	 */
+	uint32 MixSeed(const uint32& seed, const SeedPurpose& purpose, const uint32& a, const uint32& b, const uint32& c);
+
+	/**
+	 * @brief 高斯金字塔降采样: 以5x5高斯核([1 4 6 4 1]/16可分离)平滑后隔行隔列取样, 边界像素复制
+	 * 降采样后的像素(x,y)对应原图像素(2x,2y)
+	 * @param in			输入, 图像
+	 * @param out			输出, 与输入格式相同、紧密排列的图像, 预先分配((width+1)/2)*((height+1)/2)个像素
+	 */
+	void PyramidDown(const PImageView& in, uint8* out);
+
+	/**
+	 * @brief 分配对齐的内存
+	 * @param size			字节数
+	 * @param alignment		对齐字节数, 2的幂且为指针大小的倍数
+	 * @param huge_pages	是否建议系统以大页映射(仅Linux, 按2MB对齐并madvise), 系统不支持时忽略
+	 * @return void*		内存地址, 失败时为nullptr; 须由AlignedFree释放
+	 */
+	void* AlignedAlloc(const uint64& size, const uint64& alignment, const bool& huge_pages);
+
+	/**
+	 * @brief 释放AlignedAlloc分配的内存
+	 * @param ptr			内存地址, 可为空
+	 */
+	void AlignedFree(void* ptr);
 }
@@ -0,0 +1,133 @@
+/* -*-c++-*- PatchMatchStereo - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+*			  https://github.com/ethan-li-coding
+* Describe	: implement of pms_weight_cache
+*/
+
+#include "stdafx.h"
+#include "pms_weight_cache.h"
+#include "cost_computor.hpp"
+
+
+PMSWeightCache::PMSWeightCache(const PImageView& img,
+							   const sint32& patch_size, const float32& gamma,
+							   const uint64& budget_bytes, const bool& is_lazy,
+							   const bool& is_row_order) :
+							   img_(img), width_(img.width), height_(img.height),
+							   patch_size_(patch_size / 2 * 2 + 1), gamma_(gamma),
+							   patch_area_(patch_size_ * patch_size_),
+							   tiles_x_(0), tiles_y_(0), num_slots_(0),
+							   stamp_(0), is_resident_(false), num_loads_(0)
+{
+	tile_bytes_ = static_cast<uint64>(TILE_SIZE) * TILE_SIZE * patch_area_;
+	if (!img.IsValid() || patch_size <= 0) {
+		return;
+	}
+	tiles_x_ = (width_ + TILE_SIZE - 1) / TILE_SIZE;
+	tiles_y_ = (height_ + TILE_SIZE - 1) / TILE_SIZE;
+	const sint32 num_tiles = tiles_x_ * tiles_y_;
+
+	// 预算可容纳的分块数
+	const uint64 slot_bytes = tile_bytes_ + (is_row_order ? TILE_SIZE * TILE_SIZE * patch_size_ * sizeof(uint16) : 0);
+	num_slots_ = static_cast<sint32>(std::min<uint64>(budget_bytes / slot_bytes, num_tiles));
+	if (num_slots_ <= 0) {
+		num_slots_ = 0;
+		return;
+	}
+
+	// 末尾多留一些字节, 使向量化实现可按整块读取最后一行权值
+	slots_.resize(num_slots_ * tile_bytes_ + 64);
+	if (is_row_order) {
+		orders_.resize(static_cast<uint64>(num_slots_) * TILE_SIZE * TILE_SIZE * patch_size_);
+	}
+	tile_slot_.assign(num_tiles, -1);
+	slot_tile_.assign(num_slots_, -1);
+	slot_stamp_.assign(num_slots_, 0);
+
+	// 预算可容纳全图时预先计算
+	if (!is_lazy && num_slots_ == num_tiles) {
+		for (sint32 tile = 0; tile < num_tiles; tile++) {
+			LoadTile(tile);
+		}
+		is_resident_ = true;
+	}
+}
+
+sint32 PMSWeightCache::LoadTile(const sint32& tile)
+{
+	// 找到空槽或最久未访问的槽
+	sint32 slot = 0;
+	for (sint32 s = 0; s < num_slots_; s++) {
+		if (slot_tile_[s] < 0) {
+			slot = s;
+			break;
+		}
+		if (slot_stamp_[s] < slot_stamp_[slot]) {
+			slot = s;
+		}
+	}
+	if (slot_tile_[slot] >= 0) {
+		tile_slot_[slot_tile_[slot]] = -1;
+	}
+
+	// 计算分块内每个像素的权值块
+	const sint32 tx = (tile % tiles_x_) * TILE_SIZE;
+	const sint32 ty = (tile / tiles_x_) * TILE_SIZE;
+	uint8* data = slots_.data() + static_cast<uint64>(slot) * tile_bytes_;
+	for (sint32 i = 0; i < TILE_SIZE; i++) {
+		for (sint32 j = 0; j < TILE_SIZE; j++) {
+			const sint32 x = tx + j;
+			const sint32 y = ty + i;
+			if (x < width_ && y < height_) {
+				const uint64 k = static_cast<uint64>(slot) * (TILE_SIZE * TILE_SIZE) + i * TILE_SIZE + j;
+				ComputeWeights(x, y, data + static_cast<uint64>(i * TILE_SIZE + j) * patch_area_,
+							   orders_.empty() ? nullptr : orders_.data() + k * patch_size_);
+			}
+		}
+	}
+
+	tile_slot_[tile] = slot;
+	slot_tile_[slot] = tile;
+	slot_stamp_[slot] = ++stamp_;
+	num_loads_++;
+	return slot;
+}
+
+void PMSWeightCache::ComputeWeights(const sint32& x, const sint32& y, uint8* weights, uint16* order) const
+{
+	const sint32 pat = patch_size_ / 2;
+	const PColor col_p = img_.Color(x, y);
+	for (sint32 r = -pat; r <= pat; r++) {
+		const sint32 yr = y + r;
+		for (sint32 c = -pat; c <= pat; c++) {
+			const sint32 xc = x + c;
+			uint8& w_q = weights[(r + pat) * patch_size_ + c + pat];
+			if (yr < 0 || yr > height_ - 1 || xc < 0 || xc > width_ - 1) {
+				w_q = 0;
+				continue;
+			}
+			const PColor col_q = img_.Color(xc, yr);
+			const sint32 dc = abs(col_p.b - col_q.b) + abs(col_p.g - col_q.g) + abs(col_p.r - col_q.r);
+#ifdef USE_FAST_EXP
+			const auto w = fast_exp(double(-dc / gamma_));
+#else
+			const auto w = exp(-dc / gamma_);
+#endif
+			w_q = static_cast<uint8>(std::min(255.0, w * 255.0 + 0.5));
+		}
+	}
+
+	// 按行权值和降序排列行序
+	if (order) {
+		vector<sint32> row_sum(patch_size_, 0);
+		for (sint32 r = 0; r < patch_size_; r++) {
+			for (sint32 c = 0; c < patch_size_; c++) {
+				row_sum[r] += weights[r * patch_size_ + c];
+			}
+			order[r] = static_cast<uint16>(r);
+		}
+		std::stable_sort(order, order + patch_size_, [&row_sum](const uint16& a, const uint16& b) {
+			return row_sum[a] > row_sum[b];
+		});
+	}
+}
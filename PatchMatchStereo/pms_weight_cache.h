@@ -0,0 +1,148 @@
+/* -*-c++-*- PatchMatchStereo - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+*			  https://github.com/ethan-li-coding
+* Describe	: header of pms_weight_cache
+*/
+
+#ifndef PATCH_MATCH_STEREO_WEIGHT_CACHE_H_
+#define PATCH_MATCH_STEREO_WEIGHT_CACHE_H_
+#include "pms_types.h"
+
+
+/**
+ * @brief 自适应支持权值缓存类
+ * 聚合代价中的权值w = exp(-dc/gamma)只与本视图图像、中心像素及块内偏移有关, 与待测平面无关,
+ * 因此每个像素的权值块(patch_size*patch_size)只需计算一次, 以8位量化存储, 供该像素的所有候选平面复用
+ * 图像按TILE_SIZE*TILE_SIZE划分为块, 以块为单位计算和存储; 内存预算不足以容纳全图时,
+ * 只计算被访问到的块, 超出预算时淘汰最久未访问的块
+ * 可选地为每个像素记录按行权值和从大到小排列的行序, 供提前终止的聚合优先访问权值大的行
+ */
+class PMSWeightCache final {
+public:
+	// 分块尺寸
+	static constexpr sint32 TILE_SIZE = 16;
+	// 量化权值到实际权值的比例
+	static constexpr float32 WEIGHT_SCALE = 1.0f / 255.0f;
+
+	/**
+	 * @brief 权值缓存类的带参数构造方法
+	 * @param img			本视图图像
+	 * @param patch_size	局部块大小
+	 * @param gamma			参数gamma值
+	 * @param budget_bytes	内存预算(字节)
+	 * @param is_lazy		是否惰性计算(只在访问时计算所在分块), 否则在预算允许时预先计算全图
+	 * @param is_row_order	是否同时记录每个像素按行权值和降序排列的行序
+	 */
+	PMSWeightCache(const PImageView& img,
+				   const sint32& patch_size, const float32& gamma,
+				   const uint64& budget_bytes, const bool& is_lazy,
+				   const bool& is_row_order = false);
+
+	~PMSWeightCache() = default;
+
+	/**
+	 * @brief 获取像素(x,y)的量化权值块
+	 * @param x				像素x坐标
+	 * @param y				像素y坐标
+	 * @return const uint8*	patch_size*patch_size个量化权值(行优先), 块外像素的权值为0
+	 */
+	inline const uint8* GetWeights(const sint32& x, const sint32& y)
+	{
+		return slots_.data() + Locate(x, y) * patch_area_;
+	}
+
+	/**
+	 * @brief 获取像素(x,y)按行权值和降序排列的行序
+	 * @param x				像素x坐标
+	 * @param y				像素y坐标
+	 * @return const uint16*	patch_size个块内行号(0~patch_size-1), 未记录行序时为nullptr
+	 */
+	inline const uint16* GetRowOrder(const sint32& x, const sint32& y)
+	{
+		if (orders_.empty()) {
+			return nullptr;
+		}
+		return orders_.data() + Locate(x, y) * patch_size_;
+	}
+
+	// 缓存是否可用(预算至少能容纳一个分块)
+	bool IsValid() const { return num_slots_ > 0; }
+
+	// 是否已预先计算全图, 此时访问不修改缓存状态, 可多线程并发读取
+	bool IsResident() const { return is_resident_; }
+
+	// 已计算分块的次数(含淘汰后重新计算)
+	uint64 NumTileLoads() const { return num_loads_; }
+
+private:
+	/**
+	 * @brief 获取像素(x,y)在存储中的序号, 所在分块未计算时先计算
+	 * @param x			像素x坐标
+	 * @param y			像素y坐标
+	 * @return uint64	存储槽号*分块像素数+块内像素序号
+	 */
+	inline uint64 Locate(const sint32& x, const sint32& y)
+	{
+		const sint32 tile = (y / TILE_SIZE) * tiles_x_ + x / TILE_SIZE;
+		sint32 slot = tile_slot_[tile];
+		if (slot < 0) {
+			slot = LoadTile(tile);
+		}
+		if (!is_resident_) {
+			slot_stamp_[slot] = ++stamp_;
+		}
+		return static_cast<uint64>(slot) * (TILE_SIZE * TILE_SIZE) + (y % TILE_SIZE) * TILE_SIZE + x % TILE_SIZE;
+	}
+
+	/**
+	 * @brief 计算分块的权值, 必要时淘汰最久未访问的分块
+	 * @param tile		分块索引
+	 * @return sint32	分块所在的存储槽
+	 */
+	sint32 LoadTile(const sint32& tile);
+
+	/**
+	 * @brief 计算像素(x,y)的权值块
+	 * @param x			像素x坐标
+	 * @param y			像素y坐标
+	 * @param weights	输出, patch_size*patch_size个量化权值
+	 * @param order		输出, 按行权值和降序排列的行序, 为nullptr时不计算
+	 */
+	void ComputeWeights(const sint32& x, const sint32& y, uint8* weights, uint16* order) const;
+
+private:
+	PImageView img_;
+	sint32 width_;
+	sint32 height_;
+	sint32 patch_size_;
+	float32 gamma_;
+
+	// 每个像素的权值块大小
+	sint32 patch_area_;
+	// 每个分块的权值数据大小
+	uint64 tile_bytes_;
+
+	// 分块数
+	sint32 tiles_x_;
+	sint32 tiles_y_;
+
+	// 存储槽数, 每个槽容纳一个分块
+	sint32 num_slots_;
+	// 权值数据
+	vector<uint8> slots_;
+	// 行序数据, 与权值数据按相同的槽存放, 未启用时为空
+	vector<uint16> orders_;
+	// 每个分块所在的存储槽, -1为未计算
+	vector<sint32> tile_slot_;
+	// 每个存储槽存放的分块, -1为空
+	vector<sint32> slot_tile_;
+	// 每个存储槽最近一次访问的时间戳
+	vector<uint64> slot_stamp_;
+	uint64 stamp_;
+	// 全图已预先计算, 不再淘汰
+	bool is_resident_;
+
+	uint64 num_loads_;
+};
+
+#endif
@@ -0,0 +1,386 @@
+/* -*-c++-*- PatchMatchStereo - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+*			  https://github.com/ethan-li-coding
+* Describe	: batch matching with a pipelined driver
+*/
+
+#include "stdafx.h"
+#include "PatchMatchStereo.h"
+#include "demo_util.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <opencv2/opencv.hpp>
+#if defined(_MSC_VER)
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+using namespace std::chrono;
+
+
+// 一个像对的匹配任务
+struct PairTask {
+	std::string path_left;		// 左图像路径
+	std::string path_right;		// 右图像路径
+	std::string out_prefix;		// 输出视差图的路径前缀
+	sint32 min_disparity = 0;
+	sint32 max_disparity = 64;
+
+	sint32 width = 0;
+	sint32 height = 0;
+	cv::Mat img_left;			// 左图像, 匹配时以视图引用, 不拷贝
+	cv::Mat img_right;			// 右图像
+	vector<float32> disparity;	// 左视图视差图
+	bool is_decoded = false;	// 左右图像是否解码成功且尺寸一致
+	bool is_matched = false;	// 是否匹配成功
+};
+
+/**
+ * \brief 有界阻塞队列, 用于流水线各阶段之间传递任务
+ * 队列满时Push阻塞, 空时Pop阻塞; Close后Pop取完剩余任务返回false
+ */
+template <class T>
+class BoundedQueue {
+public:
+	explicit BoundedQueue(const sint32& capacity) : capacity_(std::max(capacity, 1)), is_closed_(false) {}
+
+	void Push(T item)
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		cv_not_full_.wait(lock, [this] { return static_cast<sint32>(items_.size()) < capacity_; });
+		items_.push_back(std::move(item));
+		cv_not_empty_.notify_one();
+	}
+
+	bool Pop(T& item)
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		cv_not_empty_.wait(lock, [this] { return !items_.empty() || is_closed_; });
+		if (items_.empty()) {
+			return false;
+		}
+		item = std::move(items_.front());
+		items_.pop_front();
+		cv_not_full_.notify_one();
+		return true;
+	}
+
+	// 不再有新任务
+	void Close()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		is_closed_ = true;
+		cv_not_empty_.notify_all();
+	}
+
+private:
+	std::deque<T> items_;
+	sint32 capacity_;
+	bool is_closed_;
+	std::mutex mutex_;
+	std::condition_variable cv_not_full_;
+	std::condition_variable cv_not_empty_;
+};
+
+// 流水线阶段的统计
+struct StageStat {
+	const char* name;
+	sint32 num_threads;
+	std::atomic<sint64> busy_us;	// 各线程处理任务的耗时之和(微秒), 不含等待队列的时间
+	StageStat(const char* _name, const sint32& _num_threads) : name(_name), num_threads(_num_threads), busy_us(0) {}
+};
+
+// 读取像对清单, 每行: 左图像路径 右图像路径 [最小视差 最大视差 [输出路径前缀]], #开头为注释
+bool LoadManifest(const std::string& path, const std::string& out_dir, vector<PairTask>& tasks);
+// 遍历数据目录, 每个含d_range.txt的子目录(如Data/Cone/)为一个像对, 目录中按文件名排序的前两幅png图像分别为左右图像,
+// 以另一幅图像的文件名开头的png(如之前写出的im2.png-d.png)不作为输入
+bool LoadDataDirectory(const std::string& dir, const std::string& out_dir, vector<PairTask>& tasks);
+// 匹配参数, 与单像对示例程序相同
+PMSOption MakeOption();
+// 创建目录(只创建最后一级), 已存在时也返回true
+bool MakeDirectory(const std::string& path);
+
+
+/**
+ * @brief 批量匹配: 图像解码、匹配、视差图编码三个阶段流水执行, 匹配阶段每个线程持有一个预先初始化的匹配实例
+ * @param argv 2
+ * @param argc argc[1]: 像对清单文件或数据目录; argc[2]: 输出目录[可选, 清单默认与左图像同目录, 数据目录默认为其下的output/]; argc[3]: 匹配线程数[可选, 默认CPU核数]
+ * @param eg. ../Data
+ * @param eg. pairs.txt ./out 8
+ * @return
+ */
+int main(int argv, char** argc)
+{
+	if (argv < 2) {
+		std::cout << "参数过少, 请指定像对清单文件或数据目录!" << std::endl;
+		return -1;
+	}
+	const std::string input = argc[1];
+	const std::string out_dir = argv < 3 ? "" : argc[2];
+	sint32 num_engines = argv < 4 ? 0 : atoi(argc[3]);
+	if (num_engines <= 0) {
+		num_engines = std::max(1, static_cast<sint32>(std::thread::hardware_concurrency()));
+	}
+
+	vector<PairTask> tasks;
+	// 数据目录未指定输出目录时写入其下的output/, 避免输出的视差图被下次运行当作输入图像
+	const std::string data_out_dir = out_dir.empty() ? input + "/output" : out_dir;
+	std::string output_dir;
+	if (LoadDataDirectory(input, data_out_dir, tasks)) {
+		output_dir = data_out_dir;
+	}
+	else if (LoadManifest(input, out_dir, tasks)) {
+		output_dir = out_dir;
+	}
+	else {
+		std::cout << "读取像对清单失败!" << std::endl;
+		return -1;
+	}
+	if (!output_dir.empty() && !MakeDirectory(output_dir)) {
+		std::cout << "创建输出目录失败: " << output_dir << std::endl;
+		return -1;
+	}
+	printf("Pairs : %d, matching threads : %d\n", static_cast<sint32>(tasks.size()), num_engines);
+
+	// 各阶段之间的队列容量与匹配线程数相同: 每个匹配线程处理一个像对时, 下一个像对已解码等待(双缓冲)
+	using TaskPtr = std::unique_ptr<PairTask>;
+	BoundedQueue<TaskPtr> decoded(num_engines);
+	BoundedQueue<TaskPtr> matched(num_engines);
+	StageStat stat_decode("decode", 1);
+	StageStat stat_match("match", num_engines);
+	StageStat stat_encode("encode", 1);
+
+	const auto busy_since = [](const steady_clock::time_point& start, StageStat& stat) {
+		stat.busy_us += duration_cast<microseconds>(steady_clock::now() - start).count();
+	};
+
+	const auto start = steady_clock::now();
+
+	// 解码阶段
+	std::thread decoder([&] {
+		for (auto& task : tasks) {
+			const auto t0 = steady_clock::now();
+			TaskPtr item(new PairTask(std::move(task)));
+			item->img_left = cv::imread(item->path_left, cv::IMREAD_COLOR);
+			item->img_right = cv::imread(item->path_right, cv::IMREAD_COLOR);
+			const cv::Mat& img_left = item->img_left;
+			const cv::Mat& img_right = item->img_right;
+			if (img_left.data != nullptr && img_right.data != nullptr &&
+				img_left.rows == img_right.rows && img_left.cols == img_right.cols) {
+				item->width = img_left.cols;
+				item->height = img_left.rows;
+				item->is_decoded = true;
+			}
+			busy_since(t0, stat_decode);
+			decoded.Push(std::move(item));
+		}
+		decoded.Close();
+	});
+
+	// 匹配阶段: 每个线程一个匹配实例, 图像尺寸或视差范围变化时才重新初始化
+	vector<std::thread> matchers;
+	std::atomic<sint32> num_active(num_engines);
+	for (sint32 n = 0; n < num_engines; n++) {
+		matchers.emplace_back([&] {
+			PatchMatchStereo pms;
+			PMSOption option = MakeOption();
+			sint32 width = 0, height = 0;
+			TaskPtr item;
+			while (decoded.Pop(item)) {
+				const auto t0 = steady_clock::now();
+				if (item->is_decoded) {
+					if (item->width != width || item->height != height ||
+						item->min_disparity != option.min_disparity || item->max_disparity != option.max_disparity) {
+						width = item->width;
+						height = item->height;
+						option.min_disparity = item->min_disparity;
+						option.max_disparity = item->max_disparity;
+						if (!pms.Reset(width, height, option)) {
+							width = height = 0;
+						}
+					}
+					item->disparity.resize(item->width * item->height);
+					const PImageView view_left(item->img_left.data, width, height,
+											   static_cast<sint64>(item->img_left.step), PixelFormat::BGR);
+					const PImageView view_right(item->img_right.data, width, height,
+												static_cast<sint64>(item->img_right.step), PixelFormat::BGR);
+					item->is_matched = width > 0 && pms.Match(view_left, view_right, item->disparity.data());
+				}
+				// 图像数据不再需要, 尽早释放
+				item->img_left.release();
+				item->img_right.release();
+				busy_since(t0, stat_match);
+				matched.Push(std::move(item));
+			}
+			if (--num_active == 0) {
+				matched.Close();
+			}
+		});
+	}
+
+	// 编码阶段, 在主线程执行
+	sint32 num_done = 0, num_decode_failed = 0, num_match_failed = 0;
+	TaskPtr item;
+	while (matched.Pop(item)) {
+		const auto t0 = steady_clock::now();
+		if (!item->is_decoded) {
+			std::cout << "图像读取失败或左右尺寸不一致: " << item->path_left << " " << item->path_right << std::endl;
+			num_decode_failed++;
+		}
+		else if (!item->is_matched) {
+			std::cout << "匹配失败: " << item->path_left << " " << item->path_right << std::endl;
+			num_match_failed++;
+		}
+		else {
+			SaveDisparityMap(item->disparity.data(), item->width, item->height, item->out_prefix);
+			num_done++;
+		}
+		busy_since(t0, stat_encode);
+	}
+
+	decoder.join();
+	for (auto& matcher : matchers) {
+		matcher.join();
+	}
+	const float64 seconds = duration_cast<microseconds>(steady_clock::now() - start).count() / 1e6;
+
+	// 吞吐量及各阶段利用率(处理任务的时间占线程总时间的比例)
+	const sint32 num_failed = num_decode_failed + num_match_failed;
+	printf("Done! %d pairs (%d decode failed, %d match failed) in %lf s, %lf pairs/s\n", num_done,
+		   num_decode_failed, num_match_failed, seconds, seconds > 0.0 ? (num_done + num_failed) / seconds : 0.0);
+	for (const StageStat* stat : { &stat_decode, &stat_match, &stat_encode }) {
+		const float64 busy = stat->busy_us.load() / 1e6;
+		printf("Stage %-6s : %d thread(s), busy %lf s, utilization %.1lf%%\n", stat->name, stat->num_threads,
+			   busy, seconds > 0.0 ? busy / (seconds * stat->num_threads) * 100.0 : 0.0);
+	}
+	return num_failed == 0 ? 0 : -2;
+}
+
+// 输出路径前缀: 指定了输出目录时为输出目录下的name, 否则为左图像路径(与单像对示例程序相同)
+static std::string OutPrefix(const std::string& out_dir, const std::string& name, const std::string& path_left)
+{
+	return out_dir.empty() ? path_left : out_dir + "/" + name;
+}
+
+// 路径中的文件名或目录名(不含扩展名)
+static std::string BaseName(const std::string& path)
+{
+	const size_t end = path.find_last_not_of("/\\") + 1;
+	const size_t begin = path.find_last_of("/\\", end - 1) + 1;
+	std::string name = path.substr(begin, end - begin);
+	const size_t dot = name.find_last_of('.');
+	return dot == std::string::npos || dot == 0 ? name : name.substr(0, dot);
+}
+
+bool LoadManifest(const std::string& path, const std::string& out_dir, vector<PairTask>& tasks)
+{
+	std::ifstream fs(path);
+	if (!fs.is_open()) {
+		return false;
+	}
+	std::string line;
+	while (std::getline(fs, line)) {
+		std::istringstream ss(line);
+		PairTask task;
+		if (!(ss >> task.path_left) || task.path_left[0] == '#' || !(ss >> task.path_right)) {
+			continue;
+		}
+		sint32 min_disparity, max_disparity;
+		if (ss >> min_disparity >> max_disparity) {
+			task.min_disparity = min_disparity;
+			task.max_disparity = max_disparity;
+		}
+		std::string prefix;
+		task.out_prefix = (ss >> prefix) ? prefix : OutPrefix(out_dir, BaseName(task.path_left), task.path_left);
+		tasks.push_back(std::move(task));
+	}
+	return !tasks.empty();
+}
+
+bool LoadDataDirectory(const std::string& dir, const std::string& out_dir, vector<PairTask>& tasks)
+{
+	vector<cv::String> ranges;
+	try {
+		cv::glob(dir + "/*/d_range.txt", ranges, false);
+	}
+	catch (const cv::Exception&) {
+		return false;
+	}
+	for (const auto& range : ranges) {
+		const std::string scene_dir = std::string(range).substr(0, range.size() - std::string("/d_range.txt").size());
+		vector<cv::String> pngs;
+		cv::glob(scene_dir + "/*.png", pngs, false);
+		// 跳过以另一幅图像的文件名开头的输出图像(如示例程序写在左图像旁的im2.png-d.png/im2.png-c.png)
+		vector<std::string> images;
+		for (const auto& png : pngs) {
+			const std::string path = png;
+			const bool is_output = std::any_of(pngs.begin(), pngs.end(), [&path](const cv::String& other) {
+				return other.size() < path.size() && path.compare(0, other.size(), std::string(other)) == 0;
+			});
+			if (!is_output) {
+				images.push_back(path);
+			}
+		}
+		if (images.size() < 2) {
+			continue;
+		}
+		std::sort(images.begin(), images.end());
+
+		PairTask task;
+		task.path_left = images[0];
+		task.path_right = images[1];
+		// d_range.txt: dmin=最小视差, dmax=最大视差
+		std::ifstream fs(range);
+		std::string line;
+		while (std::getline(fs, line)) {
+			const size_t eq = line.find('=');
+			if (eq == std::string::npos) continue;
+			const std::string key = line.substr(0, eq);
+			if (key == "dmin") task.min_disparity = atoi(line.c_str() + eq + 1);
+			else if (key == "dmax") task.max_disparity = atoi(line.c_str() + eq + 1);
+		}
+		task.out_prefix = OutPrefix(out_dir, BaseName(scene_dir), task.path_left);
+		tasks.push_back(std::move(task));
+	}
+	return !tasks.empty();
+}
+
+PMSOption MakeOption()
+{
+	PMSOption pms_option;
+	pms_option.patch_size = 35;
+	pms_option.gamma = 10.0f;
+	pms_option.alpha = 0.9f;
+	pms_option.tau_col = 10.0f;
+	pms_option.tau_grad = 2.0f;
+	pms_option.num_iters = 3;
+	pms_option.is_check_lr = true;
+	pms_option.lrcheck_thres = 1.0f;
+	pms_option.is_fill_holes = false;
+	pms_option.is_fource_fpw = false;
+	pms_option.is_integer_disp = false;
+	// 多个像对已在不同线程上并行, 单个像对内不再多线程
+	pms_option.propagation_mode = PropagationMode::SEQUENTIAL;
+	pms_option.num_threads = 1;
+	return pms_option;
+}
+
+bool MakeDirectory(const std::string& path)
+{
+#if defined(_MSC_VER)
+	return _mkdir(path.c_str()) == 0 || errno == EEXIST;
+#else
+	return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+}
@@ -0,0 +1,34 @@
+/* -*-c++-*- PatchMatchStereo - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+*			  https://github.com/ethan-li-coding
+* Describe	: implement of demo_util
+*/
+
+#include "stdafx.h"
+#include "demo_util.h"
+#include <cmath>
+#include <opencv2/opencv.hpp>
+
+void SaveDisparityMap(const float32* disp_map,
+					  const sint32& width, const sint32& height, const std::string& path)
+{
+	cv::Mat disp_mat = cv::Mat(height, width, CV_8UC1);
+	float32 min_disp = float32(width), max_disp = -float32(width);
+	for (sint32 i = 0; i < width * height; i++) {
+		const float32 disp = std::abs(disp_map[i]);
+		if (disp != Invalid_Float) {
+			min_disp = std::min(min_disp, disp);
+			max_disp = std::max(max_disp, disp);
+		}
+	}
+	for (sint32 i = 0; i < width * height; i++) {
+		const float32 disp = std::abs(disp_map[i]);
+		disp_mat.data[i] = (disp == Invalid_Float || max_disp <= min_disp) ? 0 :
+			static_cast<uint8>((disp - min_disp) / (max_disp - min_disp) * 255);
+	}
+
+	cv::imwrite(path + "-d.png", disp_mat);
+	cv::Mat disp_color;
+	applyColorMap(disp_mat, disp_color, cv::COLORMAP_JET);
+	cv::imwrite(path + "-c.png", disp_color);
+}
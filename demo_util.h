@@ -0,0 +1,23 @@
+/* -*-c++-*- PatchMatchStereo - Copyright (C) 2020.
+* Author	: Yingsong Li(Ethan Li) <ethan.li.whu@gmail.com>
+*			  https://github.com/ethan-li-coding
+* Describe	: header of demo_util, helpers shared by the demo executables
+*/
+
+#ifndef PATCH_MATCH_STEREO_DEMO_UTIL_H_
+#define PATCH_MATCH_STEREO_DEMO_UTIL_H_
+#include "pms_types.h"
+#include <string>
+
+/**
+ * @brief 保存视差图: 视差绝对值按有效范围线性拉伸到0~255, 无效视差为0
+ * 输出灰度图path-d.png及伪彩色图path-c.png
+ * @param disp_map	视差图
+ * @param width		宽
+ * @param height	高
+ * @param path		输出路径前缀
+ */
+void SaveDisparityMap(const float32* disp_map,
+					  const sint32& width, const sint32& height, const std::string& path);
+
+#endif
@@ -6,6 +6,7 @@
 
 #include "stdafx.h"
 #include "PatchMatchStereo.h"
+#include "demo_util.h"
 #include <chrono>
 #include <iostream>
 #include <opencv2/opencv.hpp>
@@ -16,11 +17,8 @@ using namespace std::chrono;
 // 显示视差图
 void ShowDisparityMap(const float32* disp_map,
 					  const sint32& width, const sint32& height, const std::string& name);
-// 保存视差图
-void SaveDisparityMap(const float32* disp_map,
-					  const sint32& width, const sint32& height, const std::string& path);
 // 保存视差点云, 需要根据相机参数设置相关参数值
-void SavePointCloud(const uint8* img_bytes,
+void SavePointCloud(const PImageView& img,
 					const float32* disp_map, const sint32& width, const sint32& height, const std::string& path);
 
 
@@ -59,19 +57,9 @@ int main(int argv, char** argc)
 	const sint32 width = static_cast<uint32>(img_left.cols);
 	const sint32 height = static_cast<uint32>(img_right.rows);
 
-	// 左右图像的彩色数据
-	auto bytes_left = new uint8[width * height * 3];
-	auto bytes_right = new uint8[width * height * 3];
-	for (int i = 0; i < height; i++) {
-		for (int j = 0; j < width; j++) {
-			bytes_left[i * 3 * width + 3 * j] = img_left.at<cv::Vec3b>(i, j)[0];
-			bytes_left[i * 3 * width + 3 * j + 1] = img_left.at<cv::Vec3b>(i, j)[1];
-			bytes_left[i * 3 * width + 3 * j + 2] = img_left.at<cv::Vec3b>(i, j)[2];
-			bytes_right[i * 3 * width + 3 * j] = img_right.at<cv::Vec3b>(i, j)[0];
-			bytes_right[i * 3 * width + 3 * j + 1] = img_right.at<cv::Vec3b>(i, j)[1];
-			bytes_right[i * 3 * width + 3 * j + 2] = img_right.at<cv::Vec3b>(i, j)[2];
-		}
-	}
+	// 左右图像的视图, 直接引用cv::Mat的数据(b,g,r, 行间距为step)
+	const PImageView view_left(img_left.data, width, height, static_cast<sint64>(img_left.step), PixelFormat::BGR);
+	const PImageView view_right(img_right.data, width, height, static_cast<sint64>(img_right.step), PixelFormat::BGR);
 	printf("Done!\n");
 
 	PMSOption pms_option; // PMS匹配参数
@@ -93,6 +81,8 @@ int main(int argv, char** argc)
 	pms_option.lrcheck_thres = 1.0f;
 	// 视差图填充
 	pms_option.is_fill_holes = false;
+	// 只计算左视图(不做一致性检查时约快一倍)
+	pms_option.is_left_view_only = false;
 	// 前端平行窗口
 	pms_option.is_fource_fpw = false;
 	// 整数视差精度
@@ -117,7 +107,7 @@ int main(int argv, char** argc)
 	start = std::chrono::steady_clock::now();
 	// 匹配, disparity数组保存子像素的视差结果
 	auto disparity = new float32[uint32(width * height)]();		
-	if (!pms.Match(bytes_left, bytes_right, disparity)) {
+	if (!pms.Match(view_left, view_right, disparity)) {
 		std::cout << "PMS匹配失败!" << std::endl;
 		return -2;
 	}
@@ -125,6 +115,32 @@ int main(int argv, char** argc)
 	tt = duration_cast<std::chrono::milliseconds>(end - start);
 	printf("Done! Timing : %lf s\n", tt.count() / 1000.0);
 
+	// 分块传播的耗时统计
+	const auto& tile_timings = pms.GetTileTimings();
+	for (sint32 view = 0; view < 2; view++) {
+		sint32 num_tiles = 0;
+		float64 sum = 0.0;
+		const PTileTiming* slowest = nullptr;
+		const PTileTiming* fastest = nullptr;
+		for (const auto& tile : tile_timings) {
+			if (tile.view != view) continue;
+			num_tiles++;
+			sum += tile.seconds;
+			if (!slowest || tile.seconds > slowest->seconds) slowest = &tile;
+			if (!fastest || tile.seconds < fastest->seconds) fastest = &tile;
+		}
+		if (num_tiles == 0) continue;
+		printf("Tiles(%s view) : %d, mean %lf s, min %lf s at (%d,%d), max %lf s at (%d,%d)\n",
+			   view == 0 ? "left" : "right", num_tiles, sum / num_tiles,
+			   fastest->seconds, fastest->x, fastest->y, slowest->seconds, slowest->x, slowest->y);
+	}
+
+	// 活跃集模式每次迭代的活跃像素及平面变化比例
+	for (const auto& stat : pms.GetIterationStats()) {
+		printf("Iteration %d (%s view) : active %.2lf%%, changed %.2lf%%\n", stat.iter,
+			   stat.view == 0 ? "left" : "right", stat.active_ratio * 100.0, stat.changed_ratio * 100.0);
+	}
+
 #if 0
 	// 显示梯度图
 	cv::Mat grad_left_x = cv::Mat(height, width, CV_8UC1);
@@ -157,18 +173,16 @@ int main(int argv, char** argc)
 	// cv::waitKey(0);
 	// 保存视差图
 	SaveDisparityMap(pms.GetDisparityMap(0), width, height, path_left);
-	SaveDisparityMap(pms.GetDisparityMap(1), width, height, path_right);
+	if (!pms_option.is_left_view_only) {
+		SaveDisparityMap(pms.GetDisparityMap(1), width, height, path_right);
+	}
 	// 保存点云
-	// SavePointCloud(bytes_left, pms.GetDisparityMap(0), width, height, path_left);
-	// SavePointCloud(bytes_right, pms.GetDisparityMap(1), width, height, path_left);
+	// SavePointCloud(view_left, pms.GetDisparityMap(0), width, height, path_left);
+	// SavePointCloud(view_right, pms.GetDisparityMap(1), width, height, path_left);
 
 	// 释放内存
 	delete[] disparity;
 	disparity = nullptr;
-	delete[] bytes_left;
-	bytes_left = nullptr;
-	delete[] bytes_right;
-	bytes_right = nullptr;
 
 	// system("pause");
 	return 0;
@@ -207,39 +221,7 @@ void ShowDisparityMap(const float32* disp_map,
 
 }
 
-void SaveDisparityMap(const float32* disp_map,
-					  const sint32& width, const sint32& height, const std::string& path)
-{
-	const cv::Mat disp_mat = cv::Mat(height, width, CV_8UC1);
-	float32 min_disp = float32(width), max_disp = -float32(width);
-	for (sint32 i = 0; i < height; i++) {
-		for (sint32 j = 0; j < width; j++) {
-			const float32 disp = abs(disp_map[i * width + j]);
-			if (disp != Invalid_Float) {
-				min_disp = std::min(min_disp, disp);
-				max_disp = std::max(max_disp, disp);
-			}
-		}
-	}
-	for (sint32 i = 0; i < height; i++) {
-		for (sint32 j = 0; j < width; j++) {
-			const float32 disp = abs(disp_map[i * width + j]);
-			if (disp == Invalid_Float) {
-				disp_mat.data[i * width + j] = 0;
-			}
-			else {
-				disp_mat.data[i * width + j] = static_cast<uchar>((disp - min_disp) / (max_disp - min_disp) * 255);
-			}
-		}
-	}
-
-	cv::imwrite(path + "-d.png", disp_mat);
-	cv::Mat disp_color;
-	applyColorMap(disp_mat, disp_color, cv::COLORMAP_JET);
-	cv::imwrite(path + "-c.png", disp_color);
-}
-
-void SavePointCloud(const uint8* img_bytes, const float32* disp_map,
+void SavePointCloud(const PImageView& img, const float32* disp_map,
 					const sint32& width, const sint32& height, const std::string& path)
 {
 	float32 B = 193.001;		// 基线
@@ -262,11 +244,8 @@ void SavePointCloud(const uint8* img_bytes, const float32* disp_map,
 			float32 X = Z * (x - x0l) / f;
 			float32 Y = Z * (y - y0l) / f;
 			// X Y Z R G B
-			fprintf(fp_disp_cloud, "%f %f %f %d %d %d\n",
-					X, Y, Z,
-					img_bytes[y * width * 3 + 3 * x + 2],
-					img_bytes[y * width * 3 + 3 * x + 1],
-					img_bytes[y * width * 3 + 3 * x]);
+			const PColor col = img.Color(x, y);
+			fprintf(fp_disp_cloud, "%f %f %f %d %d %d\n", X, Y, Z, col.r, col.g, col.b);
 		}
 	}
 	fclose(fp_disp_cloud);